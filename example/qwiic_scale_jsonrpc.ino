@@ -1,406 +1,165 @@
+// Every feature of the library is enabled here, which needs more than the 2 KB of RAM of an Uno or
+// Nano: about 2.1 KB of objects before the Serial and Wire buffers and the JSON documents on the
+// stack. Use a Mega 2560 or a 32-bit board, or shrink CAPTURE_SIZE, HUB_SIZE, FLOW_WINDOW and
+// SCALE_RPC_TX_QUEUE_SIZE and drop the features you do not need.
 #include <Wire.h>
 #include "ArduinoJson.h"
 #include "QwiicScale.h"
+#include "ScaleRpcServer.h"
+#include "TaskScheduler.h"
 
 // scale configurataion
 #define SERVER_ID         0
 #define SEND_RATE         10 //hz
 #define SAMPLERATE        80
 #define AVG_SIZE          8
-
-// jsonrpc error codes
-#define PARSE_ERROR       -32700
-#define INVALID_REQUEST   -32600
-#define METHOD_NOT_FOUND  -32601
-#define INVALID_PARAMS    -32602
-#define INTERNAL_ERROR    -32603
-
-// operation modes
-#define REQUEST 0
-#define CONTINUOUS 1
+#define FLOW_WINDOW       16 //samples in the flow rate fit, 200ms at 80 SPS
+#define DOSE_VALVE_PIN    7  //driven HIGH while a start_dose fill is running
+#define CAPTURE_SIZE      64 //samples kept by arm_capture/get_capture, 3 bytes each
+#define HUB_SIZE          16 //conversions shared by the stream and the blocking averages, 12 bytes each;
+                             //the stream drops what a longer average (up to 64) overwrites
+#define BIQUAD_SECTIONS   2  //IIR filter order / 2, loaded with set_biquad
+#define MAINS_FREQUENCY   50 //Hz, hum notched out at the aliased frequencies without channel 2; 0 for none
+#define MAINS_HARMONICS   2  //notch sections, one per harmonic
+#define CHANNEL2_NONE       0
+#define CHANNEL2_VIBRATION  1 //reference cell or accelerometer bridge on the same frame
+#define CHANNEL2_EXCITATION 2 //divider or unloaded bridge across the excitation
+#define CHANNEL2_REFERENCE  CHANNEL2_NONE
+#define REFERENCE_INTERVAL  2 //channel 1 conversions per channel 2 conversion
+#define CANCELLER_TAPS      4
+#define NOMINAL_LOCATION    20 //EEPROM address of the excitation nominal, a long after the calibration
+#define CANCELLER_FREEZE    2000 //counts of channel 1 error that pause adaptation, a few times the vibration; 0 never
+#define TEMPERATURE_INTERVAL 800 //channel 1 conversions per temperature conversion, 10s at 80 SPS; 0 for none
+#define RECAL_THRESHOLD     5.0f //degrees C of drift that trigger an AFE recalibration; 0 for none
+#define CREEP_COMPENSATION  0    //1 to remove cell creep under long static loads, fitted with qwiic_replay --fit-creep
+#define CREEP_COEFFICIENT   0.0f //fraction of the load, loaded with set_creep
+#define CREEP_TIME_CONSTANT 1800 //seconds
+#define CREEP_THRESHOLD     200  //counts of load change that restart the creep curve
+#define INTEGRITY_BUDGET    35   //I2C bytes/s spent checking the NAU7802 configuration, 35 is one check a second; 0 for none
 
 // serial settings
 #define BAUDRATE          115200
 
+// task periods and budgets (us)
+#define ACQUIRE_PERIOD    1000   // poll the DRDY bit ~12 times per conversion at 80 SPS
+#define ACQUIRE_BUDGET    1000
+#define FILTER_PERIOD     (1000000UL / SAMPLERATE)
+#define FILTER_BUDGET     500
+#define RPC_PERIOD        2000
+#define RPC_BUDGET        2000   // blocking methods (tare, calibrate) show up as overruns
+#define RPC_CHARS         32     // request characters parsed per run
+#define TX_PERIOD         500
+#define TX_BUDGET         500
+#define EEPROM_PERIOD     5000   // one byte per run, longer than the 3.3ms AVR write cycle
+#define EEPROM_BUDGET     4000
+
+// The type of Serial differs between boards (HardwareSerial, Serial_, ...)
+typedef ScaleRpcServer<decltype(Serial)> RpcServer;
+
 // global variables
 QwiicScale Scale;
-int sample_mode = REQUEST;
-
-// macros
-#define STRCMPI(x,y) !strcasecmp(x,y)
-#define FREEZE while(1) continue;
-
-
-// Dispatches on the requested jsonrpc method
-void dispatch(const unsigned long id, const char *method, const JsonVariant &params)
-{
-  if (STRCMPI(method, "tare"))
-  {
-    tare(id, params);
-  }
-  else if (STRCMPI(method, "calibrate"))
-  {
-    calibrate(id, params);
-  }
-  else if (STRCMPI(method, "reset_calibration"))
-  {
-    reset_calibration(id, params);
-  }
-  else if (STRCMPI(method, "get_calibration"))
-  {
-    get_calibration(id, params);
-  }
-  else if (STRCMPI(method, "get_average_weight"))
-  {
-    get_average_weight(id, params);
-  }
-  else if (STRCMPI(method, "get_average_reading"))
-  {
-    get_average_reading(id, params);
-  }
-  else if (STRCMPI(method, "get_status"))
-  {
-    get_status(id, params);
-  }
-  else if (STRCMPI(method, "get_sensors"))
-  {
-    get_sensors(id, params);
-  }
-  //  else if (STRCMPI(method, "reset")) {
-  //    reset_scale(id, params);
-  //  }
-  //  else if (STRCMPI(method, "power_up")) {
-  //    power_up(id, params);
-  //  }
-  //  else if (STRCMPI(method, "power_down")) {
-  //    power_down(id, params);
-  //  }
-  else if (STRCMPI(method, "change_mode"))
-  {
-    change_mode(id, params);
-  }
-  else
-  {
-    jsonrpc_method_not_found(id);
-  }
-}
-
-// Scale RPC Methods
-// All Methods must have the signature void f(uint32_t id, const JsonVariant& params)
-void calibrate(const unsigned long id, const JsonVariant &params)
-{
-  StaticJsonDocument<256> reply;
-
-  float weight = params["calibration_weight"] | -1.0f;
-  long num_readings = params["average_size"] | -1L;
-
-  if ((weight < 1) || (weight > 500))
-  {
-    jsonrpc_invalid_params(id, F("By-name parameter 'weight' is missing or outside range."));
-    return;
-  }
-  else if ((num_readings < 1) || (num_readings > 64))
-  {
-    jsonrpc_invalid_params(id, F("By-name parameter 'average_size' is missing or > 64."));
-    return;
-  }
-
-  error_code_t err = Scale.calculateCalibrationFactor(weight, num_readings);
-
-  if (!err)
-  {
-    reply["id"] = id;
-    JsonObject result = reply.createNestedObject("result");
-    result["timestamp"] = millis();
-    result["calibration_factor"] = Scale.getCalibrationFactor();
-    result["zero_offset"] = Scale.getZeroOffset();
-    serializeJson(reply, Serial);
-    Serial.println();
-  }
-  else
-  {
-    jsonrpc_scale_error(id, err);
-  }
-}
-
-// Tare the scale so that current value is new zero point.
-void tare(const unsigned long id, const JsonVariant &params)
-{
-  StaticJsonDocument<128> reply;
-  long num_readings = params["average_size"] | -1L;
-
-  if ((num_readings < 1) || (num_readings > 64))
-  {
-    jsonrpc_invalid_params(id, F("By-name parameter 'average_size' is missing or > 64."));
-    return;
-  }
-
-  error_code_t err = Scale.calculateZeroOffset(num_readings);
-
-  if (!err)
-  {
-    reply["id"] = id;
-    JsonObject result = reply.createNestedObject("result");
-    result["timestamp"] = millis();
-    result["calibration_factor"] = Scale.getCalibrationFactor();
-    result["zero_offset"] = Scale.getZeroOffset();
-    serializeJson(reply, Serial);
-    Serial.println();
-  }
-  else
-  {
-    jsonrpc_scale_error(id, err);
-  }
-}
-
-// Change the mode the microcontroller
-void change_mode(const unsigned long id, const JsonVariant &params)
+FlowRateEstimator<FLOW_WINDOW> Flow;
+DosingController Doser(DOSE_VALVE_PIN);
+CaptureEngine<CAPTURE_SIZE, Packed24Storage> Capture;
+AcquisitionHub<HUB_SIZE> Hub;
+BiquadCascade<BIQUAD_SECTIONS> Biquad;
+BiquadCascade<MAINS_HARMONICS> Notch;
+VibrationCanceller<CANCELLER_TAPS> Canceller;
+ExcitationCompensator Excitation;
+TemperatureCompensator Temperature;
+CreepCompensator Creep;
+RpcServer Server(Serial, Scale, SERVER_ID, AVG_SIZE);
+TaskScheduler<5> Scheduler;
+
+task_id_t acquire_task_id, filter_task_id, rpc_task_id, tx_task_id, eeprom_task_id;
+int32_t storedNominal;
+
+// Report the scheduler statistics of one task so that latency and jitter can be bounded.
+// Pass "reset": true to restart the measurement window.
+void get_task_stats(RpcServer &server, const unsigned long id, const JsonVariant &params)
 {
+  long index = params["task"] | 0L;
+  bool reset = params["reset"] | false;
 
-  StaticJsonDocument<128> reply;
-  const char *mode = params["mode"] | "invalid";
-
-  if (STRCMPI(mode, "invalid"))
+  if ((index < 0) || (index >= Scheduler.getTaskCount()))
   {
-    jsonrpc_invalid_params(id, F("By-name parameter 'mode' is missing or invalid"));
+    server.sendInvalidParams(id, F("By-name parameter 'task' is outside range."));
     return;
   }
-  if (STRCMPI(mode, "request"))
-    sample_mode = REQUEST;
-  else if (STRCMPI(mode, "continuous"))
-    sample_mode = CONTINUOUS;
+  const scheduler_task_t *task = Scheduler.getTask(index);
 
-  jsonrpc_ack(id);
-}
-
-void reset_calibration(const unsigned long id, const JsonVariant &params)
-{
-  float cal_factor = params["cal_factor"] | 1.0f;
-  long zero_offset = params["zero_offset"] | 0L;
-  bool cal_state = params["is_calibrated"] | false;
-
-  Scale.setCalibrationFactor(cal_factor);
-  Scale.setZeroOffset(zero_offset);
-  Scale.isCalibrated = cal_state;
-  Scale.calibrationDetected = false;
-  Scale.storeCalibration();
-
-  StaticJsonDocument<128> reply;
+  StaticJsonDocument<256> reply;
   reply["id"] = id;
   JsonObject result = reply.createNestedObject("result");
   result["timestamp"] = millis();
-  result["calibration_factor"] = Scale.getCalibrationFactor();
-  result["zero_offset"] = Scale.getZeroOffset();
-  serializeJson(reply, Serial);
-  Serial.println();
+  result["task_count"] = Scheduler.getTaskCount();
+  result["elapsed_us"] = micros() - Scheduler.getStatsStartTime();
+  result["idle_us"] = Scheduler.getIdleTime();
+  result["tx_dropped"] = server.getTxDropped();
+  result["samples_dropped"] = server.getSamplesDropped();
+  result["name"] = task->name;
+  result["runs"] = task->runs;
+  result["overruns"] = task->overruns;
+  result["missed"] = task->missed;
+  result["cpu_us"] = task->cpu_us;
+  result["max_run_us"] = task->max_run_us;
+  result["max_latency_us"] = task->max_latency_us;
+  server.sendReply(reply);
+
+  if (reset)
+    Scheduler.resetStats();
 }
 
-void get_calibration(const unsigned long id, const JsonVariant &params)
-{
-  StaticJsonDocument<128> reply;
-  reply["id"] = id;
-  JsonObject result = reply.createNestedObject("result");
-  result["timestamp"] = millis();
-  result["calibration_factor"] = Scale.getCalibrationFactor();
-  result["zero_offset"] = Scale.getZeroOffset();
-  serializeJson(reply, Serial);
-  Serial.println();
-}
+// Scheduler Tasks
+// All tasks must have the signature void f(void *context)
 
-void get_average_reading(const unsigned long id, const JsonVariant &params)
+// Moves at most one conversion from the NAU7802 to the server
+void acquire_task(void *context)
 {
-  StaticJsonDocument<128> reply;
-  long num_readings = params["average_size"] | -1L;
+  bool new_sample = false;
+  error_code_t err = Server.acquire(&new_sample);
 
-  if ((num_readings < 1) || (num_readings > 64))
-  {
-    jsonrpc_invalid_params(id, F("By-name parameter 'average_size' is missing or > 64."));
-    return;
-  }
-
-  int32_t avg_reading;
-  error_code_t err = Scale.getAverageReading(&avg_reading, num_readings);
-
-  if (!err)
-  {
-    reply["id"] = id;
-    JsonObject result = reply.createNestedObject("result");
-    result["timestamp"] = millis();
-    result["raw_avg"] = avg_reading;
-    result["num_samples"] = num_readings;
-    serializeJson(reply, Serial);
-    Serial.println();
-  }
-  else
-  {
-    jsonrpc_scale_error(id, err);
-  }
+  if (err || new_sample)
+    Scheduler.trigger(filter_task_id);
 }
 
-void get_average_weight(const unsigned long id, const JsonVariant &params)
+void filter_task(void *context)
 {
-  StaticJsonDocument<128> reply;
-  long num_readings = params["average_size"] | -1L;
-  bool allow_negative = params["allow_negative"] | true;
-
-  if ((num_readings < 1) || (num_readings > 64))
-  {
-    jsonrpc_invalid_params(id, F("By-name parameter 'num_readings' is missing or > 64."));
-    return;
-  }
-
-  float avg_weight;
-  error_code_t err = Scale.getAverageWeight(&avg_weight, num_readings, allow_negative);
-
-  if (!err)
-  {
-    reply["id"] = id;
-    JsonObject result = reply.createNestedObject("result");
-    result["timestamp"] = millis();
-    result["weight_avg"] = avg_weight;
-    result["num_samples"] = num_readings;
-    serializeJson(reply, Serial);
-    Serial.println();
-  }
-  else
-  {
-    jsonrpc_scale_error(id, err);
-  }
+  Server.filter();
 }
 
-void get_status(const unsigned long id, const JsonVariant &params)
+void rpc_task(void *context)
 {
-  StaticJsonDocument<128> reply;
-  reply["id"] = id;
-  JsonObject result = reply.createNestedObject("result");
-  result["timestamp"] = millis();
-  result["is_scale_connected"] = Scale.isConnected();
-  result["is_calibrated"] = Scale.isCalibrated;
-  result["is_cal_detected"] = Scale.calibrationDetected;
-  serializeJson(reply, Serial);
-  Serial.println();
+  Server.pollRequests(RPC_CHARS);
 }
 
-void get_sensors(uint32_t id, const JsonVariant &params)
+void tx_task(void *context)
 {
-  float avg_weight;
-  StaticJsonDocument<128> reply;
-
-  error_code_t err = Scale.getAverageWeight(&avg_weight, AVG_SIZE);
-
-  if (!err)
-  {
-    reply["id"] = id;
-    JsonObject result = reply.createNestedObject("result");
-    result["timestamp"] = millis();
-    result["weight_avg"] = avg_weight;
-    result["num_samples"] = AVG_SIZE;
-    serializeJson(reply, Serial);
-    Serial.println();
-  }
-  else
-  {
-    jsonrpc_scale_error(SERVER_ID, err);
-  }
+  Server.drainReplies();
 }
 
-// Continuous Streaming Mode
-void stream_sensors(void)
+// Commits pending calibration values one byte at a time, then the excitation nominal
+void eeprom_task(void *context)
 {
-  static bool streaming_error;
-  float avg_weight;
-  StaticJsonDocument<128> reply;
+  if (Scale.serviceEEPROM())
+    return;
 
-  error_code_t err = Scale.getAverageWeight(&avg_weight, AVG_SIZE);
+#if CHANNEL2_REFERENCE == CHANNEL2_EXCITATION
+  int32_t nominal = Excitation.getNominal();
+  if (nominal == storedNominal)
+    return;
 
-  if (!err)
+  for (uint8_t i = 0; i < sizeof(nominal); i++)
   {
-    streaming_error = false;
-    reply["id"] = SERVER_ID;
-    JsonObject result = reply.createNestedObject("result");
-    result["timestamp"] = millis();
-    result["weight_avg"] = avg_weight;
-    result["num_samples"] = AVG_SIZE;
-    serializeJson(reply, Serial);
-    Serial.println();
-  }
-  else
-  {
-    // Only send the first error encountered
-    if (!streaming_error)
+    uint8_t value = ((uint8_t *)&nominal)[i];
+    if (EEPROM.read(NOMINAL_LOCATION + i) != value)
     {
-      jsonrpc_scale_error(SERVER_ID, err);
-      streaming_error = true;
+      EEPROM.update(NOMINAL_LOCATION + i, value);
+      return;
     }
   }
-}
-
-// Acknowledgement Response
-void jsonrpc_ack(const unsigned long id)
-{
-  StaticJsonDocument<128> reply;
-  reply["id"] = id;
-  JsonObject result = reply.createNestedObject("result");
-  result["timestamp"] = millis();
-  serializeJson(reply, Serial);
-  Serial.println();
-}
-
-// Error Response Helper Functions
-void jsonrpc_scale_error(uint32_t id, error_code_t scale_err)
-{
-  StaticJsonDocument<128> reply;
-  JsonObject err = reply.createNestedObject("error");
-  err["timestamp"] = millis();
-  err["code"] = static_cast<int>(scale_err);
-  err["message"] = Scale.strerror_f(scale_err);
-  reply["id"] = id;
-  serializeJson(reply, Serial);
-  Serial.println();
-}
-
-void jsonrpc_parse_error(const DeserializationError &error)
-{
-  StaticJsonDocument<128> reply;
-  JsonObject err = reply.createNestedObject("error");
-  err["code"] = PARSE_ERROR;
-  err["message"] = F("Error parsing received JSON.");
-  err["data"] = error.f_str();
-  serializeJson(reply, Serial);
-  Serial.println();
-}
-
-void jsonrpc_invalid_request(void)
-{
-  StaticJsonDocument<128> reply;
-  JsonObject err = reply.createNestedObject("error");
-  err["code"] = INVALID_REQUEST;
-  err["message"] = F("The JSON sent is not a valid Request object.");
-  serializeJson(reply, Serial);
-  Serial.println();
-}
-
-void jsonrpc_method_not_found(const unsigned long id)
-{
-  StaticJsonDocument<128> reply;
-  JsonObject err = reply.createNestedObject("error");
-  err["code"] = METHOD_NOT_FOUND;
-  err["message"] = F("The method does not exist.");
-  reply["id"] = id;
-  serializeJson(reply, Serial);
-  Serial.println();
-}
-
-void jsonrpc_invalid_params(const unsigned long id, const __FlashStringHelper *data)
-{
-  StaticJsonDocument<128> reply;
-  JsonObject err = reply.createNestedObject("error");
-  err["code"] = INVALID_PARAMS;
-  err["message"] = F("Invalid method parameter(s).");
-  err["data"] = data;
-  reply["id"] = id;
-  serializeJson(reply, Serial);
-  Serial.println();
+  storedNominal = nominal;
+#endif
 }
 
 // INITIALIZATION (ONLY RUNS ONCE AT THE BEGINNING)
@@ -413,79 +172,117 @@ void setup()
   while (!Serial)
     continue; //Freeze
   Serial.flush();
-  Serial.setTimeout(100);
 
   Wire.begin();
 
-  StaticJsonDocument<256> reply;
+  // Without the scale the server still runs: the acquire task probes for it and initializes it
+  // when it is plugged in, and the stream resumes with a "gap_ms" marker
   err = Scale.begin();
   if (err)
   {
-    jsonrpc_scale_error(SERVER_ID, err);
-    FREEZE
+    Server.sendScaleError(SERVER_ID, err);
   }
-
-  // Configure Scale
-  err = Scale.setSampleRate(NAU7802_SPS_80);
-  if (err)
+  else
   {
-    jsonrpc_scale_error(SERVER_ID, err);
-    FREEZE
-  }
+    // Configure Scale
+    err = Scale.setSampleRate(NAU7802_SPS_80);
+    if (err)
+    {
+      Server.sendScaleError(SERVER_ID, err);
+    }
 
-  // Internal calibration.
-  // Recommended after power up, gain changes, sample rate changes, or channel change
-  err = Scale.calibrateAFE();
-  if (err)
-  {
-    jsonrpc_scale_error(SERVER_ID, err);
-    FREEZE
+    // Internal calibration.
+    // Recommended after power up, gain changes, sample rate changes, or channel change
+    err = Scale.calibrateAFE();
+    if (err)
+    {
+      Server.sendScaleError(SERVER_ID, err);
+    }
   }
 
   // Load zeroOffset and calibrationFactor from EEPROM
   err = Scale.readCalibration();
   if (err)
   {
-    jsonrpc_scale_error(SERVER_ID, err);
+    Server.sendScaleError(SERVER_ID, err);
   }
+
+  // One conversion feeds the stream, tare, calibrate and get_average_*, which no longer
+  // read the ADC themselves
+  Scale.attachHub(&Hub);
+
+  // Stream the flow rate with every average
+  Scale.attachFlowEstimator(&Flow);
+
+  // Dosing valve, controlled with start_dose/abort_dose/get_dose
+  Doser.begin();
+  Scale.attachDosingController(&Doser);
+
+  // Waveform capture around impacts and spikes
+  Scale.attachCaptureEngine(&Capture);
+
+  // IIR low-pass ahead of the averages; passes readings through until set_biquad loads it
+  Scale.attachBiquad(&Biquad);
+
+  // Mains hum aliases into the band at 80 SPS; retuned by setSampleRate() and set_mains_filter.
+  // The notches need channel 1 at an even rate, so they are left off when channel 2 is interleaved.
+  Scale.attachNotch(&Notch);
+#if CHANNEL2_REFERENCE == CHANNEL2_NONE
+  err = Scale.setMainsRejection(MAINS_FREQUENCY);
+  if (err)
+  {
+    Server.sendScaleError(SERVER_ID, err);
+  }
+#endif
+
+#if CHANNEL2_REFERENCE == CHANNEL2_VIBRATION
+  // Subtract frame vibration measured on channel 2, read between channel 1 conversions
+  Canceller.setFreezeThreshold(CANCELLER_FREEZE);
+  Scale.attachCanceller(&Canceller);
+  Scale.beginInterleave(REFERENCE_INTERVAL);
+#elif CHANNEL2_REFERENCE == CHANNEL2_EXCITATION
+  // Normalise channel 1 to the excitation measured on channel 2. The nominal reference is kept in
+  // EEPROM by eeprom_task; on the first start (erased EEPROM reads -1) it is taken from the first sample.
+  EEPROM.get(NOMINAL_LOCATION, storedNominal);
+  Excitation.setNominal(storedNominal);
+  Scale.attachExcitationCompensator(&Excitation);
+  Scale.beginInterleave(REFERENCE_INTERVAL);
+#endif
+
+#if TEMPERATURE_INTERVAL > 0
+  // Zero and span drift with temperature, learned from empty-platform tares ("empty": true) and
+  // calibrations at different temperatures, or loaded with set_temperature_compensation
+  Temperature.setRecalibrationThreshold(RECAL_THRESHOLD);
+  Scale.attachTemperatureCompensator(&Temperature);
+  Scale.beginTemperatureSampling(TEMPERATURE_INTERVAL);
+#endif
+
+#if CREEP_COMPENSATION
+  Creep.setModel(CREEP_COEFFICIENT, CREEP_TIME_CONSTANT);
+  Creep.setThreshold(CREEP_THRESHOLD);
+  Scale.attachCreepCompensator(&Creep);
+#endif
+
+#if INTEGRITY_BUDGET > 0
+  // A brown-out resets the NAU7802 to its defaults without the host noticing. Compare its registers
+  // with the configuration between conversions and write it back, reported as an error once.
+  Scale.beginIntegrityCheck(INTEGRITY_BUDGET);
+#endif
+
+  // Calibration changes are written by eeprom_task instead of inside the rpc methods
+  Scale.deferEEPROM = true;
+
+  Server.addMethod("get_task_stats", get_task_stats);
+
+  // Tasks are added in priority order; ties go to the earlier task
+  Scheduler.addTask(&acquire_task_id, "acquire", acquire_task, NULL, ACQUIRE_PERIOD, ACQUIRE_BUDGET);
+  Scheduler.addTask(&filter_task_id, "filter", filter_task, NULL, FILTER_PERIOD, FILTER_BUDGET);
+  Scheduler.addTask(&tx_task_id, "tx", tx_task, NULL, TX_PERIOD, TX_BUDGET);
+  Scheduler.addTask(&rpc_task_id, "rpc", rpc_task, NULL, RPC_PERIOD, RPC_BUDGET);
+  Scheduler.addTask(&eeprom_task_id, "eeprom", eeprom_task, NULL, EEPROM_PERIOD, EEPROM_BUDGET);
 }
 // MAIN LOOP (CALLED INDEFINITELY)
 void loop()
 {
-
-  StaticJsonDocument<128> request;
-
-  if (Serial.available())
-  {
-    String request_line = Serial.readStringUntil('\n');
-    DeserializationError err = deserializeJson(request, request_line);
-    if (err)
-    {
-      jsonrpc_parse_error(err);
-      // flush any remaining input
-//      while (Serial.available())
-//        Serial.read();
-      return;
-    }
-    //flush any remaining input
-//    while (Serial.available())
-//      Serial.read();
-    // Parse the request
-    const char *method = request["method"] | "?";
-    JsonVariant params = request["params"];
-    unsigned long  id = request["id"] | 0uL;
-
-    if ((strcmp(method, "?") != 0) && (id > 0))
-    {
-      dispatch(id, method, params);
-    }
-    else
-    {
-      jsonrpc_invalid_request();
-    }
-  }
-  else if (sample_mode == CONTINUOUS)
-  {
-    stream_sensors();
-  }
+  Scheduler.run();
 }
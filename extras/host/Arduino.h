@@ -0,0 +1,79 @@
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+/* Minimal Arduino core for building the library on a Linux host.
+  Time is virtual: micros() returns whatever the tool last set with hostSetMicros(), and delay()
+  advances it, so runs are deterministic and blocking waits finish immediately. The clock and the
+  pin levels are kept per thread.*/
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+class __FlashStringHelper;
+#define F(string_literal) (reinterpret_cast<const __FlashStringHelper *>(string_literal))
+#define PROGMEM
+//Flash is ordinary memory here. With these defined ArduinoJson accepts the F() strings.
+#define pgm_read_byte(address)  (*(const uint8_t *)(address))
+#define pgm_read_word(address)  (*(const uint16_t *)(address))
+#define pgm_read_dword(address) (*(const uint32_t *)(address))
+#define pgm_read_float(address) (*(const float *)(address))
+#define pgm_read_ptr(address)   (*(void *const *)(address))
+
+#define PI 3.1415926535897932384626433832795
+
+#define HIGH 0x1
+#define LOW  0x0
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+
+template <class T> T min(T a, T b) {return (a < b) ? a : b;}
+template <class T> T max(T a, T b) {return (a > b) ? a : b;}
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+#define noInterrupts()
+#define interrupts()
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+
+//Host control of the virtual clock and pins
+void hostSetMicros(uint32_t us);
+void hostSetPin(uint8_t pin, uint8_t value);
+
+class Print
+{
+  public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t value) = 0;
+    virtual size_t write(const uint8_t *buffer, size_t size)
+    {
+      size_t n = 0;
+      while (size--)
+        n += write(*buffer++);
+      return n;
+    }
+    virtual int availableForWrite() {return 0;}
+    size_t print(const char *s) {return write((const uint8_t *)s, strlen(s));}
+    size_t println() {return write('\n');}
+};
+
+class Stream : public Print
+{
+  public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+};
+#endif //HOST_ARDUINO_H
@@ -0,0 +1,39 @@
+#ifndef HOST_EEPROM_H
+#define HOST_EEPROM_H
+/* EEPROM held in RAM for host builds, erased (0xFF) at start like a new AVR.*/
+#include "Arduino.h"
+
+#define HOST_EEPROM_SIZE 1024
+
+class EEPROMClass
+{
+  public:
+    EEPROMClass() {memset(data, 0xFF, sizeof(data));}
+
+    uint8_t read(int idx) {return data[idx % HOST_EEPROM_SIZE];}
+    void write(int idx, uint8_t value) {data[idx % HOST_EEPROM_SIZE] = value;}
+    void update(int idx, uint8_t value) {write(idx, value);}
+    uint16_t length() {return HOST_EEPROM_SIZE;}
+
+    template <typename T> T &get(int idx, T &t)
+    {
+      uint8_t *ptr = (uint8_t *)&t;
+      for (size_t i = 0; i < sizeof(T); i++)
+        ptr[i] = read(idx + i);
+      return t;
+    }
+
+    template <typename T> const T &put(int idx, const T &t)
+    {
+      const uint8_t *ptr = (const uint8_t *)&t;
+      for (size_t i = 0; i < sizeof(T); i++)
+        update(idx + i, ptr[i]);
+      return t;
+    }
+
+  private:
+    uint8_t data[HOST_EEPROM_SIZE];
+};
+
+extern EEPROMClass EEPROM;
+#endif //HOST_EEPROM_H
@@ -0,0 +1,24 @@
+#ifndef HOST_WIRE_H
+#define HOST_WIRE_H
+/* I2C stub for host builds. No device ever acks, so anything that talks to the NAU7802 returns
+  an I2C error. Host tools feed samples through QwiicScale::processSample() instead.*/
+#include "Arduino.h"
+
+#define BUFFER_LENGTH 32
+
+class TwoWire : public Stream
+{
+  public:
+    void begin() {}
+    void beginTransmission(uint8_t address) {}
+    uint8_t endTransmission(bool sendStop = true) {return 2;}
+    uint8_t requestFrom(uint8_t address, uint8_t quantity, uint8_t sendStop = 1) {return 0;}
+    size_t write(uint8_t value) {return 1;}
+    using Print::write;
+    int available() {return 0;}
+    int read() {return -1;}
+    int peek() {return -1;}
+};
+
+extern TwoWire Wire;
+#endif //HOST_WIRE_H
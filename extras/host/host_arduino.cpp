@@ -0,0 +1,22 @@
+#include "Arduino.h"
+#include "Wire.h"
+#include "EEPROM.h"
+
+TwoWire Wire;
+EEPROMClass EEPROM;
+
+//Per thread, so that tools can replay several traces in parallel
+static thread_local uint32_t hostMicros = 0;
+static thread_local uint8_t hostPins[256];
+
+void hostSetMicros(uint32_t us) {hostMicros = us;}
+void hostSetPin(uint8_t pin, uint8_t value) {hostPins[pin] = value;}
+
+unsigned long micros() {return hostMicros;}
+unsigned long millis() {return hostMicros / 1000;}
+void delay(unsigned long ms) {hostMicros += ms * 1000;}
+void delayMicroseconds(unsigned int us) {hostMicros += us;}
+
+void pinMode(uint8_t pin, uint8_t mode) {}
+void digitalWrite(uint8_t pin, uint8_t value) {hostPins[pin] = value;}
+int digitalRead(uint8_t pin) {return hostPins[pin];}
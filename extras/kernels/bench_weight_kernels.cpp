@@ -0,0 +1,175 @@
+/* Checks every weight kernel this CPU runs against the scalar one and measures their throughput.
+  The results must be bit-identical; any difference is reported and fails the run.
+
+  usage: bench_weight_kernels [samples] [repeats]*/
+
+// Build from the repository root with
+//   g++ -std=gnu++11 -O2 -Iextras/kernels -o bench_weight_kernels
+//       extras/kernels/bench_weight_kernels.cpp extras/kernels/weight_kernels.cpp
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#include "weight_kernels.h"
+
+#define BENCH_ZERO_OFFSET   -81520
+#define BENCH_CAL_FACTOR    -421.7f
+#define BENCH_BLOCK_SIZE    256
+
+typedef std::chrono::steady_clock bench_clock;
+
+struct Buffers
+{
+  std::vector<int32_t> raw;
+  std::vector<float> weight;
+  std::vector<float> packedWeight;
+  std::vector<RawBlockStatistics> blocks;
+};
+
+//Fastest of repeats runs, in samples per microsecond (millions per second)
+template <class F>
+static double measure(size_t samples, int repeats, F run)
+{
+  double best = 0;
+  for (int r = 0; r < repeats; r++)
+  {
+    bench_clock::time_point start = bench_clock::now();
+    run();
+    double us = std::chrono::duration<double, std::micro>(bench_clock::now() - start).count();
+    if ((us > 0) && (samples / us > best))
+      best = samples / us;
+  }
+  return best;
+}
+
+static void run_kernel(const std::vector<uint8_t> &packed, size_t count, size_t offset, bool allowNegative,
+                       Weight_Kernel kernel, Buffers &out)
+{
+  out.raw.assign(count, 0);
+  out.weight.assign(count, 0);
+  out.packedWeight.assign(count, 0);
+  out.blocks.assign(count / BENCH_BLOCK_SIZE + 1, RawBlockStatistics());
+
+  const uint8_t *p = &packed[3 * offset];
+  unpack_int24(p, &out.raw[0], count, kernel);
+  raw_to_weight(&out.raw[0], &out.weight[0], count, BENCH_ZERO_OFFSET, BENCH_CAL_FACTOR, allowNegative, kernel);
+  packed_to_weight(p, &out.packedWeight[0], count, BENCH_ZERO_OFFSET, BENCH_CAL_FACTOR, allowNegative, kernel);
+  out.blocks.resize(raw_block_statistics(&out.raw[0], count, BENCH_BLOCK_SIZE, &out.blocks[0], kernel));
+}
+
+static bool same_blocks(const std::vector<RawBlockStatistics> &a, const std::vector<RawBlockStatistics> &b)
+{
+  if (a.size() != b.size())
+    return false;
+  for (size_t i = 0; i < a.size(); i++)
+    if ((a[i].count != b[i].count) || (a[i].origin != b[i].origin) || (a[i].minimum != b[i].minimum) ||
+        (a[i].maximum != b[i].maximum) || (a[i].sum != b[i].sum) || (a[i].sumSquares != b[i].sumSquares))
+      return false;
+  return true;
+}
+
+//Compare against scalar on awkward lengths and alignments, so every tail path runs
+static bool check(const std::vector<uint8_t> &packed, Weight_Kernel kernel)
+{
+  bool ok = true;
+  const size_t lengths[] = {0, 1, 3, 4, 5, 7, 8, 11, 12, 31, 257, 1000, 4099};
+  for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++)
+    for (size_t offset = 0; offset < 3; offset++)
+      for (int allowNegative = 0; allowNegative < 2; allowNegative++)
+      {
+        Buffers expected, actual;
+        run_kernel(packed, lengths[l], offset, allowNegative, WEIGHT_KERNEL_SCALAR, expected);
+        run_kernel(packed, lengths[l], offset, allowNegative, kernel, actual);
+
+        bool same = (expected.raw == actual.raw) &&
+                    !memcmp(expected.weight.data(), actual.weight.data(), lengths[l] * sizeof(float)) &&
+                    !memcmp(expected.packedWeight.data(), actual.packedWeight.data(), lengths[l] * sizeof(float)) &&
+                    !memcmp(expected.weight.data(), expected.packedWeight.data(), lengths[l] * sizeof(float)) &&
+                    same_blocks(expected.blocks, actual.blocks);
+        if (!same)
+        {
+          fprintf(stderr, "%s differs from scalar: length %zu offset %zu allow_negative %d\n",
+                  weight_kernel_name(kernel), lengths[l], offset, allowNegative);
+          ok = false;
+        }
+      }
+  return ok;
+}
+
+int main(int argc, char **argv)
+{
+  size_t samples = (argc > 1) ? strtoul(argv[1], NULL, 0) : 16000000;
+  int repeats = (argc > 2) ? atoi(argv[2]) : 5;
+  if ((samples < 8192) || (repeats < 1))
+  {
+    fprintf(stderr, "usage: %s [samples >= 8192] [repeats]\n", argv[0]);
+    return 2;
+  }
+
+  //Full-scale random readings, with the extremes included
+  std::vector<uint8_t> packed(3 * samples);
+  srand(1);
+  for (size_t i = 0; i < samples; i++)
+  {
+    int32_t value = (int32_t)(((uint32_t)rand() << 8) ^ (uint32_t)rand()) >> 8;
+    if (i == 1)
+      value = -(1 << 23);
+    if (i == 2)
+      value = (1 << 23) - 1;
+    packed[3 * i] = value;
+    packed[3 * i + 1] = value >> 8;
+    packed[3 * i + 2] = value >> 16;
+  }
+
+  std::vector<int32_t> raw(samples);
+  std::vector<float> weight(samples);
+  std::vector<RawBlockStatistics> blocks(samples / BENCH_BLOCK_SIZE + 1);
+
+  printf("%zu samples, best of %d, Msamples/s (speedup over scalar)\n", samples, repeats);
+  printf("%-8s %18s %18s %18s %18s\n", "kernel", "unpack", "raw_to_weight", "packed_to_weight", "block_stats");
+
+  bool ok = true;
+  double scalar[4] = {0, 0, 0, 0};
+  const Weight_Kernel kernels[] = {WEIGHT_KERNEL_SCALAR, WEIGHT_KERNEL_SSE2, WEIGHT_KERNEL_AVX2};
+  for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++)
+  {
+    Weight_Kernel kernel = kernels[k];
+    if (!weight_kernel_supported(kernel))
+    {
+      printf("%-8s not supported\n", weight_kernel_name(kernel));
+      continue;
+    }
+    if ((kernel != WEIGHT_KERNEL_SCALAR) && !check(packed, kernel))
+      ok = false;
+
+    double rate[4];
+    rate[0] = measure(samples, repeats, [&]() {unpack_int24(&packed[0], &raw[0], samples, kernel);});
+    rate[1] = measure(samples, repeats, [&]() {
+      raw_to_weight(&raw[0], &weight[0], samples, BENCH_ZERO_OFFSET, BENCH_CAL_FACTOR, true, kernel);
+    });
+    rate[2] = measure(samples, repeats, [&]() {
+      packed_to_weight(&packed[0], &weight[0], samples, BENCH_ZERO_OFFSET, BENCH_CAL_FACTOR, true, kernel);
+    });
+    rate[3] = measure(samples, repeats, [&]() {
+      raw_block_statistics(&raw[0], samples, BENCH_BLOCK_SIZE, &blocks[0], kernel);
+    });
+
+    printf("%-8s", weight_kernel_name(kernel));
+    for (int i = 0; i < 4; i++)
+    {
+      if (kernel == WEIGHT_KERNEL_SCALAR)
+        scalar[i] = rate[i];
+      printf(" %10.1f (%4.1fx)", rate[i], scalar[i] ? rate[i] / scalar[i] : 0);
+    }
+    printf("\n");
+  }
+
+  WeightBlockStatistics first;
+  block_to_weight(blocks[0], BENCH_ZERO_OFFSET, BENCH_CAL_FACTOR, &first);
+  printf("first block: mean %.6g min %.6g max %.6g sd %.6g\n", first.mean, first.minimum, first.maximum,
+         first.stdDev);
+
+  printf("%s\n", ok ? "all kernels match scalar" : "MISMATCH");
+  return ok ? 0 : 1;
+}
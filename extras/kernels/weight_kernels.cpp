@@ -0,0 +1,406 @@
+#include <math.h>
+#include "weight_kernels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define WEIGHT_KERNELS_X86
+#include <immintrin.h>
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+//Scalar kernels, also used for the tails of the SIMD ones
+
+static inline int32_t unpack_one(const uint8_t *p)
+{
+  uint32_t value = (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16);
+  return (int32_t)(value << 8) >> 8;
+}
+
+static inline float weight_one(int32_t reading, int32_t zeroOffset, float calibrationFactor, bool allowNegative)
+{
+  if (!allowNegative && (reading < zeroOffset))
+    reading = zeroOffset;
+  return (reading - zeroOffset) / calibrationFactor;
+}
+
+static void unpack_scalar(const uint8_t *packed, int32_t *raw, size_t count)
+{
+  for (size_t i = 0; i < count; i++)
+    raw[i] = unpack_one(packed + 3 * i);
+}
+
+static void to_weight_scalar(const int32_t *raw, float *weight, size_t count, int32_t zeroOffset,
+                             float calibrationFactor, bool allowNegative)
+{
+  for (size_t i = 0; i < count; i++)
+    weight[i] = weight_one(raw[i], zeroOffset, calibrationFactor, allowNegative);
+}
+
+static void packed_to_weight_scalar(const uint8_t *packed, float *weight, size_t count, int32_t zeroOffset,
+                                    float calibrationFactor, bool allowNegative)
+{
+  for (size_t i = 0; i < count; i++)
+    weight[i] = weight_one(unpack_one(packed + 3 * i), zeroOffset, calibrationFactor, allowNegative);
+}
+
+//Adds readings to a block whose origin is already set
+static void block_scalar(const int32_t *raw, size_t count, RawBlockStatistics *block)
+{
+  for (size_t i = 0; i < count; i++)
+  {
+    int64_t x = raw[i] - block->origin;
+    block->sum += x;
+    block->sumSquares += (uint64_t)(x * x);
+    if (raw[i] < block->minimum)
+      block->minimum = raw[i];
+    if (raw[i] > block->maximum)
+      block->maximum = raw[i];
+  }
+}
+
+#ifdef WEIGHT_KERNELS_X86
+
+//SSE2 has no byte shuffle, so the four 24-bit samples in 12 bytes are lined up with byte shifts:
+//the dwords at byte offsets 0, 3, 6 and 9 hold one sample each in their low 3 bytes.
+TARGET_SSE2 static inline __m128i unpack4_sse2(const uint8_t *p)
+{
+  __m128i v = _mm_loadu_si128((const __m128i *)p);
+  __m128i ab = _mm_unpacklo_epi32(v, _mm_srli_si128(v, 3));
+  __m128i cd = _mm_unpacklo_epi32(_mm_srli_si128(v, 6), _mm_srli_si128(v, 9));
+  return _mm_srai_epi32(_mm_slli_epi32(_mm_unpacklo_epi64(ab, cd), 8), 8);
+}
+
+//max(a, b) for signed 32-bit lanes, which SSE2 lacks
+TARGET_SSE2 static inline __m128i max_epi32_sse2(__m128i a, __m128i b)
+{
+  __m128i greater = _mm_cmpgt_epi32(a, b);
+  return _mm_or_si128(_mm_and_si128(greater, a), _mm_andnot_si128(greater, b));
+}
+
+TARGET_SSE2 static inline __m128i min_epi32_sse2(__m128i a, __m128i b)
+{
+  __m128i greater = _mm_cmpgt_epi32(a, b);
+  return _mm_or_si128(_mm_and_si128(greater, b), _mm_andnot_si128(greater, a));
+}
+
+TARGET_SSE2 static inline __m128 weight4_sse2(__m128i reading, __m128i zero, __m128 factor, bool allowNegative)
+{
+  if (!allowNegative)
+    reading = max_epi32_sse2(reading, zero);
+  return _mm_div_ps(_mm_cvtepi32_ps(_mm_sub_epi32(reading, zero)), factor);
+}
+
+TARGET_SSE2 static void unpack_sse2(const uint8_t *packed, int32_t *raw, size_t count)
+{
+  size_t i = 0;
+  //16 byte loads; the last 4 bytes belong to the next samples, so stop while they still exist
+  for (; i + 6 <= count; i += 4)
+    _mm_storeu_si128((__m128i *)(raw + i), unpack4_sse2(packed + 3 * i));
+  unpack_scalar(packed + 3 * i, raw + i, count - i);
+}
+
+TARGET_SSE2 static void to_weight_sse2(const int32_t *raw, float *weight, size_t count, int32_t zeroOffset,
+                                       float calibrationFactor, bool allowNegative)
+{
+  __m128i zero = _mm_set1_epi32(zeroOffset);
+  __m128 factor = _mm_set1_ps(calibrationFactor);
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4)
+  {
+    __m128i reading = _mm_loadu_si128((const __m128i *)(raw + i));
+    _mm_storeu_ps(weight + i, weight4_sse2(reading, zero, factor, allowNegative));
+  }
+  to_weight_scalar(raw + i, weight + i, count - i, zeroOffset, calibrationFactor, allowNegative);
+}
+
+TARGET_SSE2 static void packed_to_weight_sse2(const uint8_t *packed, float *weight, size_t count,
+                                              int32_t zeroOffset, float calibrationFactor, bool allowNegative)
+{
+  __m128i zero = _mm_set1_epi32(zeroOffset);
+  __m128 factor = _mm_set1_ps(calibrationFactor);
+  size_t i = 0;
+  for (; i + 6 <= count; i += 4)
+    _mm_storeu_ps(weight + i, weight4_sse2(unpack4_sse2(packed + 3 * i), zero, factor, allowNegative));
+  packed_to_weight_scalar(packed + 3 * i, weight + i, count - i, zeroOffset, calibrationFactor, allowNegative);
+}
+
+TARGET_SSE2 static void block_sse2(const int32_t *raw, size_t count, RawBlockStatistics *block)
+{
+  __m128i origin = _mm_set1_epi32(block->origin);
+  __m128i minimum = _mm_set1_epi32(block->minimum);
+  __m128i maximum = _mm_set1_epi32(block->maximum);
+  __m128i sum = _mm_setzero_si128();
+  __m128i squares = _mm_setzero_si128();
+  size_t i = 0;
+
+  for (; i + 4 <= count; i += 4)
+  {
+    __m128i reading = _mm_loadu_si128((const __m128i *)(raw + i));
+    minimum = min_epi32_sse2(minimum, reading);
+    maximum = max_epi32_sse2(maximum, reading);
+
+    //Sign-extend to 64 bits for the sum; square the magnitude with the unsigned multiply
+    __m128i x = _mm_sub_epi32(reading, origin);
+    __m128i sign = _mm_srai_epi32(x, 31);
+    sum = _mm_add_epi64(sum, _mm_unpacklo_epi32(x, sign));
+    sum = _mm_add_epi64(sum, _mm_unpackhi_epi32(x, sign));
+    __m128i magnitude = _mm_sub_epi32(_mm_xor_si128(x, sign), sign);
+    squares = _mm_add_epi64(squares, _mm_mul_epu32(magnitude, magnitude));
+    __m128i odd = _mm_srli_epi64(magnitude, 32);
+    squares = _mm_add_epi64(squares, _mm_mul_epu32(odd, odd));
+  }
+
+  int32_t lanes[4];
+  int64_t wide[2];
+  _mm_storeu_si128((__m128i *)lanes, minimum);
+  for (int l = 0; l < 4; l++)
+    block->minimum = (lanes[l] < block->minimum) ? lanes[l] : block->minimum;
+  _mm_storeu_si128((__m128i *)lanes, maximum);
+  for (int l = 0; l < 4; l++)
+    block->maximum = (lanes[l] > block->maximum) ? lanes[l] : block->maximum;
+  _mm_storeu_si128((__m128i *)wide, sum);
+  block->sum += wide[0] + wide[1];
+  _mm_storeu_si128((__m128i *)wide, squares);
+  block->sumSquares += (uint64_t)wide[0] + (uint64_t)wide[1];
+
+  block_scalar(raw + i, count - i, block);
+}
+
+//Eight samples from 24 bytes: move each half into its own 128-bit lane (bytes 0-15 and 12-27),
+//then shuffle each sample into the top 3 bytes of its dword and shift it back down with sign.
+TARGET_AVX2 static inline __m256i unpack8_avx2(const uint8_t *p)
+{
+  const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 3, 4, 5, 6);
+  const __m256i bytes = _mm256_setr_epi8(-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11,
+                                         -1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+  __m256i v = _mm256_loadu_si256((const __m256i *)p);
+  v = _mm256_shuffle_epi8(_mm256_permutevar8x32_epi32(v, lanes), bytes);
+  return _mm256_srai_epi32(v, 8);
+}
+
+TARGET_AVX2 static inline __m256 weight8_avx2(__m256i reading, __m256i zero, __m256 factor, bool allowNegative)
+{
+  if (!allowNegative)
+    reading = _mm256_max_epi32(reading, zero);
+  return _mm256_div_ps(_mm256_cvtepi32_ps(_mm256_sub_epi32(reading, zero)), factor);
+}
+
+TARGET_AVX2 static void unpack_avx2(const uint8_t *packed, int32_t *raw, size_t count)
+{
+  size_t i = 0;
+  //32 byte loads for 24 bytes of samples
+  for (; i + 11 <= count; i += 8)
+    _mm256_storeu_si256((__m256i *)(raw + i), unpack8_avx2(packed + 3 * i));
+  unpack_scalar(packed + 3 * i, raw + i, count - i);
+}
+
+TARGET_AVX2 static void to_weight_avx2(const int32_t *raw, float *weight, size_t count, int32_t zeroOffset,
+                                       float calibrationFactor, bool allowNegative)
+{
+  __m256i zero = _mm256_set1_epi32(zeroOffset);
+  __m256 factor = _mm256_set1_ps(calibrationFactor);
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8)
+  {
+    __m256i reading = _mm256_loadu_si256((const __m256i *)(raw + i));
+    _mm256_storeu_ps(weight + i, weight8_avx2(reading, zero, factor, allowNegative));
+  }
+  to_weight_scalar(raw + i, weight + i, count - i, zeroOffset, calibrationFactor, allowNegative);
+}
+
+TARGET_AVX2 static void packed_to_weight_avx2(const uint8_t *packed, float *weight, size_t count,
+                                              int32_t zeroOffset, float calibrationFactor, bool allowNegative)
+{
+  __m256i zero = _mm256_set1_epi32(zeroOffset);
+  __m256 factor = _mm256_set1_ps(calibrationFactor);
+  size_t i = 0;
+  for (; i + 11 <= count; i += 8)
+    _mm256_storeu_ps(weight + i, weight8_avx2(unpack8_avx2(packed + 3 * i), zero, factor, allowNegative));
+  packed_to_weight_scalar(packed + 3 * i, weight + i, count - i, zeroOffset, calibrationFactor, allowNegative);
+}
+
+TARGET_AVX2 static void block_avx2(const int32_t *raw, size_t count, RawBlockStatistics *block)
+{
+  __m256i origin = _mm256_set1_epi32(block->origin);
+  __m256i minimum = _mm256_set1_epi32(block->minimum);
+  __m256i maximum = _mm256_set1_epi32(block->maximum);
+  __m256i sum = _mm256_setzero_si256();
+  __m256i squares = _mm256_setzero_si256();
+  size_t i = 0;
+
+  for (; i + 8 <= count; i += 8)
+  {
+    __m256i reading = _mm256_loadu_si256((const __m256i *)(raw + i));
+    minimum = _mm256_min_epi32(minimum, reading);
+    maximum = _mm256_max_epi32(maximum, reading);
+
+    __m256i x = _mm256_sub_epi32(reading, origin);
+    sum = _mm256_add_epi64(sum, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(x)));
+    sum = _mm256_add_epi64(sum, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(x, 1)));
+    squares = _mm256_add_epi64(squares, _mm256_mul_epi32(x, x));
+    __m256i odd = _mm256_srli_epi64(x, 32);
+    squares = _mm256_add_epi64(squares, _mm256_mul_epi32(odd, odd));
+  }
+
+  int32_t lanes[8];
+  int64_t wide[4];
+  _mm256_storeu_si256((__m256i *)lanes, minimum);
+  for (int l = 0; l < 8; l++)
+    block->minimum = (lanes[l] < block->minimum) ? lanes[l] : block->minimum;
+  _mm256_storeu_si256((__m256i *)lanes, maximum);
+  for (int l = 0; l < 8; l++)
+    block->maximum = (lanes[l] > block->maximum) ? lanes[l] : block->maximum;
+  _mm256_storeu_si256((__m256i *)wide, sum);
+  block->sum += wide[0] + wide[1] + wide[2] + wide[3];
+  _mm256_storeu_si256((__m256i *)wide, squares);
+  block->sumSquares += (uint64_t)wide[0] + (uint64_t)wide[1] + (uint64_t)wide[2] + (uint64_t)wide[3];
+
+  block_scalar(raw + i, count - i, block);
+}
+#endif //WEIGHT_KERNELS_X86
+
+bool weight_kernel_supported(Weight_Kernel kernel)
+{
+  switch (kernel)
+  {
+    case WEIGHT_KERNEL_SCALAR:
+      return true;
+#ifdef WEIGHT_KERNELS_X86
+    case WEIGHT_KERNEL_SSE2:
+      return __builtin_cpu_supports("sse2");
+    case WEIGHT_KERNEL_AVX2:
+      return __builtin_cpu_supports("avx2");
+#endif
+    default:
+      return false;
+  }
+}
+
+Weight_Kernel best_weight_kernel()
+{
+  if (weight_kernel_supported(WEIGHT_KERNEL_AVX2))
+    return WEIGHT_KERNEL_AVX2;
+  if (weight_kernel_supported(WEIGHT_KERNEL_SSE2))
+    return WEIGHT_KERNEL_SSE2;
+  return WEIGHT_KERNEL_SCALAR;
+}
+
+const char *weight_kernel_name(Weight_Kernel kernel)
+{
+  switch (kernel)
+  {
+    case WEIGHT_KERNEL_SCALAR: return "scalar";
+    case WEIGHT_KERNEL_SSE2: return "sse2";
+    case WEIGHT_KERNEL_AVX2: return "avx2";
+    default: return "unknown";
+  }
+}
+
+//An unsupported kernel falls back to the best one available
+static Weight_Kernel resolve(Weight_Kernel kernel)
+{
+  return weight_kernel_supported(kernel) ? kernel : best_weight_kernel();
+}
+
+void unpack_int24(const uint8_t *packed, int32_t *raw, size_t count, Weight_Kernel kernel)
+{
+  switch (resolve(kernel))
+  {
+#ifdef WEIGHT_KERNELS_X86
+    case WEIGHT_KERNEL_AVX2: unpack_avx2(packed, raw, count); break;
+    case WEIGHT_KERNEL_SSE2: unpack_sse2(packed, raw, count); break;
+#endif
+    default: unpack_scalar(packed, raw, count); break;
+  }
+}
+
+void raw_to_weight(const int32_t *raw, float *weight, size_t count, int32_t zeroOffset,
+                   float calibrationFactor, bool allowNegative, Weight_Kernel kernel)
+{
+  switch (resolve(kernel))
+  {
+#ifdef WEIGHT_KERNELS_X86
+    case WEIGHT_KERNEL_AVX2: to_weight_avx2(raw, weight, count, zeroOffset, calibrationFactor, allowNegative); break;
+    case WEIGHT_KERNEL_SSE2: to_weight_sse2(raw, weight, count, zeroOffset, calibrationFactor, allowNegative); break;
+#endif
+    default: to_weight_scalar(raw, weight, count, zeroOffset, calibrationFactor, allowNegative); break;
+  }
+}
+
+void packed_to_weight(const uint8_t *packed, float *weight, size_t count, int32_t zeroOffset,
+                      float calibrationFactor, bool allowNegative, Weight_Kernel kernel)
+{
+  switch (resolve(kernel))
+  {
+#ifdef WEIGHT_KERNELS_X86
+    case WEIGHT_KERNEL_AVX2:
+      packed_to_weight_avx2(packed, weight, count, zeroOffset, calibrationFactor, allowNegative);
+      break;
+    case WEIGHT_KERNEL_SSE2:
+      packed_to_weight_sse2(packed, weight, count, zeroOffset, calibrationFactor, allowNegative);
+      break;
+#endif
+    default:
+      packed_to_weight_scalar(packed, weight, count, zeroOffset, calibrationFactor, allowNegative);
+      break;
+  }
+}
+
+size_t raw_block_statistics(const int32_t *raw, size_t count, size_t blockSize, RawBlockStatistics *blocks,
+                            Weight_Kernel kernel)
+{
+  if (blockSize == 0)
+    blockSize = 1;
+  if (blockSize > WEIGHT_KERNEL_MAX_BLOCK)
+    blockSize = WEIGHT_KERNEL_MAX_BLOCK;
+  kernel = resolve(kernel);
+
+  size_t written = 0;
+  for (size_t start = 0; start < count; start += blockSize)
+  {
+    size_t length = (count - start < blockSize) ? count - start : blockSize;
+    RawBlockStatistics *block = &blocks[written++];
+    block->count = length;
+    block->origin = raw[start];
+    block->minimum = raw[start];
+    block->maximum = raw[start];
+    block->sum = 0;
+    block->sumSquares = 0;
+
+    switch (kernel)
+    {
+#ifdef WEIGHT_KERNELS_X86
+      case WEIGHT_KERNEL_AVX2: block_avx2(raw + start, length, block); break;
+      case WEIGHT_KERNEL_SSE2: block_sse2(raw + start, length, block); break;
+#endif
+      default: block_scalar(raw + start, length, block); break;
+    }
+  }
+  return written;
+}
+
+void block_to_weight(const RawBlockStatistics &block, int32_t zeroOffset, float calibrationFactor,
+                     WeightBlockStatistics *weight)
+{
+  weight->count = block.count;
+  if (block.count == 0)
+  {
+    weight->mean = weight->minimum = weight->maximum = weight->stdDev = 0;
+    return;
+  }
+
+  //The sums are exact, so the only rounding is here and it is the same for every kernel
+  double mean = (double)block.sum / block.count;
+  double variance = 0;
+  if (block.count > 1)
+    variance = ((double)block.sumSquares - mean * (double)block.sum) / (block.count - 1);
+  if (variance < 0)
+    variance = 0;
+
+  weight->mean = (float)((block.origin - zeroOffset + mean) / calibrationFactor);
+  float low = weight_one(block.minimum, zeroOffset, calibrationFactor, true);
+  float high = weight_one(block.maximum, zeroOffset, calibrationFactor, true);
+  weight->minimum = (low < high) ? low : high;
+  weight->maximum = (low < high) ? high : low;
+  weight->stdDev = (float)(sqrt(variance) / fabs(calibrationFactor));
+}
@@ -0,0 +1,71 @@
+#ifndef WEIGHT_KERNELS_H
+#define WEIGHT_KERNELS_H
+#include <stddef.h>
+#include <stdint.h>
+
+/* Batch conversion of recorded raw conversions to weight on a host, for traces of tens of millions
+  of samples. Weights use the same (reading - zeroOffset) / calibrationFactor as
+  QwiicScale::getWeight(), including the int32 subtraction and float division, so every kernel
+  gives bit-identical results to the library and to each other.
+
+  Packed input is the NAU7802's own format: 3 bytes per sample, little-endian 24-bit two's
+  complement. Kernels are selected at run time: AVX2 or SSE2 on x86 when the CPU has them, portable
+  scalar code otherwise. The SIMD kernels are compiled with per-function target attributes, so the
+  file builds without -mavx2 and runs on any x86-64.*/
+
+typedef enum
+{
+  WEIGHT_KERNEL_SCALAR = 0,
+  WEIGHT_KERNEL_SSE2,
+  WEIGHT_KERNEL_AVX2,
+} Weight_Kernel;
+
+//Exact integer statistics of one block of readings. Squares are taken relative to the first
+//reading of the block, so they fit 64 bits for 24-bit readings and blocks of up to 8192 samples.
+struct RawBlockStatistics
+{
+  uint32_t count;
+  int32_t origin;          //First reading of the block
+  int32_t minimum;
+  int32_t maximum;
+  int64_t sum;             //Sum of (reading - origin)
+  uint64_t sumSquares;     //Sum of (reading - origin)^2
+};
+
+//The same block in weight units, statistics as in SampleStatistics
+struct WeightBlockStatistics
+{
+  uint32_t count;
+  float mean;
+  float minimum;
+  float maximum;
+  float stdDev;            //Sample standard deviation
+};
+
+#define WEIGHT_KERNEL_MAX_BLOCK 8192
+
+//Fastest kernel this CPU runs
+Weight_Kernel best_weight_kernel();
+//False if the kernel was not compiled in or the CPU lacks the instructions
+bool weight_kernel_supported(Weight_Kernel kernel);
+const char *weight_kernel_name(Weight_Kernel kernel);
+
+//Sign-extend count packed samples to int32
+void unpack_int24(const uint8_t *packed, int32_t *raw, size_t count, Weight_Kernel kernel);
+
+//Readings to weights. Without allowNegative readings below zeroOffset give 0, as in getWeight().
+void raw_to_weight(const int32_t *raw, float *weight, size_t count, int32_t zeroOffset,
+                   float calibrationFactor, bool allowNegative, Weight_Kernel kernel);
+
+//Unpack and convert in one pass, without the intermediate readings
+void packed_to_weight(const uint8_t *packed, float *weight, size_t count, int32_t zeroOffset,
+                      float calibrationFactor, bool allowNegative, Weight_Kernel kernel);
+
+//Statistics of consecutive blocks of blockSize readings (1 to WEIGHT_KERNEL_MAX_BLOCK); the last
+//block holds the remainder. Returns the number of blocks written, count / blockSize rounded up.
+size_t raw_block_statistics(const int32_t *raw, size_t count, size_t blockSize, RawBlockStatistics *blocks,
+                            Weight_Kernel kernel);
+
+void block_to_weight(const RawBlockStatistics &block, int32_t zeroOffset, float calibrationFactor,
+                     WeightBlockStatistics *weight);
+#endif //WEIGHT_KERNELS_H
@@ -0,0 +1,217 @@
+/* Replays recorded raw conversions through the QwiicScale sample pipeline on a Linux host and
+  writes the per-sample outputs as CSV, followed by settle time and noise figures on stderr.
+  Runs are deterministic, so the same trace and options always give the same output and filter
+  changes can be compared on production traces.
+
+  Record a trace with {"id":1,"method":"change_mode","params":{"mode":"raw"}} and save the serial
+  output, or convert it to the compact binary format with --write-binary.
+
+  --fit-creep fits the CreepCompensator model to a trace of long static loads, prints the
+  coefficient and time constant for set_creep, and replays the trace with them.
+
+  --notch and --biquad put the mains notches and the biquad cascade in the pipeline as
+  set_mains_filter and set_biquad would on the device. The notches are tuned for the NAU7802 rate
+  nearest to the trace's median sample interval unless --sps gives one.*/
+
+// Build from the repository root with
+//   g++ -std=gnu++11 -O2 -Iextras/host -Isrc -Iextras/replay -o qwiic_replay
+//       extras/replay/qwiic_replay.cpp extras/replay/trace.cpp extras/replay/replay_pipeline.cpp
+//       extras/host/host_arduino.cpp src/*.cpp
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "replay_pipeline.h"
+
+static void usage(const char *name)
+{
+  fprintf(stderr,
+          "usage: %s [options] trace\n"
+          "  --cal F            calibration factor, counts per unit (default 1)\n"
+          "  --zero N           zero offset, counts (default 0)\n"
+          "  --average N        sliding average length (default 1)\n"
+          "  --flow N           flow rate window in samples (default off)\n"
+          "  --deadband W       display deadband (default off)\n"
+          "  --stable N         stability window in samples (default off)\n"
+          "  --stable-band W    largest spread that counts as stable (default band)\n"
+          "  --creep C          creep coefficient, fraction of the load (default off)\n"
+          "  --creep-time S     creep time constant, seconds (default 1800)\n"
+          "  --creep-threshold N  load change in counts that is a creep event (default 0)\n"
+          "  --notch HZ         mains frequency to notch out (default off)\n"
+          "  --notch-width HZ   notch -3dB width (default 2)\n"
+          "  --notch-sections N harmonics notched (default 2)\n"
+          "  --sps N            rate the notches are tuned for (default from the trace)\n"
+          "  --biquad b0,b1,b2,a1,a2  one Q2.30 biquad section, repeat for a cascade\n"
+          "  --biquad-file F    biquad sections, one b0,b1,b2,a1,a2 per line\n"
+          "  --fit-creep        fit --creep and --creep-time to the trace, needs --creep-threshold\n"
+          "  --fit-skip S       seconds after each load change left out of the fit (default 10)\n"
+          "  --step W           weight jump that starts a new segment (default off)\n"
+          "  --band W           settle band around the final value (default step / 100)\n"
+          "  --out FILE         write the CSV here instead of stdout\n"
+          "  --write-binary F   also save the trace in the binary format\n"
+          "  --quiet            no CSV, metrics only\n",
+          name);
+}
+
+int main(int argc, char **argv)
+{
+  PipelineConfig config;
+  float step = 0;
+  float band = -1;
+  float stableBand = -1;
+  const char *tracePath = NULL;
+  const char *outPath = NULL;
+  const char *binaryPath = NULL;
+  bool quiet = false;
+  bool fitCreep = false;
+  float fitSkip = 10;
+  float sampleRate = 0;
+  const char *biquadPath = NULL;
+
+  for (int i = 1; i < argc; i++)
+  {
+    bool hasValue = (i + 1 < argc);
+    if (!strcmp(argv[i], "--cal") && hasValue)
+      config.calibrationFactor = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--zero") && hasValue)
+      config.zeroOffset = atol(argv[++i]);
+    else if (!strcmp(argv[i], "--average") && hasValue)
+      config.average = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--flow") && hasValue)
+      config.flowWindow = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--deadband") && hasValue)
+      config.deadband = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--stable") && hasValue)
+      config.stableCount = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--stable-band") && hasValue)
+      stableBand = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--creep") && hasValue)
+      config.creepCoefficient = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--creep-time") && hasValue)
+      config.creepTime = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--creep-threshold") && hasValue)
+      config.creepThreshold = atol(argv[++i]);
+    else if (!strcmp(argv[i], "--notch") && hasValue)
+      config.mainsHz = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--notch-width") && hasValue)
+      config.notchWidth = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--notch-sections") && hasValue)
+      config.notchSections = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--sps") && hasValue)
+      sampleRate = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--biquad") && hasValue)
+    {
+      biquad_coefficients_t section;
+      if (!parse_biquad_section(argv[++i], section))
+      {
+        fprintf(stderr, "--biquad expects b0,b1,b2,a1,a2\n");
+        return 2;
+      }
+      config.biquad.push_back(section);
+    }
+    else if (!strcmp(argv[i], "--biquad-file") && hasValue)
+      biquadPath = argv[++i];
+    else if (!strcmp(argv[i], "--fit-creep"))
+      fitCreep = true;
+    else if (!strcmp(argv[i], "--fit-skip") && hasValue)
+      fitSkip = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--step") && hasValue)
+      step = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--band") && hasValue)
+      band = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--out") && hasValue)
+      outPath = argv[++i];
+    else if (!strcmp(argv[i], "--write-binary") && hasValue)
+      binaryPath = argv[++i];
+    else if (!strcmp(argv[i], "--quiet"))
+      quiet = true;
+    else if ((argv[i][0] != '-') && (tracePath == NULL))
+      tracePath = argv[i];
+    else
+    {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+
+  if ((tracePath == NULL) || (config.calibrationFactor == 0))
+  {
+    usage(argv[0]);
+    return 2;
+  }
+  if (band < 0)
+    band = step / 100;
+  config.stableBand = (stableBand < 0) ? band : stableBand;
+
+  Trace trace;
+  std::string error;
+  if (!load_trace(tracePath, trace, error))
+  {
+    fprintf(stderr, "%s\n", error.c_str());
+    return 1;
+  }
+
+  if ((binaryPath != NULL) && !write_binary_trace(binaryPath, trace, error))
+  {
+    fprintf(stderr, "%s\n", error.c_str());
+    return 1;
+  }
+
+  if ((biquadPath != NULL) && !load_biquad_file(biquadPath, config.biquad, error))
+  {
+    fprintf(stderr, "%s\n", error.c_str());
+    return 1;
+  }
+  if (config.biquad.size() > 255)
+  {
+    fprintf(stderr, "at most 255 biquad sections\n");
+    return 2;
+  }
+  config.sampleRate = (sampleRate > 0) ? sampleRate : nominal_sample_rate(trace);
+
+  if (fitCreep)
+  {
+    CreepFit fit;
+    if (!fit_creep(trace, config, fitSkip, fit))
+    {
+      fprintf(stderr, "creep fit needs --creep-threshold and load changes followed by static periods\n");
+      return 1;
+    }
+    fprintf(stderr, "creep coefficient %.6g time_constant_s %.1f segments %zu samples %zu rms %.6g "
+            "rms_uncompensated %.6g\n",
+            fit.coefficient, fit.timeConstant, fit.segments, fit.samples, fit.rms, fit.rmsUncompensated);
+    config.creepCoefficient = fit.coefficient;
+    config.creepTime = fit.timeConstant;
+  }
+
+  std::vector<PipelineOutput> output;
+  run_pipeline(trace, config, output);
+
+  if (!quiet)
+  {
+    FILE *out = outPath ? fopen(outPath, "w") : stdout;
+    if (out == NULL)
+    {
+      fprintf(stderr, "cannot create %s\n", outPath);
+      return 1;
+    }
+
+    fprintf(out, "t_us,raw,reading,weight,filtered,displayed,stable,flow_rate,flow_rate_sd\n");
+    for (size_t i = 0; i < output.size(); i++)
+    {
+      const PipelineOutput &o = output[i];
+      fprintf(out, "%u,%d,%d,%.6g,%.6g,%.6g,%d,%.6g,%.6g\n", o.t_us, o.raw, o.reading, o.weight, o.filtered,
+              o.displayed, o.stable, o.flowRate, o.flowRateSd);
+    }
+
+    if (out != stdout)
+      fclose(out);
+  }
+
+  PipelineMetrics metrics;
+  compute_metrics(output, step, band, metrics);
+  fprintf(stderr, "samples %zu steps %zu unsettled %zu settle_mean_ms %.1f settle_max_ms %.1f noise %.6g "
+          "stable %zu false_stable %zu\n",
+          metrics.samples, metrics.steps, metrics.unsettled, metrics.meanSettle_ms, metrics.maxSettle_ms,
+          metrics.noise, metrics.stableSamples, metrics.falseStable);
+  return 0;
+}
@@ -0,0 +1,442 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include "replay_pipeline.h"
+
+//The library sizes its estimators at compile time; this one takes its window at run time.
+//The storage base is listed first so it is constructed before the estimator uses it.
+struct HostFlowStorage
+{
+  std::vector<uint32_t> sampleTimes;
+  std::vector<uint8_t> sampleReadings;
+  HostFlowStorage(uint16_t window) : sampleTimes(window), sampleReadings(window * Int32Storage::BYTES) {}
+};
+
+class HostFlowRateEstimator : private HostFlowStorage, public FlowRateEstimatorBase
+{
+  public:
+    HostFlowRateEstimator(uint16_t window)
+      : HostFlowStorage(window), FlowRateEstimatorBase(&sampleTimes[0], &sampleReadings[0], window, Int32Storage::BYTES) {}
+};
+
+//The same for the biquad stages, sized by the config
+class HostBiquadCascade : private std::vector<biquad_section_t>, public BiquadCascadeBase
+{
+  public:
+    HostBiquadCascade(uint8_t sections)
+      : std::vector<biquad_section_t>(max(sections, (uint8_t)1)), BiquadCascadeBase(data(), sections) {}
+};
+
+float nominal_sample_rate(const Trace &trace)
+{
+  static const float rates[] = {10, 20, 40, 80, 320};
+  if (trace.size() < 2)
+    return 80;
+
+  std::vector<uint32_t> intervals(trace.size() - 1);
+  for (size_t i = 1; i < trace.size(); i++)
+    intervals[i - 1] = trace[i].t_us - trace[i - 1].t_us;
+  std::nth_element(intervals.begin(), intervals.begin() + intervals.size() / 2, intervals.end());
+  uint32_t median = intervals[intervals.size() / 2];
+  if (median == 0)
+    return 80;
+
+  //Nearest on a log scale, the rates being a factor apart
+  float measured = 1e6f / median;
+  float best = rates[0];
+  for (size_t i = 1; i < sizeof(rates) / sizeof(rates[0]); i++)
+    if (fabs(log(rates[i] / measured)) < fabs(log(best / measured)))
+      best = rates[i];
+  return best;
+}
+
+bool parse_biquad_section(const char *text, biquad_coefficients_t &section)
+{
+  long v[5];
+  const char *p = text;
+  for (int i = 0; i < 5; i++)
+  {
+    char *end;
+    v[i] = strtol(p, &end, 10);
+    if (end == p)
+      return false;
+    p = end;
+    while ((*p == ' ') || (*p == '\t'))
+      p++;
+    if ((i < 4) && (*p == ','))
+      p++;
+  }
+  while ((*p == ' ') || (*p == '\t') || (*p == '\r') || (*p == '\n'))
+    p++;
+  if (*p)
+    return false;
+
+  section.b0 = v[0];
+  section.b1 = v[1];
+  section.b2 = v[2];
+  section.a1 = v[3];
+  section.a2 = v[4];
+  return true;
+}
+
+bool load_biquad_file(const char *path, std::vector<biquad_coefficients_t> &sections, std::string &error)
+{
+  FILE *file = fopen(path, "r");
+  if (file == NULL)
+  {
+    error = std::string("cannot open ") + path;
+    return false;
+  }
+
+  sections.clear();
+  char line[256];
+  int number = 0;
+  while (fgets(line, sizeof(line), file))
+  {
+    number++;
+    const char *p = line;
+    while ((*p == ' ') || (*p == '\t'))
+      p++;
+    if ((*p == '#') || (*p == '\r') || (*p == '\n') || (*p == 0))
+      continue;
+
+    biquad_coefficients_t section;
+    if (!parse_biquad_section(p, section))
+    {
+      error = std::string(path) + ":" + std::to_string(number) + ": expected b0,b1,b2,a1,a2";
+      fclose(file);
+      return false;
+    }
+    sections.push_back(section);
+  }
+  fclose(file);
+  if (sections.empty())
+  {
+    error = std::string(path) + ": no sections";
+    return false;
+  }
+  return true;
+}
+
+void run_pipeline(const Trace &trace, const PipelineConfig &config, std::vector<PipelineOutput> &output)
+{
+  QwiicScale scale;
+  scale.useEEPROM = false;
+  scale.setCalibrationFactor(config.calibrationFactor);
+  scale.setZeroOffset(config.zeroOffset);
+  scale.isCalibrated = true;
+
+  CreepCompensator creep;
+  if (config.creepCoefficient != 0)
+  {
+    creep.setModel(config.creepCoefficient, config.creepTime);
+    creep.setThreshold(config.creepThreshold);
+    scale.attachCreepCompensator(&creep);
+  }
+
+  //Attached without setMainsRejection(), which reads the rate from the device
+  HostBiquadCascade notch(config.notchSections);
+  if (config.mainsHz > 0)
+  {
+    biquadMainsNotches(&notch, config.mainsHz, config.sampleRate, config.notchWidth);
+    scale.attachNotch(&notch);
+  }
+
+  HostBiquadCascade biquad(config.biquad.size());
+  if (!config.biquad.empty())
+  {
+    for (size_t i = 0; i < config.biquad.size(); i++)
+      biquad.setSection(i, config.biquad[i]);
+    scale.attachBiquad(&biquad);
+  }
+
+  HostFlowRateEstimator *flow = NULL;
+  if (config.flowWindow > 0)
+  {
+    flow = new HostFlowRateEstimator(config.flowWindow);
+    scale.attachFlowEstimator(flow);
+  }
+
+  uint16_t average = config.average ? config.average : 1;
+  std::vector<float> window(average, 0.0f);
+  double total = 0;
+  size_t filled = 0;
+
+  std::vector<float> recent(config.stableCount ? config.stableCount : 1, 0.0f);
+  float displayed = 0;
+
+  output.resize(trace.size());
+  for (size_t i = 0; i < trace.size(); i++)
+  {
+    PipelineOutput &out = output[i];
+    hostSetMicros(trace[i].t_us);
+    scale.processSample(trace[i].raw, trace[i].t_us);
+
+    out.t_us = trace[i].t_us;
+    out.raw = trace[i].raw;
+    scale.getWeight(&out.rawWeight, out.raw);
+    out.reading = scale.getLastReading();
+    scale.getWeight(&out.weight, out.reading);
+
+    total += out.weight - window[i % average];
+    window[i % average] = out.weight;
+    if (filled < average)
+      filled++;
+    out.filtered = total / filled;
+
+    if ((i == 0) || (fabs(out.filtered - displayed) > config.deadband))
+      displayed = out.filtered;
+    out.displayed = displayed;
+
+    out.stable = false;
+    if (config.stableCount > 0)
+    {
+      recent[i % config.stableCount] = out.filtered;
+      if (i + 1 >= config.stableCount)
+      {
+        float low = recent[0];
+        float high = recent[0];
+        for (uint16_t j = 1; j < config.stableCount; j++)
+        {
+          low = min(low, recent[j]);
+          high = max(high, recent[j]);
+        }
+        out.stable = (high - low <= config.stableBand);
+      }
+    }
+
+    out.flowRate = 0;
+    out.flowRateSd = 0;
+    if (flow != NULL)
+      scale.getFlowRate(&out.flowRate, &out.flowRateSd);
+  }
+
+  delete flow;
+}
+
+void compute_metrics(const std::vector<PipelineOutput> &output, float step, float band, PipelineMetrics &metrics)
+{
+  metrics.samples = output.size();
+  metrics.steps = 0;
+  metrics.unsettled = 0;
+  metrics.meanSettle_ms = 0;
+  metrics.maxSettle_ms = 0;
+  metrics.noise = 0;
+  metrics.noiseSamples = 0;
+  metrics.stableSamples = 0;
+  metrics.falseStable = 0;
+
+  //Segment boundaries: the first sample and every jump larger than step
+  std::vector<size_t> starts(1, 0);
+  for (size_t i = 1; i < output.size(); i++)
+  {
+    float jump = fabs(output[i].rawWeight - output[i - 1].rawWeight);
+    if ((step > 0) && (jump > step) && (i - starts.back() > 1))
+      starts.push_back(i);
+  }
+  starts.push_back(output.size());
+
+  double squares = 0;
+  double settleTotal = 0;
+
+  for (size_t s = 0; s + 1 < starts.size(); s++)
+  {
+    size_t begin = starts[s];
+    size_t end = starts[s + 1];
+    if (end - begin < 8)
+      continue;
+
+    double final = 0;
+    size_t tail = begin + (end - begin) * 3 / 4;
+    for (size_t i = tail; i < end; i++)
+      final += output[i].displayed;
+    final /= (end - tail);
+
+    for (size_t i = begin; i < end; i++)
+    {
+      if (!output[i].stable)
+        continue;
+      metrics.stableSamples++;
+      if (fabs(output[i].displayed - final) > band)
+        metrics.falseStable++;
+    }
+
+    //Noise over the second half, against its own mean
+    size_t half = begin + (end - begin) / 2;
+    double mean = 0;
+    for (size_t i = half; i < end; i++)
+      mean += output[i].displayed;
+    mean /= (end - half);
+    for (size_t i = half; i < end; i++)
+      squares += (output[i].displayed - mean) * (output[i].displayed - mean);
+    metrics.noiseSamples += end - half;
+
+    //The first segment starts with the trace, not with a step
+    if (s == 0)
+      continue;
+
+    metrics.steps++;
+    size_t settled = end;
+    for (size_t i = end; i > begin; i--)
+    {
+      if (fabs(output[i - 1].displayed - final) > band)
+        break;
+      settled = i - 1;
+    }
+
+    if (settled >= tail)
+    {
+      metrics.unsettled++;
+      continue;
+    }
+
+    double settle_ms = (output[settled].t_us - output[begin].t_us) / 1000.0;
+    settleTotal += settle_ms;
+    if (settle_ms > metrics.maxSettle_ms)
+      metrics.maxSettle_ms = settle_ms;
+  }
+
+  if (metrics.steps > metrics.unsettled)
+    metrics.meanSettle_ms = settleTotal / (metrics.steps - metrics.unsettled);
+  if (metrics.noiseSamples > 0)
+    metrics.noise = sqrt(squares / metrics.noiseSamples);
+}
+
+//Time constants searched by fit_creep(), seconds: a log grid, then a golden-section refinement
+//between the neighbours of the best grid point
+#define CREEP_FIT_MIN_S       10.0
+#define CREEP_FIT_MAX_S       100000.0
+#define CREEP_FIT_GRID        96
+#define CREEP_FIT_REFINE      24
+
+//Sums of one segment, relative to its first reading to keep the doubles exact
+struct CreepSegment
+{
+  size_t n;
+  double origin, sb, sr, sbb, sbr, srr;
+};
+
+struct CreepFitSums
+{
+  size_t segments, samples;
+  double sbb, sbr, srr;   //Centred within each segment
+};
+
+static void close_segment(const CreepSegment &seg, CreepFitSums &sums)
+{
+  if (seg.n < 2)
+    return;
+  sums.segments++;
+  sums.samples += seg.n;
+  sums.sbb += seg.sbb - seg.sb * seg.sb / seg.n;
+  sums.sbr += seg.sbr - seg.sb * seg.sr / seg.n;
+  sums.srr += seg.srr - seg.sr * seg.sr / seg.n;
+}
+
+static void creep_sums(const Trace &trace, const PipelineConfig &config, double time_constant, uint32_t skip_us,
+                       CreepFitSums &sums)
+{
+  //Coefficient 0 leaves the readings and so the events alone; the response is the regressor
+  CreepCompensator model;
+  model.setModel(0, time_constant);
+  model.setThreshold(config.creepThreshold);
+
+  memset(&sums, 0, sizeof(sums));
+  CreepSegment seg;
+  memset(&seg, 0, sizeof(seg));
+  uint32_t events = 0;
+
+  for (size_t i = 0; i < trace.size(); i++)
+  {
+    model.compensate(trace[i].raw, config.zeroOffset, trace[i].t_us);
+    if (model.getEventCount() != events)
+    {
+      events = model.getEventCount();
+      close_segment(seg, sums);
+      memset(&seg, 0, sizeof(seg));
+    }
+    if (trace[i].t_us - model.getLastEventTime() < skip_us)
+      continue;
+
+    if (seg.n == 0)
+      seg.origin = trace[i].raw;
+    double b = model.getResponse() - model.getHeldLoad();
+    double r = trace[i].raw - seg.origin;
+    seg.n++;
+    seg.sb += b;
+    seg.sr += r;
+    seg.sbb += b * b;
+    seg.sbr += b * r;
+    seg.srr += r * r;
+  }
+  close_segment(seg, sums);
+}
+
+//Residual sum of squares at the best coefficient for one time constant
+static double creep_residual(const CreepFitSums &sums)
+{
+  if (sums.sbb <= 0)
+    return sums.srr;
+  return sums.srr - sums.sbr * sums.sbr / sums.sbb;
+}
+
+bool fit_creep(const Trace &trace, const PipelineConfig &config, float skip_s, CreepFit &fit)
+{
+  if ((config.creepThreshold <= 0) || (trace.size() < 3))
+    return false;
+
+  uint32_t skip_us = (skip_s > 0) ? (uint32_t)(skip_s * 1e6) : 0;
+  double ratio = log(CREEP_FIT_MAX_S / CREEP_FIT_MIN_S) / CREEP_FIT_GRID;
+  CreepFitSums sums;
+
+  int best = -1;
+  double bestResidual = 0;
+  for (int k = 0; k <= CREEP_FIT_GRID; k++)
+  {
+    creep_sums(trace, config, CREEP_FIT_MIN_S * exp(k * ratio), skip_us, sums);
+    if (sums.sbb <= 0)
+      continue;
+    double residual = creep_residual(sums);
+    if ((best < 0) || (residual < bestResidual))
+    {
+      best = k;
+      bestResidual = residual;
+    }
+  }
+  if (best < 0)
+    return false;
+
+  //Golden-section search on log(time constant) between the grid neighbours
+  const double golden = 0.6180339887;
+  double lo = max(best - 1, 0) * ratio;
+  double hi = min(best + 1, CREEP_FIT_GRID) * ratio;
+  for (int i = 0; i < CREEP_FIT_REFINE; i++)
+  {
+    double a = hi - golden * (hi - lo);
+    double b = lo + golden * (hi - lo);
+    creep_sums(trace, config, CREEP_FIT_MIN_S * exp(a), skip_us, sums);
+    double ra = creep_residual(sums);
+    creep_sums(trace, config, CREEP_FIT_MIN_S * exp(b), skip_us, sums);
+    double rb = creep_residual(sums);
+    if (ra < rb)
+      hi = b;
+    else
+      lo = a;
+  }
+
+  double timeConstant = CREEP_FIT_MIN_S * exp((lo + hi) / 2);
+  creep_sums(trace, config, timeConstant, skip_us, sums);
+  if ((sums.sbb <= 0) || (sums.samples == 0))
+    return false;
+
+  //The regressor is response - held load, which has the same slope as the response
+  fit.coefficient = sums.sbr / sums.sbb;
+  fit.timeConstant = timeConstant;
+  fit.segments = sums.segments;
+  fit.samples = sums.samples;
+  fit.rms = sqrt(max(creep_residual(sums), 0.0) / sums.samples);
+  fit.rmsUncompensated = sqrt(sums.srr / sums.samples);
+  return true;
+}
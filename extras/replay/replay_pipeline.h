@@ -0,0 +1,97 @@
+#ifndef REPLAY_PIPELINE_H
+#define REPLAY_PIPELINE_H
+#include <vector>
+#include "QwiicScale.h"
+#include "trace.h"
+
+/* Runs a trace through a QwiicScale built for the host, one processSample() call per conversion,
+  so the sample pipeline and the conversion to weight are the library's own code, including the
+  mains notches and the biquad cascade when they are configured. The per-sample
+  output is getLastReading() converted with getWeight(), then a sliding average, then an optional
+  display deadband. A sample is flagged stable when the last stableCount averaged weights lie within
+  stableBand of each other.
+
+  Only the stages up to getLastReading() are shared with the device. The ScaleRpcServer stream
+  averages disjoint blocks of conversions instead and sends one weight per block, so it lags a
+  step by up to one block more than the sliding average here. The deadband and the stability flag
+  model a display and have no counterpart in the library.*/
+
+struct PipelineConfig
+{
+  float calibrationFactor;
+  int32_t zeroOffset;
+  uint16_t average;       //Sliding average length, 1 for none
+  uint16_t flowWindow;    //Flow rate window in samples, 0 for none
+  float deadband;         //Displayed weight only follows changes larger than this, 0 for none
+  uint16_t stableCount;   //Samples in the stability window, 0 never flags stable
+  float stableBand;       //Largest spread of the stability window that counts as stable
+  float creepCoefficient; //CreepCompensator model, 0 for none
+  float creepTime;        //Creep time constant, seconds
+  int32_t creepThreshold; //Load change event threshold, counts
+  float mainsHz;          //Mains frequency notched out, 0 for none
+  float notchWidth;       //Notch -3dB width, Hz
+  uint8_t notchSections;  //Harmonics notched, as the size of the device's notch cascade
+  float sampleRate;       //Nominal SPS the notches are tuned for
+  std::vector<biquad_coefficients_t> biquad;  //Q2.30 sections as loaded with set_biquad, empty for none
+
+  PipelineConfig() : calibrationFactor(1.0f), zeroOffset(0), average(1), flowWindow(0), deadband(0),
+    stableCount(0), stableBand(0), creepCoefficient(0), creepTime(1800), creepThreshold(0), mainsHz(0),
+    notchWidth(2.0f), notchSections(2), sampleRate(80) {}
+};
+
+struct PipelineOutput
+{
+  uint32_t t_us;
+  int32_t raw;          //Input reading
+  float rawWeight;      //raw converted to weight, where steps are detected
+  int32_t reading;      //QwiicScale::getLastReading() after the sample pipeline
+  float weight;         //reading converted to weight
+  float filtered;       //weight after the sliding average
+  float displayed;      //filtered after the deadband
+  bool stable;
+  float flowRate;       //0 when no estimate
+  float flowRateSd;
+};
+
+//Figures of merit for a replay. Steps are detected on the raw input converted to weight, which the
+//notch and biquad stages have not spread over several samples yet; a step has settled
+//once the displayed output stays within band of the mean of the last quarter of its segment.
+//A stable flag raised while the displayed weight is further than band from that mean is false.
+struct PipelineMetrics
+{
+  size_t samples;
+  size_t steps;
+  size_t unsettled;       //Steps whose output never stayed within band
+  double meanSettle_ms;
+  double maxSettle_ms;
+  double noise;           //Pooled standard deviation over the second half of each segment
+  size_t noiseSamples;
+  size_t stableSamples;   //Samples flagged stable
+  size_t falseStable;     //Of those, samples away from the final value
+};
+
+//Creep model fitted to a trace. The CreepCompensator response is computed for each candidate time
+//constant with the event threshold from the config, and the readings of each segment between
+//load change events, less the first skip seconds, are regressed on it with a separate intercept
+//per segment. The time constant with the smallest residual wins; coefficient is the slope there.
+struct CreepFit
+{
+  float coefficient;
+  float timeConstant;     //Seconds
+  size_t segments;        //Segments between load change events that took part
+  size_t samples;
+  double rms;             //Residual about the per-segment means with the model, counts
+  double rmsUncompensated;//The same without it
+};
+
+//The NAU7802 rate (10, 20, 40, 80 or 320 SPS) nearest to the median interval of the trace
+float nominal_sample_rate(const Trace &trace);
+//One section as "b0,b1,b2,a1,a2" in Q2.30 counts
+bool parse_biquad_section(const char *text, biquad_coefficients_t &section);
+//A file of sections, one per line; blank lines and lines starting with # are skipped
+bool load_biquad_file(const char *path, std::vector<biquad_coefficients_t> &sections, std::string &error);
+
+void run_pipeline(const Trace &trace, const PipelineConfig &config, std::vector<PipelineOutput> &output);
+void compute_metrics(const std::vector<PipelineOutput> &output, float step, float band, PipelineMetrics &metrics);
+bool fit_creep(const Trace &trace, const PipelineConfig &config, float skip_s, CreepFit &fit);
+#endif //REPLAY_PIPELINE_H
@@ -0,0 +1,132 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "trace.h"
+
+static const char TRACE_MAGIC[4] = {'Q', 'S', 'T', '1'};
+static const uint32_t TRACE_ESCAPE = 0xFFFFFF;
+
+//Value of a numeric "key": field, without a JSON parser
+static bool find_number(const char *line, const char *key, long long *value)
+{
+  const char *p = strstr(line, key);
+  if (p == NULL)
+    return false;
+
+  p += strlen(key);
+  char *end;
+  *value = strtoll(p, &end, 10);
+  return end != p;
+}
+
+static bool load_json_lines(FILE *file, Trace &trace)
+{
+  char line[512];
+
+  while (fgets(line, sizeof(line), file))
+  {
+    long long t, raw;
+    if (find_number(line, "\"t\":", &t) && find_number(line, "\"raw\":", &raw))
+    {
+      TraceSample sample = {(uint32_t)t, (int32_t)raw};
+      trace.push_back(sample);
+    }
+  }
+  return true;
+}
+
+static uint32_t read_u24(const uint8_t *p)
+{
+  return p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16);
+}
+
+static bool load_binary(FILE *file, Trace &trace, std::string &error)
+{
+  uint8_t record[6];
+  uint32_t t = 0;
+
+  while (fread(record, 1, sizeof(record), file) == sizeof(record))
+  {
+    //Sign extend bit 23
+    int32_t raw = (int32_t)(read_u24(record) << 8) >> 8;
+    uint32_t delta = read_u24(record + 3);
+
+    if (delta == TRACE_ESCAPE)
+    {
+      uint8_t absolute[4];
+      if (fread(absolute, 1, 4, file) != 4)
+      {
+        error = "truncated timestamp in binary trace";
+        return false;
+      }
+      t = absolute[0] | ((uint32_t)absolute[1] << 8) | ((uint32_t)absolute[2] << 16) | ((uint32_t)absolute[3] << 24);
+    }
+    else
+    {
+      t += delta;
+    }
+
+    TraceSample sample = {t, raw};
+    trace.push_back(sample);
+  }
+  return true;
+}
+
+bool load_trace(const char *path, Trace &trace, std::string &error)
+{
+  FILE *file = fopen(path, "rb");
+  if (file == NULL)
+  {
+    error = std::string("cannot open ") + path;
+    return false;
+  }
+
+  char magic[4];
+  bool binary = (fread(magic, 1, 4, file) == 4) && !memcmp(magic, TRACE_MAGIC, 4);
+  if (!binary)
+    rewind(file);
+
+  bool ok = binary ? load_binary(file, trace, error) : load_json_lines(file, trace);
+  fclose(file);
+  return ok;
+}
+
+bool write_binary_trace(const char *path, const Trace &trace, std::string &error)
+{
+  FILE *file = fopen(path, "wb");
+  if (file == NULL)
+  {
+    error = std::string("cannot create ") + path;
+    return false;
+  }
+
+  fwrite(TRACE_MAGIC, 1, 4, file);
+
+  uint32_t previous = 0;
+  for (size_t i = 0; i < trace.size(); i++)
+  {
+    uint32_t raw = (uint32_t)trace[i].raw;
+    uint32_t delta = trace[i].t_us - previous;
+    bool escape = (i == 0) || (delta >= TRACE_ESCAPE);
+    if (escape)
+      delta = TRACE_ESCAPE;
+
+    uint8_t record[6] = {(uint8_t)raw, (uint8_t)(raw >> 8), (uint8_t)(raw >> 16),
+                         (uint8_t)delta, (uint8_t)(delta >> 8), (uint8_t)(delta >> 16)};
+    fwrite(record, 1, sizeof(record), file);
+
+    if (escape)
+    {
+      uint32_t t = trace[i].t_us;
+      uint8_t absolute[4] = {(uint8_t)t, (uint8_t)(t >> 8), (uint8_t)(t >> 16), (uint8_t)(t >> 24)};
+      fwrite(absolute, 1, 4, file);
+    }
+    previous = trace[i].t_us;
+  }
+
+  bool ok = !ferror(file);
+  fclose(file);
+  if (!ok)
+    error = std::string("write failed on ") + path;
+  return ok;
+}
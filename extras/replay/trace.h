@@ -0,0 +1,28 @@
+#ifndef REPLAY_TRACE_H
+#define REPLAY_TRACE_H
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/* Recorded raw conversions with their micros() timestamps.
+
+  Two input formats are read:
+  - JSON lines as sent by ScaleRpcServer in "raw" mode: {"id":0,"result":{"t":123,"raw":-45}}.
+    Lines without both fields (acks, errors) are skipped.
+  - Binary traces: the magic "QST1", then one 6 byte record per conversion: the reading as a
+    little-endian 24-bit two's complement value followed by the little-endian 24-bit time since the
+    previous record in microseconds (since 0 for the first). A time field of 0xFFFFFF is followed by
+    a 4 byte absolute timestamp, for gaps of 16.7s or more.*/
+
+struct TraceSample
+{
+  uint32_t t_us;
+  int32_t raw;
+};
+
+typedef std::vector<TraceSample> Trace;
+
+//Load either format; binary traces are detected by their magic
+bool load_trace(const char *path, Trace &trace, std::string &error);
+bool write_binary_trace(const char *path, const Trace &trace, std::string &error);
+#endif //REPLAY_TRACE_H
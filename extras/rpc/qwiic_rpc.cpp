@@ -0,0 +1,187 @@
+/* Runs the JSON-RPC server on a Linux host, ScaleRpcServer<MemoryStream, QwiicScale>, with request
+  lines read from a file (or stdin) and the replies written to stdout as the device would send them.
+  There is no NAU7802 on the host, so methods that talk to it reply with an I2C error; the others,
+  and the stream, run on the library's own code.
+
+  With --trace, recorded conversions are fed through QwiicScale::processSample() and the server's
+  filter(), --samples of them after each request, so get_sensors and the continuous and raw modes
+  have data. --repeat runs the requests several times and reports the time per request, including
+  the conversions fed after it, for benchmarks of the protocol path.*/
+
+// Build from the repository root with ArduinoJson 6 on the include path:
+//   g++ -std=gnu++11 -O2 -Iextras/host -Isrc -Iextras/replay -I<ArduinoJson>/src -o qwiic_rpc
+//       extras/rpc/qwiic_rpc.cpp extras/replay/trace.cpp extras/host/host_arduino.cpp src/*.cpp
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "QwiicScale.h"
+#include "ScaleRpcServer.h"
+#include "MemoryStream.h"
+#include "trace.h"
+
+static void usage(const char *name)
+{
+  fprintf(stderr,
+          "usage: %s [options] [requests]\n"
+          "  requests           file of request lines (default stdin)\n"
+          "  --cal F            calibration factor, counts per unit (default uncalibrated)\n"
+          "  --zero N           zero offset, counts (default 0)\n"
+          "  --average N        stream average size (default 8)\n"
+          "  --trace FILE       conversions fed to the scale between requests\n"
+          "  --samples N        conversions fed after each request (default 8)\n"
+          "  --repeat N         run the requests N times and report the time per request\n"
+          "  --quiet            no replies, timing only\n",
+          name);
+}
+
+struct Host
+{
+  uint8_t output[4096];
+  MemoryStream stream;
+  QwiicScale scale;
+  ScaleRpcServer<MemoryStream, QwiicScale> server;
+  bool quiet;
+
+  Host(uint8_t average, bool quiet) : stream(output, sizeof(output)), server(stream, scale, 0, average), quiet(quiet) {}
+
+  //Move the queued replies through the stream to stdout
+  void drain()
+  {
+    while (server.getTxPending())
+    {
+      server.drainReplies();
+      if (!quiet)
+        fwrite(stream.getOutput(), 1, stream.getOutputLength(), stdout);
+      stream.clearOutput();
+    }
+  }
+
+  void request(const std::string &line)
+  {
+    std::string input = line + "\n";
+    stream.setInput(input.c_str());
+    while (stream.available())
+    {
+      server.pollRequests();
+      drain();
+    }
+  }
+
+  void sample(const TraceSample &s)
+  {
+    hostSetMicros(s.t_us);
+    scale.processSample(s.raw, s.t_us);
+    server.addSample(scale.getLastReading());
+    server.filter();
+    drain();
+  }
+};
+
+int main(int argc, char **argv)
+{
+  float calibrationFactor = 0;
+  int32_t zeroOffset = 0;
+  int average = 8;
+  const char *tracePath = NULL;
+  const char *requestPath = NULL;
+  long samplesPerRequest = 8;
+  long repeat = 1;
+  bool quiet = false;
+
+  for (int i = 1; i < argc; i++)
+  {
+    bool hasValue = (i + 1 < argc);
+    if (!strcmp(argv[i], "--cal") && hasValue)
+      calibrationFactor = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--zero") && hasValue)
+      zeroOffset = atol(argv[++i]);
+    else if (!strcmp(argv[i], "--average") && hasValue)
+      average = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--trace") && hasValue)
+      tracePath = argv[++i];
+    else if (!strcmp(argv[i], "--samples") && hasValue)
+      samplesPerRequest = atol(argv[++i]);
+    else if (!strcmp(argv[i], "--repeat") && hasValue)
+      repeat = atol(argv[++i]);
+    else if (!strcmp(argv[i], "--quiet"))
+      quiet = true;
+    else if ((argv[i][0] != '-') && (requestPath == NULL))
+      requestPath = argv[i];
+    else
+    {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+
+  if ((average < 1) || (average > 255) || (repeat < 1) || (samplesPerRequest < 0))
+  {
+    usage(argv[0]);
+    return 2;
+  }
+
+  Trace trace;
+  if (tracePath != NULL)
+  {
+    std::string error;
+    if (!load_trace(tracePath, trace, error))
+    {
+      fprintf(stderr, "%s\n", error.c_str());
+      return 1;
+    }
+  }
+
+  FILE *in = requestPath ? fopen(requestPath, "r") : stdin;
+  if (in == NULL)
+  {
+    fprintf(stderr, "cannot open %s\n", requestPath);
+    return 1;
+  }
+  std::vector<std::string> requests;
+  char line[SCALE_RPC_RX_LINE_SIZE * 2];
+  while (fgets(line, sizeof(line), in))
+  {
+    size_t length = strcspn(line, "\r\n");
+    if (length > 0)
+      requests.push_back(std::string(line, length));
+  }
+  if (in != stdin)
+    fclose(in);
+
+  Host host((uint8_t)average, quiet);
+  host.scale.useEEPROM = false;
+  if (calibrationFactor != 0)
+  {
+    host.scale.setCalibrationFactor(calibrationFactor);
+    host.scale.setZeroOffset(zeroOffset);
+    host.scale.isCalibrated = true;
+  }
+
+  size_t next = 0;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (long r = 0; r < repeat; r++)
+  {
+    for (size_t i = 0; i < requests.size(); i++)
+    {
+      host.request(requests[i]);
+      for (long s = 0; (s < samplesPerRequest) && (next < trace.size()); s++)
+        host.sample(trace[next++]);
+    }
+  }
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  //The rest of the trace, e.g. for a stream started by the last request
+  while (next < trace.size())
+    host.sample(trace[next++]);
+
+  if ((repeat > 1) || quiet)
+  {
+    size_t count = requests.size() * repeat;
+    fprintf(stderr, "%zu requests in %.3fs, %.2fus per request, %u replies dropped\n", count, elapsed,
+            count ? elapsed * 1e6 / count : 0.0, host.server.getTxDropped());
+  }
+  return 0;
+}
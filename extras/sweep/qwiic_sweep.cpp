@@ -0,0 +1,361 @@
+/* Tunes the sample pipeline by replaying recorded traces with every combination of a parameter
+  grid, spread over all cores. Each configuration is scored on every trace with the same metrics
+  as qwiic_replay and the configurations are ranked on settle time, steady-state noise and
+  false-stable rate: the sum of the three ranks, with configurations that leave steps unsettled
+  after all others.
+
+  Grid values are lists (4,8,16) or ranges (lo:hi:step), e.g.
+    qwiic_sweep --cal 420 --zero 8150 --step 5 --average 1:32:1 --stable 4,8,16 --stable-band 0.02,0.05 *.qst
+  The mains notches and biquad designs are axes too, e.g. --notch 0,50 --notch-width 1,2,4
+  --biquad none,lp5.txt,lp10.txt with files in the qwiic_replay --biquad-file format.*/
+
+// Build from the repository root with
+//   g++ -std=gnu++11 -O2 -pthread -Iextras/host -Isrc -Iextras/replay -Iextras/sweep -o qwiic_sweep
+//       extras/sweep/qwiic_sweep.cpp extras/sweep/work_pool.cpp extras/replay/trace.cpp
+//       extras/replay/replay_pipeline.cpp extras/host/host_arduino.cpp src/*.cpp
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include "replay_pipeline.h"
+#include "work_pool.h"
+
+struct SweepResult
+{
+  PipelineConfig config;
+  size_t biquad;        //Index into the --biquad list
+  size_t steps;
+  size_t unsettled;
+  double meanSettle_ms;
+  double maxSettle_ms;
+  double noise;
+  double falseStableRate;
+  size_t score;
+};
+
+static void usage(const char *name)
+{
+  fprintf(stderr,
+          "usage: %s [options] trace...\n"
+          "  --cal F              calibration factor, counts per unit (default 1)\n"
+          "  --zero N             zero offset, counts (default 0)\n"
+          "  --step W             weight jump that starts a new segment (required)\n"
+          "  --band W             settle band around the final value (default step / 100)\n"
+          "  --average LIST       sliding average lengths (default 1)\n"
+          "  --deadband LIST      display deadbands (default 0)\n"
+          "  --stable LIST        stability windows in samples (default 8)\n"
+          "  --stable-band LIST   stability spreads (default band)\n"
+          "  --notch LIST         mains frequencies notched out, 0 for none (default 0)\n"
+          "  --notch-width LIST   notch -3dB widths (default 2)\n"
+          "  --notch-sections N   harmonics notched (default 2)\n"
+          "  --sps N              rate the notches are tuned for (default from the first trace)\n"
+          "  --biquad FILES       comma separated biquad section files, none for no biquad (default none)\n"
+          "  --threads N          worker threads (default one per core)\n"
+          "  --top N              configurations printed (default 20)\n"
+          "  --csv FILE           write every configuration to FILE\n"
+          "LIST is comma separated values or lo:hi:step\n",
+          name);
+}
+
+static bool parse_list(const char *text, std::vector<double> &values)
+{
+  values.clear();
+  double lo, hi, step;
+  char extra;
+  if (sscanf(text, "%lf:%lf:%lf%c", &lo, &hi, &step, &extra) == 3)
+  {
+    if ((step <= 0) || (hi < lo))
+      return false;
+    //Half a step of slack so that float ranges include hi
+    for (double v = lo; v <= hi + step / 2; v += step)
+      values.push_back(v);
+    return true;
+  }
+
+  const char *p = text;
+  while (*p)
+  {
+    char *end;
+    double v = strtod(p, &end);
+    if (end == p)
+      return false;
+    values.push_back(v);
+    p = end;
+    if (*p == ',')
+      p++;
+    else if (*p)
+      return false;
+  }
+  return !values.empty();
+}
+
+static bool parse_names(const char *text, std::vector<std::string> &names)
+{
+  names.clear();
+  const char *p = text;
+  while (true)
+  {
+    const char *end = strchr(p, ',');
+    std::string name = end ? std::string(p, end - p) : std::string(p);
+    if (name.empty())
+      return false;
+    names.push_back(name);
+    if (end == NULL)
+      return true;
+    p = end + 1;
+  }
+}
+
+//Ranks of values, ties sharing the lower rank
+static void rank(const std::vector<double> &values, std::vector<size_t> &ranks)
+{
+  std::vector<size_t> order(values.size());
+  for (size_t i = 0; i < order.size(); i++)
+    order[i] = i;
+  std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {return values[a] < values[b];});
+
+  ranks.resize(values.size());
+  for (size_t i = 0; i < order.size(); i++)
+    ranks[order[i]] = ((i > 0) && (values[order[i]] == values[order[i - 1]])) ? ranks[order[i - 1]] : i;
+}
+
+int main(int argc, char **argv)
+{
+  float calibrationFactor = 1;
+  int32_t zeroOffset = 0;
+  float step = 0;
+  float band = -1;
+  std::vector<double> averages(1, 1);
+  std::vector<double> deadbands(1, 0);
+  std::vector<double> stableCounts(1, 8);
+  std::vector<double> stableBands;
+  std::vector<double> notches(1, 0);
+  std::vector<double> notchWidths(1, 2);
+  int notchSections = 2;
+  float sampleRate = 0;
+  std::vector<std::string> biquadNames(1, "none");
+  unsigned threads = 0;
+  size_t top = 20;
+  const char *csvPath = NULL;
+  std::vector<const char *> tracePaths;
+
+  for (int i = 1; i < argc; i++)
+  {
+    bool hasValue = (i + 1 < argc);
+    bool ok = true;
+    if (!strcmp(argv[i], "--cal") && hasValue)
+      calibrationFactor = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--zero") && hasValue)
+      zeroOffset = atol(argv[++i]);
+    else if (!strcmp(argv[i], "--step") && hasValue)
+      step = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--band") && hasValue)
+      band = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--average") && hasValue)
+      ok = parse_list(argv[++i], averages);
+    else if (!strcmp(argv[i], "--deadband") && hasValue)
+      ok = parse_list(argv[++i], deadbands);
+    else if (!strcmp(argv[i], "--stable") && hasValue)
+      ok = parse_list(argv[++i], stableCounts);
+    else if (!strcmp(argv[i], "--stable-band") && hasValue)
+      ok = parse_list(argv[++i], stableBands);
+    else if (!strcmp(argv[i], "--notch") && hasValue)
+      ok = parse_list(argv[++i], notches);
+    else if (!strcmp(argv[i], "--notch-width") && hasValue)
+      ok = parse_list(argv[++i], notchWidths);
+    else if (!strcmp(argv[i], "--notch-sections") && hasValue)
+      notchSections = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--sps") && hasValue)
+      sampleRate = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--biquad") && hasValue)
+      ok = parse_names(argv[++i], biquadNames);
+    else if (!strcmp(argv[i], "--threads") && hasValue)
+      threads = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--top") && hasValue)
+      top = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--csv") && hasValue)
+      csvPath = argv[++i];
+    else if (argv[i][0] != '-')
+      tracePaths.push_back(argv[i]);
+    else
+      ok = false;
+
+    if (!ok)
+    {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+
+  if (tracePaths.empty() || (step <= 0) || (calibrationFactor == 0))
+  {
+    usage(argv[0]);
+    return 2;
+  }
+  if (band < 0)
+    band = step / 100;
+  if (stableBands.empty())
+    stableBands.push_back(band);
+
+  std::vector<Trace> traces(tracePaths.size());
+  for (size_t i = 0; i < tracePaths.size(); i++)
+  {
+    std::string error;
+    if (!load_trace(tracePaths[i], traces[i], error))
+    {
+      fprintf(stderr, "%s\n", error.c_str());
+      return 1;
+    }
+  }
+
+  std::vector<std::vector<biquad_coefficients_t> > biquads(biquadNames.size());
+  for (size_t i = 0; i < biquadNames.size(); i++)
+  {
+    std::string error;
+    if ((biquadNames[i] != "none") && !load_biquad_file(biquadNames[i].c_str(), biquads[i], error))
+    {
+      fprintf(stderr, "%s\n", error.c_str());
+      return 1;
+    }
+    if (biquads[i].size() > 255)
+    {
+      fprintf(stderr, "%s: at most 255 biquad sections\n", biquadNames[i].c_str());
+      return 2;
+    }
+  }
+  if (sampleRate <= 0)
+    sampleRate = nominal_sample_rate(traces[0]);
+
+  std::vector<SweepResult> results;
+  for (size_t a = 0; a < averages.size(); a++)
+    for (size_t d = 0; d < deadbands.size(); d++)
+      for (size_t s = 0; s < stableCounts.size(); s++)
+        for (size_t b = 0; b < stableBands.size(); b++)
+          for (size_t n = 0; n < notches.size(); n++)
+            for (size_t w = 0; w < notchWidths.size(); w++)
+              for (size_t q = 0; q < biquads.size(); q++)
+              {
+                //Widths only matter with a notch
+                if ((notches[n] <= 0) && (w > 0))
+                  continue;
+
+                SweepResult result = SweepResult();
+                result.config.calibrationFactor = calibrationFactor;
+                result.config.zeroOffset = zeroOffset;
+                result.config.average = (uint16_t)max(averages[a], 1.0);
+                result.config.deadband = deadbands[d];
+                result.config.stableCount = (uint16_t)max(stableCounts[s], 0.0);
+                result.config.stableBand = stableBands[b];
+                result.config.mainsHz = max(notches[n], 0.0);
+                result.config.notchWidth = (notches[n] > 0) ? notchWidths[w] : 0;
+                result.config.notchSections = (uint8_t)max(notchSections, 1);
+                result.config.sampleRate = sampleRate;
+                result.config.biquad = biquads[q];
+                result.biquad = q;
+                results.push_back(result);
+              }
+
+  //One job per configuration and trace; each writes only its own metrics
+  size_t jobCount = results.size() * traces.size();
+  std::vector<PipelineMetrics> metrics(jobCount);
+  WorkStealingPool pool(threads);
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  pool.run(jobCount, [&](size_t job) {
+    size_t config = job / traces.size();
+    size_t trace = job % traces.size();
+    std::vector<PipelineOutput> output;
+    run_pipeline(traces[trace], results[config].config, output);
+    compute_metrics(output, step, band, metrics[job]);
+  });
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  //Pool the per-trace metrics of each configuration
+  std::vector<double> settles(results.size());
+  std::vector<double> noises(results.size());
+  std::vector<double> falseRates(results.size());
+  for (size_t c = 0; c < results.size(); c++)
+  {
+    SweepResult &r = results[c];
+    double settleTotal = 0;
+    double squares = 0;
+    size_t noiseSamples = 0;
+    size_t stable = 0;
+    size_t falseStable = 0;
+    for (size_t t = 0; t < traces.size(); t++)
+    {
+      const PipelineMetrics &m = metrics[c * traces.size() + t];
+      r.steps += m.steps;
+      r.unsettled += m.unsettled;
+      settleTotal += m.meanSettle_ms * (m.steps - m.unsettled);
+      r.maxSettle_ms = max(r.maxSettle_ms, m.maxSettle_ms);
+      squares += m.noise * m.noise * m.noiseSamples;
+      noiseSamples += m.noiseSamples;
+      stable += m.stableSamples;
+      falseStable += m.falseStable;
+    }
+    if (r.steps > r.unsettled)
+      r.meanSettle_ms = settleTotal / (r.steps - r.unsettled);
+    if (noiseSamples > 0)
+      r.noise = sqrt(squares / noiseSamples);
+    //A configuration that never reports stable is useless, not perfect
+    r.falseStableRate = stable ? (double)falseStable / stable : 1.0;
+
+    settles[c] = r.meanSettle_ms;
+    noises[c] = r.noise;
+    falseRates[c] = r.falseStableRate;
+  }
+
+  std::vector<size_t> settleRanks, noiseRanks, falseRanks;
+  rank(settles, settleRanks);
+  rank(noises, noiseRanks);
+  rank(falseRates, falseRanks);
+  for (size_t c = 0; c < results.size(); c++)
+    results[c].score = settleRanks[c] + noiseRanks[c] + falseRanks[c];
+
+  std::stable_sort(results.begin(), results.end(), [](const SweepResult &a, const SweepResult &b) {
+    if ((a.unsettled == 0) != (b.unsettled == 0))
+      return a.unsettled == 0;
+    if (a.score != b.score)
+      return a.score < b.score;
+    return a.meanSettle_ms < b.meanSettle_ms;
+  });
+
+  fprintf(stderr, "%zu configurations x %zu traces on %u threads in %.2fs (%zu steals)\n",
+          results.size(), traces.size(), pool.getThreadCount(), elapsed, pool.getSteals());
+
+  printf("%5s %8s %9s %7s %11s %6s %6s %-12s %6s %9s %9s %11s %12s\n", "rank", "average", "deadband",
+         "stable", "stable_band", "notch", "width", "biquad", "steps", "unsettled", "settle_ms", "noise",
+         "false_stable");
+  for (size_t i = 0; (i < results.size()) && (i < top); i++)
+  {
+    const SweepResult &r = results[i];
+    printf("%5zu %8u %9.4g %7u %11.4g %6.4g %6.4g %-12s %6zu %9zu %9.1f %11.4g %12.4f\n", i + 1,
+           r.config.average, r.config.deadband, r.config.stableCount, r.config.stableBand, r.config.mainsHz,
+           r.config.notchWidth, biquadNames[r.biquad].c_str(), r.steps, r.unsettled, r.meanSettle_ms, r.noise,
+           r.falseStableRate);
+  }
+
+  if (csvPath != NULL)
+  {
+    FILE *csv = fopen(csvPath, "w");
+    if (csv == NULL)
+    {
+      fprintf(stderr, "cannot create %s\n", csvPath);
+      return 1;
+    }
+    fprintf(csv, "rank,average,deadband,stable,stable_band,notch,notch_width,biquad,steps,unsettled,"
+            "settle_mean_ms,settle_max_ms,noise,false_stable_rate,score\n");
+    for (size_t i = 0; i < results.size(); i++)
+    {
+      const SweepResult &r = results[i];
+      fprintf(csv, "%zu,%u,%.6g,%u,%.6g,%.6g,%.6g,%s,%zu,%zu,%.3f,%.3f,%.6g,%.6g,%zu\n", i + 1,
+              r.config.average, r.config.deadband, r.config.stableCount, r.config.stableBand, r.config.mainsHz,
+              r.config.notchWidth, biquadNames[r.biquad].c_str(), r.steps, r.unsettled, r.meanSettle_ms,
+              r.maxSettle_ms, r.noise, r.falseStableRate, r.score);
+    }
+    fclose(csv);
+  }
+  return 0;
+}
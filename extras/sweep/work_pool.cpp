@@ -0,0 +1,66 @@
+#include <thread>
+#include "work_pool.h"
+
+WorkStealingPool::WorkStealingPool(unsigned threads)
+  : threadCount(threads ? threads : std::thread::hardware_concurrency()), workers(threadCount ? threadCount : 1)
+{
+  if (threadCount == 0)
+    threadCount = 1;
+}
+
+void WorkStealingPool::run(size_t count, const std::function<void(size_t)> &job)
+{
+  steals = 0;
+  for (unsigned w = 0; w < threadCount; w++)
+  {
+    size_t first = count * w / threadCount;
+    size_t last = count * (w + 1) / threadCount;
+    workers[w].jobs.clear();
+    for (size_t i = first; i < last; i++)
+      workers[w].jobs.push_back(i);
+  }
+
+  //The calling thread is worker 0
+  std::vector<std::thread> threads;
+  for (unsigned w = 1; w < threadCount; w++)
+    threads.push_back(std::thread(&WorkStealingPool::work, this, w, std::cref(job)));
+  work(0, job);
+  for (size_t i = 0; i < threads.size(); i++)
+    threads[i].join();
+}
+
+void WorkStealingPool::work(unsigned self, const std::function<void(size_t)> &job)
+{
+  size_t index;
+  while (take(self, &index))
+    job(index);
+}
+
+bool WorkStealingPool::take(unsigned self, size_t *index)
+{
+  {
+    Worker &own = workers[self];
+    std::lock_guard<std::mutex> guard(own.lock);
+    if (!own.jobs.empty())
+    {
+      *index = own.jobs.back();
+      own.jobs.pop_back();
+      return true;
+    }
+  }
+
+  for (unsigned i = 1; i < threadCount; i++)
+  {
+    Worker &victim = workers[(self + i) % threadCount];
+    std::lock_guard<std::mutex> guard(victim.lock);
+    if (!victim.jobs.empty())
+    {
+      *index = victim.jobs.front();
+      victim.jobs.pop_front();
+      std::lock_guard<std::mutex> count(stealLock);
+      steals++;
+      return true;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,43 @@
+#ifndef WORK_POOL_H
+#define WORK_POOL_H
+#include <stddef.h>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+/* Runs a fixed set of jobs 0..count-1 on a pool of threads with work stealing.
+  Each worker starts with a contiguous block of the jobs in its own deque and takes from the back
+  of it. A worker whose deque is empty steals from the front of another worker's, so long and short
+  jobs even out without a shared queue that every job has to pass through. Jobs are independent and
+  do not add jobs, so a worker that finds every deque empty is finished.*/
+
+class WorkStealingPool
+{
+  public:
+    //0 threads uses one per hardware thread
+    WorkStealingPool(unsigned threads = 0);
+
+    //Calls job(index) once for every index below count and returns when all have finished
+    void run(size_t count, const std::function<void(size_t)> &job);
+
+    unsigned getThreadCount() {return threadCount;}
+    //Jobs taken from another worker's deque during the last run()
+    size_t getSteals() {return steals;}
+
+  private:
+    struct Worker
+    {
+      std::mutex lock;
+      std::deque<size_t> jobs;
+    };
+
+    void work(unsigned self, const std::function<void(size_t)> &job);
+    bool take(unsigned self, size_t *index);
+
+    unsigned threadCount;
+    std::vector<Worker> workers;
+    std::mutex stealLock;
+    size_t steals = 0;
+};
+#endif //WORK_POOL_H
@@ -0,0 +1,42 @@
+#include <Arduino.h>
+#include "AcquisitionHub.h"
+
+AcquisitionHubBase::AcquisitionHubBase(hub_sample_t *buffer, uint8_t capacity)
+  : buffer(buffer), capacity(capacity)
+{
+}
+
+void AcquisitionHubBase::publish(int32_t reading, int32_t primary, uint32_t timestamp_us)
+{
+  hub_sample_t &sample = buffer[head];
+  sample.reading = reading;
+  sample.primary = primary;
+  sample.timestamp_us = timestamp_us;
+  head = (head + 1 < capacity) ? head + 1 : 0;
+  published++;
+}
+
+bool AcquisitionHubBase::read(hub_cursor_t *cursor, hub_sample_t *sample)
+{
+  uint32_t behind = published - cursor->next;
+  if (behind == 0)
+    return false;
+
+  if (behind > capacity)
+  {
+    cursor->dropped += behind - capacity;
+    cursor->next = published - capacity;
+    behind = capacity;
+  }
+
+  //The sequence numbers wrap, so the slot is found from the distance behind the write position
+  *sample = buffer[(head >= behind) ? head - behind : head + capacity - behind];
+  cursor->next++;
+  return true;
+}
+
+uint8_t AcquisitionHubBase::getPending(const hub_cursor_t *cursor)
+{
+  uint32_t behind = published - cursor->next;
+  return (behind > capacity) ? capacity : behind;
+}
@@ -0,0 +1,65 @@
+#ifndef ACQUISITION_HUB_H
+#define ACQUISITION_HUB_H
+#include <Arduino.h>
+
+/* Publishes every conversion once to any number of consumers, so a fast stream, a slow precise
+  average and a tare can all use the same conversions instead of each reading the ADC itself.
+
+  QwiicScale::processSample() writes each channel 1 conversion into a ring buffer. Every consumer
+  keeps its own hub_cursor_t and reads at its own pace, with its own filter state (e.g. a Pipeline
+  from SamplePipeline.h) on its side. The hub does not track its consumers, so any number can
+  subscribe without registering. A consumer that falls more than the capacity behind skips to the
+  oldest conversion still held and has the skipped ones counted in its cursor.
+
+  Blocking consumers (QwiicScale::getHubAverage(), and through it tare and calibration) pump the
+  hub with update() while they wait, so the other consumers also see those conversions.*/
+
+typedef struct
+{
+  int32_t reading;        //After the filter stages, as QwiicScale::getLastReading()
+  int32_t primary;        //Before temperature compensation and the filter stages, as tare and calibration average
+  uint32_t timestamp_us;
+} hub_sample_t;
+
+typedef struct
+{
+  uint32_t next;          //Sequence number of the next conversion to read
+  uint32_t dropped;       //Conversions overwritten before this consumer read them
+} hub_cursor_t;
+
+class AcquisitionHubBase
+{
+  public:
+    void publish(int32_t reading, int32_t primary, uint32_t timestamp_us);
+
+    //Start a cursor at the next conversion to be published
+    void subscribe(hub_cursor_t *cursor) {cursor->next = published; cursor->dropped = 0;}
+    //Oldest unread conversion of this cursor. Returns false if it has read everything.
+    bool read(hub_cursor_t *cursor, hub_sample_t *sample);
+    //Conversions waiting for this cursor, up to the capacity
+    uint8_t getPending(const hub_cursor_t *cursor);
+
+    uint32_t getPublished() {return published;}
+    uint8_t getCapacity() {return capacity;}
+
+  protected:
+    AcquisitionHubBase(hub_sample_t *buffer, uint8_t capacity);
+
+  private:
+    hub_sample_t *buffer;
+    uint8_t capacity;
+    uint8_t head = 0;         //Next slot to write
+    uint32_t published = 0;   //Conversions published so far, the sequence number of the next
+};
+
+//Hub holding the last CAPACITY conversions (12 bytes each)
+template <uint8_t CAPACITY>
+class AcquisitionHub : public AcquisitionHubBase
+{
+  public:
+    AcquisitionHub() : AcquisitionHubBase(samples, CAPACITY) {};
+
+  private:
+    hub_sample_t samples[CAPACITY];
+};
+#endif //ACQUISITION_HUB_H
@@ -0,0 +1,161 @@
+#include <Arduino.h>
+#include "BiquadCascade.h"
+
+#define BIQUAD_OUTPUT_MAX  2147483647LL
+#define BIQUAD_OUTPUT_MIN  (-2147483647LL - 1)
+
+BiquadCascadeBase::BiquadCascadeBase(biquad_section_t *sections, uint8_t capacity)
+  : sections(sections), capacity(capacity)
+{
+}
+
+bool BiquadCascadeBase::setSection(uint8_t index, const biquad_coefficients_t &coefficients)
+{
+  if (index >= capacity)
+    return false;
+
+  sections[index].c = coefficients;
+  if (index >= sectionCount)
+  {
+    //Sections skipped over pass readings through until they are set
+    for (uint8_t i = sectionCount; i < index; i++)
+    {
+      sections[i].c.b0 = BIQUAD_ONE;
+      sections[i].c.b1 = sections[i].c.b2 = sections[i].c.a1 = sections[i].c.a2 = 0;
+    }
+    sectionCount = index + 1;
+  }
+  primed = false;
+  return true;
+}
+
+bool BiquadCascadeBase::getSection(uint8_t index, biquad_coefficients_t *coefficients)
+{
+  if (index >= sectionCount)
+    return false;
+
+  *coefficients = sections[index].c;
+  return true;
+}
+
+void BiquadCascadeBase::setSectionCount(uint8_t count)
+{
+  sectionCount = min(count, capacity);
+  primed = false;
+}
+
+//Fill the delay lines with the response the cascade would settle to for a constant reading
+void BiquadCascadeBase::prime(int32_t reading)
+{
+  int64_t value = reading;
+  for (uint8_t i = 0; i < sectionCount; i++)
+  {
+    biquad_section_t &s = sections[i];
+    //Exact DC gain terms; the coefficients near +-2^31 would lose bits summed in float
+    int64_t numerator = (int64_t)s.c.b0 + s.c.b1 + s.c.b2;
+    int64_t denominator = (int64_t)BIQUAD_ONE + s.c.a1 + s.c.a2;
+
+    s.x1 = s.x2 = (int32_t)value;
+    //A pole at DC (denominator 0) has no steady state; start it from the input
+    if (denominator != 0)
+    {
+      double settled = (double)value * numerator / denominator;
+      if (settled > BIQUAD_OUTPUT_MAX)
+        value = BIQUAD_OUTPUT_MAX;
+      else if (settled < BIQUAD_OUTPUT_MIN)
+        value = BIQUAD_OUTPUT_MIN;
+      else
+        value = (int64_t)settled;
+    }
+    s.y1 = s.y2 = (int32_t)value;
+    s.error = 0;
+  }
+  primed = true;
+}
+
+int32_t BiquadCascadeBase::filter(int32_t reading)
+{
+  if (!primed)
+    prime(reading);
+
+  int32_t x = reading;
+  for (uint8_t i = 0; i < sectionCount; i++)
+  {
+    biquad_section_t &s = sections[i];
+    int64_t acc = s.error;
+    acc += (int64_t)s.c.b0 * x;
+    acc += (int64_t)s.c.b1 * s.x1;
+    acc += (int64_t)s.c.b2 * s.x2;
+    acc -= (int64_t)s.c.a1 * s.y1;
+    acc -= (int64_t)s.c.a2 * s.y2;
+
+    //Floor division by 2^30; the remainder is always in [0, 2^30)
+    int64_t y = acc >> 30;
+    s.error = (int32_t)(acc - (y << 30));
+    if (y > BIQUAD_OUTPUT_MAX)
+      y = BIQUAD_OUTPUT_MAX;
+    else if (y < BIQUAD_OUTPUT_MIN)
+      y = BIQUAD_OUTPUT_MIN;
+
+    s.x2 = s.x1;
+    s.x1 = x;
+    s.y2 = s.y1;
+    s.y1 = (int32_t)y;
+    x = (int32_t)y;
+  }
+  return x;
+}
+
+//Zeros on the unit circle at w0 and poles just inside at radius r give
+//(1 - 2cos(w0) z^-1 + z^-2) / (1 - 2r cos(w0) z^-1 + r^2 z^-2), scaled by g for unity gain at DC.
+bool biquadNotch(float notch_hz, float sample_rate, float width_hz, biquad_coefficients_t *c)
+{
+  if ((sample_rate <= 0) || (width_hz <= 0))
+    return false;
+
+  float f = fmod(notch_hz, sample_rate);
+  if (f > sample_rate / 2)
+    f = sample_rate - f;
+  if (f < width_hz)
+    return false;
+
+  float w0 = 2 * PI * f / sample_rate;
+  float r = 1 - PI * width_hz / sample_rate;
+  if (r < 0)
+    r = 0;
+  float cosine = cos(w0);
+  float g = (1 - 2 * r * cosine + r * r) / (2 - 2 * cosine);
+
+  //Close to DC the gain needed for unity at DC pushes b1 out of the Q2.30 range
+  if (fabs(2 * g * cosine) >= 2)
+    return false;
+
+  c->b0 = lround(g * BIQUAD_ONE);
+  c->b1 = lround(-2 * g * cosine * BIQUAD_ONE);
+  c->b2 = c->b0;
+  c->a1 = lround(-2 * r * cosine * BIQUAD_ONE);
+  c->a2 = lround(r * r * BIQUAD_ONE);
+  return true;
+}
+
+uint8_t biquadMainsNotches(BiquadCascadeBase *cascade, float mains_hz, float sample_rate, float width_hz)
+{
+  uint8_t sections = 0;
+  cascade->setSectionCount(0);
+  for (uint8_t harmonic = 1; (harmonic <= 2 * cascade->getCapacity()) && (sections < cascade->getCapacity()); harmonic++)
+  {
+    biquad_coefficients_t c, earlier;
+    if (!biquadNotch(harmonic * mains_hz, sample_rate, width_hz, &c))
+      continue;
+
+    bool repeated = false;
+    for (uint8_t i = 1; i < harmonic; i++)
+      if (biquadNotch(i * mains_hz, sample_rate, width_hz, &earlier) && (earlier.a1 == c.a1))
+        repeated = true;
+    if (repeated)
+      continue;
+
+    cascade->setSection(sections++, c);
+  }
+  return sections;
+}
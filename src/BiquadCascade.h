@@ -0,0 +1,83 @@
+#ifndef BIQUAD_CASCADE_H
+#define BIQUAD_CASCADE_H
+#include <Arduino.h>
+
+/* Fixed-point IIR low-pass (or any other response) as a cascade of second-order sections,
+  a better filter per sample of delay than a boxcar average, with far smaller sidelobes.
+
+  Each section computes y = b0 x + b1 x1 + b2 x2 - a1 y1 - a2 y2 in Direct Form I with Q2.30
+  coefficients (1.0 = 2^30, range [-2, 2)) and a 64-bit accumulator, so it costs five 32x32
+  multiplies per section per sample whatever the coefficients. The rounding error of each output is
+  fed back into the next accumulation, which keeps the DC gain exact and the output free of
+  limit cycles when poles sit close to z = 1, as they do in a scale low-pass.
+
+  Coefficients are designed offline, e.g. scipy.signal.butter(2, fc, fs=sps, output='sos'), and the
+  rows of the second-order sections divided by a0 and multiplied by 2^30. The first reading after
+  reset() is taken as the steady state, so the output does not ramp up from zero.*/
+
+#define BIQUAD_ONE  (1L << 30)
+
+typedef struct
+{
+  int32_t b0, b1, b2;
+  int32_t a1, a2;       //a0 is 1
+} biquad_coefficients_t;
+
+typedef struct
+{
+  biquad_coefficients_t c;
+  int32_t x1, x2;
+  int32_t y1, y2;
+  int32_t error;        //Rounding remainder carried to the next sample
+} biquad_section_t;
+
+class BiquadCascadeBase
+{
+  public:
+    //Set one section and make sure it is in use. The filter state is reset.
+    //Returns false if index is beyond the capacity.
+    bool setSection(uint8_t index, const biquad_coefficients_t &coefficients);
+    bool getSection(uint8_t index, biquad_coefficients_t *coefficients);
+    //Number of sections applied, up to the capacity. 0 passes readings through.
+    void setSectionCount(uint8_t count);
+    uint8_t getSectionCount() {return sectionCount;}
+    uint8_t getCapacity() {return capacity;}
+
+    //Restart from the next reading
+    void reset() {primed = false;}
+
+    //Filter one conversion
+    int32_t filter(int32_t reading);
+
+  protected:
+    BiquadCascadeBase(biquad_section_t *sections, uint8_t capacity);
+
+  private:
+    void prime(int32_t reading);
+
+    biquad_section_t *sections;
+    uint8_t capacity;
+    uint8_t sectionCount = 0;
+    bool primed = false;
+};
+
+//Notch at notch_hz for readings taken at sample_rate, with a -3dB width of width_hz and unity DC
+//gain. A frequency above the Nyquist rate is folded to the frequency it aliases to. Returns false,
+//leaving c unchanged, when that lands so close to DC that the notch would take the weight with it.
+bool biquadNotch(float notch_hz, float sample_rate, float width_hz, biquad_coefficients_t *c);
+
+//Load cascade with one notch per harmonic of mains_hz, skipping harmonics that alias onto DC or onto
+//an earlier notch, until it is full. Returns the number of sections in use.
+uint8_t biquadMainsNotches(BiquadCascadeBase *cascade, float mains_hz, float sample_rate, float width_hz);
+
+//Cascade of up to SECTIONS second-order sections (order 2 * SECTIONS), 36 bytes each
+template <uint8_t SECTIONS>
+class BiquadCascade : public BiquadCascadeBase
+{
+  public:
+    BiquadCascade() : BiquadCascadeBase(sections, SECTIONS) {};
+
+  private:
+    biquad_section_t sections[SECTIONS];
+};
+#endif //BIQUAD_CASCADE_H
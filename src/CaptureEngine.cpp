@@ -0,0 +1,112 @@
+#include <Arduino.h>
+#include "CaptureEngine.h"
+
+CaptureEngineBase::CaptureEngineBase(uint8_t *buffer, uint16_t capacity, uint8_t width)
+  : buffer(buffer, width), capacity(capacity)
+{
+}
+
+void CaptureEngineBase::arm(Capture_Trigger newType, int32_t newLevel, uint16_t newPre, uint16_t newPost,
+                            uint8_t newPin, uint8_t newPinLevel)
+{
+  state = CAPTURE_IDLE;
+
+  //Error check. The trigger sample itself takes one slot.
+  if (newPost > capacity - 1)
+    newPost = capacity - 1;
+  if (newPre > capacity - 1 - newPost)
+    newPre = capacity - 1 - newPost;
+
+  type = newType;
+  level = newLevel;
+  pre = newPre;
+  post = newPost;
+  pin = newPin;
+  pinLevel = newPinLevel;
+
+  head = 0;
+  filled = 0;
+  seen = 0;
+  preCount = 0;
+  postCount = 0;
+  forceTrigger = false;
+  state = CAPTURE_ARMED;
+}
+
+bool CaptureEngineBase::isTriggered(int32_t reading)
+{
+  if (forceTrigger)
+    return true;
+
+  switch (type)
+  {
+    case CAPTURE_TRIGGER_RISING:
+      return (seen > 0) && (previous < level) && (reading >= level);
+    case CAPTURE_TRIGGER_FALLING:
+      return (seen > 0) && (previous > level) && (reading <= level);
+    case CAPTURE_TRIGGER_SLOPE:
+      return (seen > 0) && (abs(reading - previous) >= level);
+    case CAPTURE_TRIGGER_GPIO:
+      return digitalRead(pin) == pinLevel;
+    default:
+      return false;
+  }
+}
+
+void CaptureEngineBase::addSample(int32_t reading, uint32_t timestamp_us)
+{
+  if ((state != CAPTURE_ARMED) && (state != CAPTURE_TRIGGERED))
+    return;
+
+  buffer.set(head, reading);
+  head = (head + 1) % capacity;
+  if (filled < capacity)
+    filled++;
+
+  if (seen == 0)
+    armTime = timestamp_us;
+
+  if (state == CAPTURE_ARMED)
+  {
+    if (isTriggered(reading))
+    {
+      forceTrigger = false;
+      triggerTime = timestamp_us;
+      preCount = min((uint16_t)(filled - 1), pre);
+      state = (post == 0) ? CAPTURE_DONE : CAPTURE_TRIGGERED;
+    }
+  }
+  else if (++postCount >= post)
+  {
+    state = CAPTURE_DONE;
+  }
+
+  previous = reading;
+  lastTime = timestamp_us;
+  seen++;
+}
+
+uint32_t CaptureEngineBase::getSamplePeriod()
+{
+  if (seen < 2)
+    return 0;
+  return (lastTime - armTime) / (seen - 1);
+}
+
+uint16_t CaptureEngineBase::read(uint16_t offset, int32_t *samples, uint16_t count)
+{
+  uint16_t length = getLength();
+  if (offset >= length)
+    return 0;
+
+  if (count > length - offset)
+    count = length - offset;
+
+  //head is one past the newest sample, so the capture starts length samples before it
+  uint16_t start = (head + capacity - length + offset) % capacity;
+  SampleIterator sample(buffer, start, capacity);
+  for (uint16_t i = 0; i < count; i++)
+    samples[i] = sample.next();
+
+  return count;
+}
@@ -0,0 +1,95 @@
+#ifndef CAPTURE_ENGINE_H
+#define CAPTURE_ENGINE_H
+#include <Arduino.h>
+#include "SampleStorage.h"
+
+/* Triggered capture of the raw waveform around an event, like a storage oscilloscope.
+  While armed, every conversion goes into a ring buffer. When the trigger condition is met the
+  engine keeps the `pre` samples before it, collects `post` more, and freezes the buffer until it
+  is re-armed. The capture is read back in chunks with read(), so nothing has to stream.
+
+  Triggers are evaluated on each conversion: a level crossing, a jump between consecutive
+  samples (slope), a GPIO level, or a call to trigger(), which may be made from an interrupt.*/
+
+typedef enum
+{
+  CAPTURE_TRIGGER_MANUAL = 0,  //Only trigger()
+  CAPTURE_TRIGGER_RISING,      //Reading crosses level upwards
+  CAPTURE_TRIGGER_FALLING,     //Reading crosses level downwards
+  CAPTURE_TRIGGER_SLOPE,       //|reading - previous reading| >= level
+  CAPTURE_TRIGGER_GPIO,        //digitalRead(pin) == pinLevel
+} Capture_Trigger;
+
+typedef enum
+{
+  CAPTURE_IDLE = 0,
+  CAPTURE_ARMED,       //Filling the pre-trigger history, waiting for the trigger
+  CAPTURE_TRIGGERED,   //Collecting post-trigger samples
+  CAPTURE_DONE,        //Frozen, ready to read
+} Capture_State;
+
+class CaptureEngineBase
+{
+  public:
+    //pre + 1 + post samples must fit in the buffer; both are reduced to fit otherwise
+    void arm(Capture_Trigger type, int32_t level, uint16_t pre, uint16_t post, uint8_t pin = 0, uint8_t pinLevel = HIGH);
+    void disarm() {state = CAPTURE_IDLE;}
+    //Force the trigger. Safe to call from an interrupt; acted on with the next conversion.
+    void trigger() {forceTrigger = true;}
+
+    //Feed one conversion
+    void addSample(int32_t reading, uint32_t timestamp_us);
+
+    Capture_State getState() {return state;}
+    uint16_t getCapacity() {return capacity;}
+
+    //Valid once the capture is done. The trigger sample is at index getPreTriggerCount().
+    uint16_t getLength() {return (state == CAPTURE_DONE) ? preCount + 1 + postCount : 0;}
+    uint16_t getPreTriggerCount() {return preCount;}
+    uint32_t getTriggerTime() {return triggerTime;}
+    //Mean sample period over the capture, microseconds
+    uint32_t getSamplePeriod();
+
+    //Copy up to count samples starting at offset (oldest first). Returns the number copied.
+    uint16_t read(uint16_t offset, int32_t *samples, uint16_t count);
+
+  protected:
+    CaptureEngineBase(uint8_t *buffer, uint16_t capacity, uint8_t width);
+
+  private:
+    bool isTriggered(int32_t reading);
+
+    SampleBuffer buffer;
+    uint16_t capacity;
+    uint16_t head = 0;        //Next write position
+    uint16_t filled = 0;      //Samples in the buffer since arming, up to capacity
+
+    Capture_Trigger type = CAPTURE_TRIGGER_MANUAL;
+    int32_t level = 0;
+    uint8_t pin = 0;
+    uint8_t pinLevel = HIGH;
+    uint16_t pre = 0;
+    uint16_t post = 0;
+    volatile bool forceTrigger = false;
+
+    Capture_State state = CAPTURE_IDLE;
+    int32_t previous = 0;
+    uint16_t preCount = 0;
+    uint16_t postCount = 0;
+    uint32_t seen = 0;        //Conversions since arming
+    uint32_t armTime = 0;     //Timestamp of the first conversion after arming
+    uint32_t triggerTime = 0;
+    uint32_t lastTime = 0;
+};
+
+//Capture engine holding up to MAX_SAMPLES conversions, 4 bytes each, or 3 with Packed24Storage
+template <uint16_t MAX_SAMPLES, typename Storage = Int32Storage>
+class CaptureEngine : public CaptureEngineBase
+{
+  public:
+    CaptureEngine() : CaptureEngineBase(samples, MAX_SAMPLES, Storage::BYTES) {};
+
+  private:
+    uint8_t samples[MAX_SAMPLES * Storage::BYTES];
+};
+#endif //CAPTURE_ENGINE_H
@@ -0,0 +1,58 @@
+#include <Arduino.h>
+#include "CreepCompensator.h"
+
+void CreepCompensator::setModel(float coefficient, float time_constant_s)
+{
+  this->coefficient = coefficient;
+  if (time_constant_s > 0)
+    timeConstant = time_constant_s;
+  lagInterval = 0;
+}
+
+void CreepCompensator::reset()
+{
+  started = false;
+  heldLoad = 0;
+  lag = 0;
+  eventCount = 0;
+  lastEventTime = 0;
+  lastTime = 0;
+  lagInterval = 0;
+  lagFactor = 0;
+}
+
+int32_t CreepCompensator::compensate(int32_t reading, int32_t zero_offset, uint32_t timestamp_us)
+{
+  int32_t load = reading - zero_offset - lround(getCreep());
+
+  if (!started)
+  {
+    started = true;
+    heldLoad = load;
+    lastEventTime = timestamp_us;
+  }
+  else
+  {
+    if (abs(load - heldLoad) > threshold)
+    {
+      lag += load - heldLoad;
+      heldLoad = load;
+      eventCount++;
+      lastEventTime = timestamp_us;
+    }
+
+    //Rounded to 64us so micros() jitter does not recompute the factor every sample
+    uint32_t interval = (timestamp_us - lastTime + 32) & ~(uint32_t)63;
+    if (interval != lagInterval)
+    {
+      lagInterval = interval;
+      float x = (interval * 1e-6f) / timeConstant;
+      //1 - exp(-x) loses most of its digits in float for the small x of a long time constant
+      lagFactor = (x < 0.01f) ? x * (1 - x / 2) : 1 - exp(-x);
+    }
+    lag -= lagFactor * lag;
+  }
+  lastTime = timestamp_us;
+
+  return reading - lround(getCreep());
+}
@@ -0,0 +1,66 @@
+#ifndef CREEP_COMPENSATOR_H
+#define CREEP_COMPENSATOR_H
+#include <Arduino.h>
+
+/* Correction of load cell creep under long static loads.
+  After a load change a cell's output keeps moving by a small fraction of the load, approaching
+  coefficient * load with a time constant of minutes to hours, and recovers the same way when the
+  load is removed. That is a first-order lag on the load: the response b follows the held load L with
+  db/dt = (L - b) / timeConstant, and the creep is coefficient * b.
+
+  The held load only changes on load change events, when the creep-corrected reading moves more than
+  the threshold away from it, so noise and slow creep itself do not feed the model. The lag is
+  advanced once per conversion by its timestamp; the sample interval is rounded to 64us, so the
+  factor 1 - exp(-dt / timeConstant) is recomputed when the interval moves to another step, not on
+  every bit of micros() jitter. The model keeps L - b, which decays geometrically, so the tiny
+  per-sample steps of an hours-long time constant are not lost to float rounding.
+
+  The model starts in equilibrium with the load of the first reading, as after a restart under a
+  load that has been there for a long time. Loads are measured from the zero offset, so tare with
+  the structure empty; QwiicScale restarts the model at each tare. The coefficient and time
+  constant can be fitted to a recorded trace with qwiic_replay --fit-creep (extras/replay).*/
+
+class CreepCompensator
+{
+  public:
+    CreepCompensator() {reset();};
+
+    //Creep at equilibrium as a fraction of the load, and its time constant. coefficient 0 disables.
+    void setModel(float coefficient, float time_constant_s);
+    float getCoefficient() {return coefficient;}
+    float getTimeConstant() {return timeConstant;}
+    //Change of the creep-corrected load, in counts, that counts as a load change event
+    void setThreshold(int32_t counts) {threshold = max(counts, (int32_t)0);}
+    int32_t getThreshold() {return threshold;}
+
+    //Start over with no load and no creep
+    void reset();
+
+    //Channel 1 reading with the creep removed. Advances the model to timestamp_us.
+    int32_t compensate(int32_t reading, int32_t zero_offset, uint32_t timestamp_us);
+
+    //Creep being removed, counts
+    float getCreep() {return coefficient * (heldLoad - lag);}
+    //Lagged load the creep is proportional to, counts from zero
+    float getResponse() {return heldLoad - lag;}
+    int32_t getHeldLoad() {return heldLoad;}
+    uint32_t getEventCount() {return eventCount;}
+    uint32_t getLastEventTime() {return lastEventTime;}
+
+  private:
+    float coefficient = 0;
+    float timeConstant = 3600;
+    int32_t threshold = 0;
+
+    bool started;
+    int32_t heldLoad;
+    float lag;              //heldLoad - response, kept instead of the response so it decays to 0 exactly
+    uint32_t eventCount;
+    uint32_t lastEventTime;
+    uint32_t lastTime;
+
+    //1 - exp(-interval / timeConstant) for the last sample interval, rounded to 64us
+    uint32_t lagInterval;
+    float lagFactor;
+};
+#endif //CREEP_COMPENSATOR_H
@@ -0,0 +1,108 @@
+#include <Arduino.h>
+#include "DosingController.h"
+
+void DosingController::begin()
+{
+  digitalWrite(pin, !activeLevel);
+  pinMode(pin, OUTPUT);
+  state = DOSE_IDLE;
+}
+
+void DosingController::start(float target)
+{
+  result.target = target;
+  result.cutoffWeight = 0;
+  result.cutoffRate = 0;
+  result.finalWeight = 0;
+  result.inFlightTime = inFlightTime;
+  result.fillTime_ms = 0;
+  settleTotal = 0;
+  settleCount = 0;
+  startTime_us = micros();
+  lastSample_us = 0;
+
+  state = DOSE_FILLING;
+  digitalWrite(pin, activeLevel);
+}
+
+void DosingController::closeValve()
+{
+  digitalWrite(pin, !activeLevel);
+}
+
+void DosingController::abort()
+{
+  closeValve();
+  if ((state == DOSE_FILLING) || (state == DOSE_SETTLING))
+    state = DOSE_ABORTED;
+}
+
+void DosingController::service(uint32_t now_us)
+{
+  if (state != DOSE_FILLING)
+    return;
+
+  uint32_t last_us = lastSample_us ? lastSample_us : startTime_us;
+  bool timed_out = fillTimeout_ms && ((now_us - startTime_us) / 1000 > fillTimeout_ms);
+  bool stalled = stallTimeout_ms && ((now_us - last_us) / 1000 > stallTimeout_ms);
+  if (timed_out || stalled)
+  {
+    closeValve();
+    result.fillTime_ms = (now_us - startTime_us) / 1000;
+    state = DOSE_ABORTED;
+  }
+}
+
+void DosingController::addSample(float weight, float rate, uint32_t timestamp_us)
+{
+  switch (state)
+  {
+    case DOSE_FILLING:
+    {
+      //The valve can only be closed on a conversion, on average half a period after the ideal
+      //moment. Include that half period in the lookahead.
+      float period = lastSample_us ? (timestamp_us - lastSample_us) * 1e-6f : 0;
+      lastSample_us = timestamp_us;
+      float flow = max(rate, 0.0f);
+
+      if (weight + flow * (inFlightTime + period / 2) >= result.target)
+      {
+        closeValve();
+        cutoffTime_us = timestamp_us;
+        result.cutoffWeight = weight;
+        result.cutoffRate = flow;
+        result.fillTime_ms = (timestamp_us - startTime_us) / 1000;
+        state = DOSE_SETTLING;
+      }
+      else
+      {
+        service(timestamp_us);
+      }
+      break;
+    }
+
+    case DOSE_SETTLING:
+      if ((timestamp_us - cutoffTime_us) / 1000 < settleTime_ms)
+        break;
+
+      settleTotal += weight;
+      if (++settleCount < settleSamples)
+        break;
+
+      result.finalWeight = settleTotal / settleCount;
+
+      //Learn from fills that were cut while material was flowing
+      if (result.cutoffRate > 0)
+      {
+        float observed = (result.finalWeight - result.cutoffWeight) / result.cutoffRate;
+        inFlightTime += learningRate * (observed - inFlightTime);
+        if (inFlightTime < 0)
+          inFlightTime = 0;
+      }
+      state = DOSE_DONE;
+      break;
+
+    default:
+      break;
+  }
+}
@@ -0,0 +1,90 @@
+#ifndef DOSING_CONTROLLER_H
+#define DOSING_CONTROLLER_H
+#include <Arduino.h>
+
+/* Fill to a target weight with the valve driven from a GPIO, so the cutoff does not wait on a host.
+  Material that is still falling when the valve closes lands afterwards and causes overshoot.
+  The overshoot is modelled as flow rate times an in-flight time, so the valve is closed once
+  weight + rate * inFlightTime reaches the target. After each fill the scale settles, the
+  overshoot actually seen is divided by the flow rate at cutoff, and the in-flight time is moved
+  towards that value by the learning rate.
+
+  Weights and rates are in calibrated units; QwiicScale feeds every conversion together with the
+  flow rate from its FlowRateEstimator.*/
+
+typedef enum
+{
+  DOSE_IDLE = 0,
+  DOSE_FILLING,      //Valve open
+  DOSE_SETTLING,     //Valve closed, waiting for in-flight material to land
+  DOSE_DONE,         //Result ready
+  DOSE_ABORTED,      //Stopped by abort() or the fill timeout
+} Dose_State;
+
+typedef struct
+{
+  float target;
+  float cutoffWeight;    //Weight when the valve was closed
+  float cutoffRate;      //Flow rate when the valve was closed
+  float finalWeight;     //Mean weight after settling
+  float inFlightTime;    //In-flight time used for this fill, seconds
+  uint32_t fillTime_ms;  //Valve open time
+} dose_result_t;
+
+class DosingController
+{
+  public:
+    DosingController(uint8_t pin, uint8_t activeLevel = HIGH) : pin(pin), activeLevel(activeLevel) {};
+
+    //Configure the valve pin and close the valve
+    void begin();
+
+    //Initial or stored in-flight time, seconds. Learned values can be read back and kept in NVM.
+    void setInFlightTime(float seconds) {inFlightTime = max(seconds, 0.0f);}
+    float getInFlightTime() {return inFlightTime;}
+    //Fraction of each fill's observed in-flight time taken into the model. 0 disables learning.
+    void setLearningRate(float rate) {learningRate = constrain(rate, 0.0f, 1.0f);}
+
+    //Time to wait after cutoff before averaging settleSamples conversions for the final weight
+    void setSettling(uint16_t settle_ms, uint8_t settle_samples = 8) {settleTime_ms = settle_ms; settleSamples = max(settle_samples, (uint8_t)1);}
+    //Valve is closed and the fill aborted if the target is not reached within timeout_ms. 0 disables.
+    void setTimeout(uint32_t timeout_ms) {fillTimeout_ms = timeout_ms;}
+    //Valve is closed and the fill aborted if no conversion arrives for stall_ms while filling. 0 disables.
+    void setStallTimeout(uint16_t stall_ms) {stallTimeout_ms = stall_ms;}
+
+    //Open the valve and fill to target
+    void start(float target);
+    //Close the valve now
+    void abort();
+
+    //Feed one conversion. Closes the valve at the predicted cutoff.
+    void addSample(float weight, float rate, uint32_t timestamp_us);
+    //Enforce the fill and stall timeouts without a conversion. Call often, e.g. on every poll of
+    //the ADC, so the valve is closed even when conversions stop arriving.
+    void service(uint32_t now_us);
+
+    Dose_State getState() {return state;}
+    dose_result_t getResult() {return result;}
+
+  private:
+    void closeValve();
+
+    uint8_t pin;
+    uint8_t activeLevel;
+
+    float inFlightTime = 0;
+    float learningRate = 0.25f;
+    uint16_t settleTime_ms = 500;
+    uint8_t settleSamples = 8;
+    uint32_t fillTimeout_ms = 0;
+    uint16_t stallTimeout_ms = 500;
+
+    Dose_State state = DOSE_IDLE;
+    dose_result_t result = {};
+    uint32_t startTime_us = 0;
+    uint32_t cutoffTime_us = 0;
+    uint32_t lastSample_us = 0;
+    float settleTotal = 0;
+    uint8_t settleCount = 0;
+};
+#endif //DOSING_CONTROLLER_H
@@ -0,0 +1,160 @@
+#include <Arduino.h>
+#include "DynamicWeigher.h"
+
+DynamicWeigherBase::DynamicWeigherBase(uint8_t *buffer, uint16_t capacity, uint8_t width)
+  : buffer(buffer, width), capacity(capacity)
+{
+}
+
+void DynamicWeigherBase::configure(int32_t newBaseline, int32_t newEntryThreshold, int32_t newExitThreshold,
+                                   uint16_t newWindowSize, uint8_t newDebounce)
+{
+  baseline = newBaseline;
+
+  //Work with positive thresholds and flip the readings instead
+  direction = (newEntryThreshold < 0) ? -1 : 1;
+  entryThreshold = direction * newEntryThreshold;
+  exitThreshold = direction * newExitThreshold;
+  if (exitThreshold > entryThreshold)
+    exitThreshold = entryThreshold;
+
+  windowSize = constrain(newWindowSize, 1, capacity);
+  debounce = max(newDebounce, (uint8_t)1);
+  reset();
+}
+
+void DynamicWeigherBase::reset()
+{
+  state = DYNAMIC_IDLE;
+  count = 0;
+  run = 0;
+  resultReady = false;
+}
+
+bool DynamicWeigherBase::addSample(int32_t reading, uint32_t timestamp_us)
+{
+  int32_t level = direction * (reading - baseline);
+
+  switch (state)
+  {
+    case DYNAMIC_IDLE:
+      if (level < entryThreshold)
+        return false;
+
+      current.entryTime = timestamp_us;
+      current.overflow = false;
+      count = 0;
+      run = 0;
+      state = DYNAMIC_ENTERING;
+      //fall through
+
+    case DYNAMIC_ENTERING:
+      if (level < entryThreshold)
+      {
+        state = DYNAMIC_IDLE;
+        return false;
+      }
+
+      //Keep the debounce samples, they belong to the item
+      if (count < capacity)
+        buffer.set(count++, reading);
+      if (++run >= debounce)
+      {
+        state = DYNAMIC_ON_PLATFORM;
+        run = 0;
+      }
+      return false;
+
+    case DYNAMIC_ON_PLATFORM:
+      if (count < capacity)
+        buffer.set(count++, reading);
+      else
+        current.overflow = true;
+
+      if (level >= exitThreshold)
+      {
+        run = 0;
+        return false;
+      }
+
+      if (run == 0)
+        current.exitTime = timestamp_us;
+      if (++run < debounce)
+        return false;
+
+      //The samples below the exit threshold are the item leaving, not the item
+      if (!current.overflow)
+        count -= run;
+      finish();
+      return true;
+  }
+
+  return false;
+}
+
+//Slide a window over the item samples and keep the one with the lowest variance.
+//Sums are taken relative to the first sample to keep the squares within 64 bits.
+void DynamicWeigherBase::finish()
+{
+  uint16_t window = min(windowSize, count);
+  current.itemSamples = count;
+  current.windowLength = window;
+  current.windowStart = 0;
+  current.reading = baseline;
+  current.noise = 0;
+  state = DYNAMIC_IDLE;
+  run = 0;
+
+  if (window > 0)
+  {
+    int32_t ref = buffer.get(0);
+    int64_t sum = 0;
+    int64_t sumSquares = 0;
+    SampleIterator leaving(buffer, 0);
+    SampleIterator entering(buffer, 0);
+    for (uint16_t i = 0; i < window; i++)
+    {
+      int64_t d = entering.next() - ref;
+      sum += d;
+      sumSquares += d * d;
+    }
+
+    //n * sum(d^2) - sum(d)^2 is n^2 times the variance, exact in integers
+    int64_t bestScore = window * sumSquares - sum * sum;
+    int64_t bestSum = sum;
+
+    for (uint16_t start = 1; start + window <= count; start++)
+    {
+      int64_t out = leaving.next() - ref;
+      int64_t in = entering.next() - ref;
+      sum += in - out;
+      sumSquares += in * in - out * out;
+
+      int64_t score = window * sumSquares - sum * sum;
+      if (score < bestScore)
+      {
+        bestScore = score;
+        bestSum = sum;
+        current.windowStart = start;
+      }
+    }
+
+    current.reading = ref + (int32_t)(bestSum / window);
+    current.noise = sqrt((float)bestScore) / window;
+  }
+
+  if (resultReady)
+    missedResults++;
+  result = current;
+  resultReady = true;
+}
+
+bool DynamicWeigherBase::readResult(dynamic_weight_raw_t *raw)
+{
+  if (!resultReady)
+    return false;
+
+  *raw = result;
+  resultReady = false;
+  return true;
+}
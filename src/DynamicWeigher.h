@@ -0,0 +1,94 @@
+#ifndef DYNAMIC_WEIGHER_H
+#define DYNAMIC_WEIGHER_H
+#include <Arduino.h>
+#include "SampleStorage.h"
+#include "NAU7802.h"
+
+/* In-motion weighing for checkweighers where an item is only on the platform for a short time.
+  Works on every conversion (see QwiicScale::update()). An item enters when the reading rises past
+  the entry threshold and leaves when it falls back below the exit threshold, each for
+  `debounce` consecutive samples. The samples in between are kept and, once the item has left,
+  the window of `windowSize` samples with the lowest variance is averaged. Its standard
+  deviation is reported as a quality metric.
+
+  Thresholds are in raw counts relative to the baseline (normally the zero offset). A negative
+  threshold is used for load cells whose reading falls with load. QwiicScale converts from
+  weight units, see QwiicScale::beginDynamicWeighing().*/
+
+typedef enum
+{
+  DYNAMIC_IDLE = 0,      //Platform empty, waiting for an item
+  DYNAMIC_ENTERING,      //Above the entry threshold, debouncing
+  DYNAMIC_ON_PLATFORM,   //Item detected, collecting samples
+} Dynamic_Weigher_State;
+
+typedef struct
+{
+  int32_t reading;          //Mean raw reading over the flattest window
+  float noise;              //Standard deviation over that window, raw counts
+  uint16_t windowStart;     //First sample of the window, counted from item entry
+  uint16_t windowLength;    //Samples in the window (shorter than windowSize for short items)
+  uint16_t itemSamples;     //Samples between entry and exit
+  uint32_t entryTime;       //micros() of the first sample above the entry threshold
+  uint32_t exitTime;        //micros() of the first sample below the exit threshold
+  bool overflow;            //Item stayed longer than the buffer, only the start was kept
+} dynamic_weight_raw_t;
+
+class DynamicWeigherBase
+{
+  public:
+    void configure(int32_t baseline, int32_t entryThreshold, int32_t exitThreshold,
+                   uint16_t windowSize, uint8_t debounce = 2);
+    void setBaseline(int32_t newBaseline) {baseline = newBaseline;}
+
+    //Feed one conversion. Returns true when an item has left and a result is ready.
+    bool addSample(int32_t reading, uint32_t timestamp_us);
+
+    Dynamic_Weigher_State getState() {return state;}
+    bool isResultReady() {return resultReady;}
+
+    //Copy the last result. Returns false if no new result is ready.
+    bool readResult(dynamic_weight_raw_t *result);
+
+    //Items whose result was replaced by the next item before it was read
+    uint16_t getMissedResults() {return missedResults;}
+
+    void reset();
+
+  protected:
+    DynamicWeigherBase(uint8_t *buffer, uint16_t capacity, uint8_t width);
+
+  private:
+    void finish();
+
+    SampleBuffer buffer;
+    uint16_t capacity;
+    uint16_t count = 0;
+
+    int32_t baseline = 0;
+    int32_t entryThreshold = 0;
+    int32_t exitThreshold = 0;
+    int8_t direction = 1;
+    uint16_t windowSize = 1;
+    uint8_t debounce = 1;
+    uint8_t run = 0;        //Consecutive samples past the threshold being watched
+
+    Dynamic_Weigher_State state = DYNAMIC_IDLE;
+    dynamic_weight_raw_t current;   //Item on the platform
+    dynamic_weight_raw_t result;    //Last finished item
+    bool resultReady = false;
+    uint16_t missedResults = 0;
+};
+
+//Weigher that can hold MAX_SAMPLES conversions per item, e.g. 128 for 300ms at 320 SPS (512 bytes,
+//or 384 with Packed24Storage).
+template <uint16_t MAX_SAMPLES, typename Storage = Int32Storage>
+class DynamicWeigher : public DynamicWeigherBase
+{
+  public:
+    DynamicWeigher() : DynamicWeigherBase(samples, MAX_SAMPLES, Storage::BYTES) {};
+
+  private:
+    uint8_t samples[MAX_SAMPLES * Storage::BYTES];
+};
+#endif //DYNAMIC_WEIGHER_H
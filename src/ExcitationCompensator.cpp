@@ -0,0 +1,55 @@
+#include <Arduino.h>
+#include "ExcitationCompensator.h"
+
+void ExcitationCompensator::reset()
+{
+  referenceCount = 0;
+  smoothed = 0;
+  gain = 1;
+  gainSlope = 0;
+  gainTime = 0;
+  interval = 0;
+}
+
+void ExcitationCompensator::addReference(int32_t reading, uint32_t timestamp_us)
+{
+  if (reading <= 0)
+    return;
+
+  if (!nominalSet)
+    setNominal(reading);
+
+  if (referenceCount == 0)
+    smoothed = reading;
+  else
+    smoothed += (reading - smoothed) / (1 << smoothingShift);
+
+  float newGain = nominal / smoothed;
+  if (referenceCount > 0)
+  {
+    interval = timestamp_us - gainTime;
+    gainSlope = interval ? (newGain - gain) / interval : 0;
+  }
+  gain = newGain;
+  gainTime = timestamp_us;
+  if (referenceCount < 2)
+    referenceCount++;
+}
+
+float ExcitationCompensator::getGain(uint32_t timestamp_us)
+{
+  if (referenceCount < 2)
+    return gain;
+
+  uint32_t elapsed = timestamp_us - gainTime;
+  if (elapsed > interval)
+    elapsed = interval;
+  return gain + gainSlope * elapsed;
+}
+
+int32_t ExcitationCompensator::compensate(int32_t reading, uint32_t timestamp_us)
+{
+  if (referenceCount == 0)
+    return reading;
+  return lround(reading * getGain(timestamp_us));
+}
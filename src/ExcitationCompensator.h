@@ -0,0 +1,55 @@
+#ifndef EXCITATION_COMPENSATOR_H
+#define EXCITATION_COMPENSATOR_H
+#include <Arduino.h>
+
+/* Ratiometric correction of channel 1 for drift of the bridge excitation.
+  A load cell's output is proportional to its excitation, so supply drift shows up as span and
+  zero drift in the raw counts. With a divider or an unloaded reference bridge on channel 2, read
+  every few conversions by QwiicScale::beginInterleave(), each channel 1 reading is scaled by
+  nominal / reference, which holds the readings where they were when the reference read nominal.
+
+  The gain nominal / reference is worked out once per reference sample, together with its rate of
+  change since the previous one. Each channel 1 reading then only costs a multiply-add to
+  interpolate the gain to its timestamp and a multiply to apply it. The gain is extrapolated at
+  most one reference interval beyond the latest sample and held after that.
+
+  The nominal must stay the same for as long as a calibration is in use, so store it with the
+  calibration; by default it is taken from the first reference sample. The reference reading must
+  be positive and well inside the ADC range at the gain channel 1 uses.*/
+
+class ExcitationCompensator
+{
+  public:
+    ExcitationCompensator() {reset();};
+
+    //Reference reading the correction normalises to
+    void setNominal(int32_t reference) {nominal = reference; nominalSet = (reference > 0);}
+    int32_t getNominal() {return nominal;}
+    //Exponential smoothing of the reference samples over 2^shift samples, 0 for none
+    void setSmoothing(uint8_t shift) {smoothingShift = min(shift, (uint8_t)8);}
+
+    //Forget the reference history, keeping the nominal
+    void reset();
+
+    //New reference (channel 2) sample. Samples that are not positive are ignored.
+    void addReference(int32_t reading, uint32_t timestamp_us);
+    //Channel 1 reading scaled to the nominal excitation
+    int32_t compensate(int32_t reading, uint32_t timestamp_us);
+
+    //nominal / reference at timestamp_us, 1 until the first reference sample
+    float getGain(uint32_t timestamp_us);
+    bool isReady() {return referenceCount > 0;}
+
+  private:
+    int32_t nominal = 0;
+    bool nominalSet = false;
+    uint8_t smoothingShift = 0;
+
+    uint8_t referenceCount;    //Reference samples seen, saturating at 2
+    float smoothed;            //Smoothed reference
+    float gain;                //At gainTime
+    float gainSlope;           //Per microsecond
+    uint32_t gainTime;
+    uint32_t interval;         //Between the last two reference samples
+};
+#endif //EXCITATION_COMPENSATOR_H
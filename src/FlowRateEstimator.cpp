@@ -0,0 +1,110 @@
+#include <Arduino.h>
+#include "FlowRateEstimator.h"
+
+//Relative times are rebased before they pass 2^24us (~16.7s) so that the sums of squares over
+//a window of up to 256 samples stay within 64 bits.
+#define FLOW_RATE_REBASE_US  (1UL << 24)
+
+FlowRateEstimatorBase::FlowRateEstimatorBase(uint32_t *times, uint8_t *readings, uint16_t capacity, uint8_t width)
+  : times(times), readings(readings, width), capacity(capacity)
+{
+}
+
+void FlowRateEstimatorBase::reset()
+{
+  head = 0;
+  count = 0;
+  sumT = 0;
+  sumW = 0;
+  sumTT = 0;
+  sumTW = 0;
+  sumWW = 0;
+}
+
+void FlowRateEstimatorBase::addSample(int32_t reading, uint32_t timestamp_us)
+{
+  if (count == 0)
+    timeBase = timestamp_us;
+  else if ((timestamp_us - timeBase) >= FLOW_RATE_REBASE_US)
+    rebase();
+
+  //A window that spans more than the rebase limit cannot be fitted exactly, start over
+  if ((timestamp_us - timeBase) >= FLOW_RATE_REBASE_US)
+  {
+    reset();
+    timeBase = timestamp_us;
+  }
+
+  if (count == capacity)
+  {
+    int64_t t = times[head];
+    int64_t w = readings.get(head);
+    sumT -= t;
+    sumW -= w;
+    sumTT -= t * t;
+    sumTW -= t * w;
+    sumWW -= w * w;
+    head = (head + 1) % capacity;
+    count--;
+  }
+
+  uint32_t relative = timestamp_us - timeBase;
+  uint16_t tail = (head + count) % capacity;
+  times[tail] = relative;
+  readings.set(tail, reading);
+  count++;
+
+  //As stored, so that the value removed later is the one added here, also when it was clamped
+  int64_t t = relative;
+  int64_t w = readings.get(tail);
+  sumT += t;
+  sumW += w;
+  sumTT += t * t;
+  sumTW += t * w;
+  sumWW += w * w;
+}
+
+//Move the time origin to the oldest sample in the window
+void FlowRateEstimatorBase::rebase()
+{
+  int64_t delta = times[head];
+  int64_t n = count;
+
+  //sum((t - d)^2) = sum(t^2) - 2d sum(t) + n d^2, and similarly for the cross term
+  sumTT -= 2 * delta * sumT - n * delta * delta;
+  sumTW -= delta * sumW;
+  sumT -= n * delta;
+
+  for (uint16_t i = 0; i < count; i++)
+    times[(head + i) % capacity] -= delta;
+  timeBase += delta;
+}
+
+bool FlowRateEstimatorBase::getRate(float *rate, float *uncertainty)
+{
+  if (count < 3)
+    return false;
+
+  //Centred sums, e.g. sxx = sum(t^2) - sum(t)^2 / n. With m = sum(t) / n truncated and the remainder
+  //r = sum(t) - m n this is (sum(t^2) - m sum(t)) - r sum(t) / n. The first term is exact in 64 bits
+  //and the correction is small enough for float.
+  int64_t meanT = sumT / count;
+  int64_t meanW = sumW / count;
+  float remT = (float)(sumT - meanT * count);
+  float remW = (float)(sumW - meanW * count);
+  float sxx = (float)(sumTT - meanT * sumT) - remT * ((float)sumT / count);
+  float sxw = (float)(sumTW - meanT * sumW) - remT * ((float)sumW / count);
+  float sww = (float)(sumWW - meanW * sumW) - remW * ((float)sumW / count);
+
+  if (sxx <= 0)
+    return false;
+
+  float slope = sxw / sxx;                    //counts per microsecond
+  float residual = (sww - slope * sxw) / (count - 2);
+  if (residual < 0)
+    residual = 0;
+
+  *rate = slope * 1e6f;
+  *uncertainty = sqrt(residual / sxx) * 1e6f;
+  return true;
+}
@@ -0,0 +1,60 @@
+#ifndef FLOW_RATE_ESTIMATOR_H
+#define FLOW_RATE_ESTIMATOR_H
+#include <Arduino.h>
+#include "SampleStorage.h"
+
+/* Online flow rate (dW/dt) for dispensing and loss-in-weight feeders.
+  Fits a least-squares line through the last N timestamped conversions. The sums of the fit are
+  updated as each sample enters and the oldest leaves, so the cost per sample is constant and
+  independent of N. The sums are kept as 64-bit integers of raw counts and microseconds, which
+  keeps them exact however long the estimator runs.
+
+  Rates are in raw counts per second; QwiicScale::getFlowRate() converts to weight units.*/
+
+class FlowRateEstimatorBase
+{
+  public:
+    //Feed one conversion with its micros() timestamp
+    void addSample(int32_t reading, uint32_t timestamp_us);
+
+    //Slope of the fit and its standard error, in counts per second.
+    //Returns false until at least three samples are in the window.
+    bool getRate(float *rate, float *uncertainty);
+
+    uint16_t getCount() {return count;}
+    uint16_t getCapacity() {return capacity;}
+    void reset();
+
+  protected:
+    FlowRateEstimatorBase(uint32_t *times, uint8_t *readings, uint16_t capacity, uint8_t width);
+
+  private:
+    void rebase();
+
+    uint32_t *times;        //Relative to timeBase
+    SampleBuffer readings;
+    uint16_t capacity;
+    uint16_t head = 0;      //Oldest sample
+    uint16_t count = 0;
+
+    uint32_t timeBase = 0;
+    int64_t sumT = 0;
+    int64_t sumW = 0;
+    int64_t sumTT = 0;
+    int64_t sumTW = 0;
+    int64_t sumWW = 0;
+};
+
+//Estimator over the last WINDOW conversions, 8 bytes each or 7 with Packed24Storage.
+//At 80 SPS, 16 samples is a 200ms window.
+template <uint16_t WINDOW, typename Storage = Int32Storage>
+class FlowRateEstimator : public FlowRateEstimatorBase
+{
+  public:
+    FlowRateEstimator() : FlowRateEstimatorBase(times, readings, WINDOW, Storage::BYTES) {};
+
+  private:
+    uint32_t times[WINDOW];
+    uint8_t readings[WINDOW * Storage::BYTES];
+};
+#endif //FLOW_RATE_ESTIMATOR_H
@@ -0,0 +1,53 @@
+#ifndef MEMORY_STREAM_H
+#define MEMORY_STREAM_H
+#include <Arduino.h>
+
+/* Stream over two caller-supplied buffers. Reads come from the input buffer and writes go to the
+  output buffer. Used to run ScaleRpcServer without a serial port, e.g. for benchmarks of the
+  protocol path or for tests on a host.*/
+class MemoryStream : public Stream
+{
+  public:
+    MemoryStream(uint8_t *output, size_t outputSize)
+      : output(output), outputSize(outputSize) {};
+
+    //Replace the input with new data. The buffer must stay valid until it has been read.
+    void setInput(const uint8_t *data, size_t length) {input = data; inputLength = length; inputPos = 0;}
+    void setInput(const char *data) {setInput((const uint8_t *)data, strlen(data));}
+
+    //Output written so far. clearOutput() makes room for more.
+    const uint8_t *getOutput() {return output;}
+    size_t getOutputLength() {return outputLength;}
+    void clearOutput() {outputLength = 0;}
+
+    int available() {return inputLength - inputPos;}
+    int read() {return (inputPos < inputLength) ? input[inputPos++] : -1;}
+    int peek() {return (inputPos < inputLength) ? input[inputPos] : -1;}
+    int availableForWrite() {return outputSize - outputLength;}
+
+    size_t write(uint8_t value)
+    {
+      if (outputLength >= outputSize)
+        return 0;
+      output[outputLength++] = value;
+      return 1;
+    }
+
+    size_t write(const uint8_t *buffer, size_t size)
+    {
+      size_t count = min(size, outputSize - outputLength);
+      memcpy(output + outputLength, buffer, count);
+      outputLength += count;
+      return count;
+    }
+
+  private:
+    const uint8_t *input = NULL;
+    size_t inputLength = 0;
+    size_t inputPos = 0;
+
+    uint8_t *output;
+    size_t outputSize;
+    size_t outputLength = 0;
+};
+#endif //MEMORY_STREAM_H
@@ -42,54 +42,75 @@ error_code_t NAU7802::begin(TwoWire &wirePort, bool initialize)
   {
     //There are rare times when the sensor is occupied and doesn't ack. A 2nd try resolves this.
     if (isConnected() == false)
+    {
+      connectionLost();
       return (NAU7802_I2C_ERROR);
+    }
   }
 
   error_code_t err = NAU7802_OK;
 
   if (initialize)
-  {
-    //Reset all registers
-    if (err = reset()) {
-      return err;
-    }
-    //Power on analog and digital sections of the scale
-    if (err = powerUp()) {
-      return err;
-    }
+    err = initializeDevice();
 
-    //Set LDO to 3.3V
-    if (err = setLDO(NAU7802_LDO_3V3)) {
-      return err;
-    }
+  //Whatever the configuration now is, it is the one to keep
+  if (!err)
+    err = syncShadow();
 
-  //Set gain to 128
-  if (err = setGain(NAU7802_GAIN_128)) {
+  //serviceConnection() takes over from a failed start
+  if (err)
+  {
+    connectionLost();
     return err;
   }
+  connectionState = NAU7802_READY;
+  return (err);
+}
+
+error_code_t NAU7802::initializeDevice()
+{
+  error_code_t err;
 
-  //Set samples per second to 80 hz
-  if (err = setSampleRate(NAU7802_SPS_80)) {
+  //Reset all registers
+  if ((err = reset())) {
     return err;
   }
-
-  //Turn off CLK_CHP. From 9.1 power on sequencing.
-  if (err = setRegister(NAU7802_ADC, 0x30)) {
+  //Power on analog and digital sections of the scale
+  if ((err = powerUp())) {
     return err;
   }
-
-  //Enable 330pF decoupling cap on chan 2. From 9.14 application circuit note.
-  if (err = setBit(NAU7802_PGA_PWR_PGA_CAP_EN, NAU7802_PGA_PWR)) {
+  if ((err = configure())) {
     return err;
   }
 
   //Re-cal analog front end when we change gain, sample rate, or channel
-  if (err = calibrateAFE()) {
+  return calibrateAFE();
+}
+
+error_code_t NAU7802::configure()
+{
+  error_code_t err;
+
+  //Enable the LDO at 3.3V, set gain to 128 and samples per second to 80 hz.
+  //One burst read and one burst write over PU_CTRL, CTRL1 and CTRL2.
+  uint8_t config[3] = {0, 0, 0};
+  if ((err = getRegisters(NAU7802_PU_CTRL, config, sizeof(config)))) {
+    return err;
+  }
+  config[0] |= (1 << NAU7802_PU_CTRL_AVDDS);
+  config[1] = (config[1] & 0b11000000) | (NAU7802_LDO_3V3 << 3) | NAU7802_GAIN_128;
+  config[2] = (config[2] & 0b10001111) | (NAU7802_SPS_80 << 4);
+  if ((err = setRegisters(NAU7802_PU_CTRL, config, sizeof(config)))) {
     return err;
   }
-}
 
-return (err);
+  //Turn off CLK_CHP. From 9.1 power on sequencing.
+  if ((err = setRegister(NAU7802_ADC, 0x30))) {
+    return err;
+  }
+
+  //Enable 330pF decoupling cap on chan 2. From 9.14 application circuit note.
+  return setBit(NAU7802_PGA_PWR_PGA_CAP_EN, NAU7802_PGA_PWR);
 }
 
 //Returns true if device is present
@@ -102,10 +123,162 @@ bool NAU7802::isConnected()
   return true;
 }
 
+//One step of reconnection per call, see the header. Each step is a few I2C transactions at most.
+error_code_t NAU7802::serviceConnection()
+{
+  error_code_t err = NAU7802_OK;
+  uint8_t value = 0;
+
+  switch (connectionState)
+  {
+    case NAU7802_READY:
+      return NAU7802_OK;
+
+    case NAU7802_ABSENT:
+      if ((millis() - stateTime) < probeInterval)
+        return NAU7802_NOT_CONNECTED_ERROR;
+      if (!isConnected())
+      {
+        connectionLost();
+        return NAU7802_NOT_CONNECTED_ERROR;
+      }
+      connectionState = NAU7802_PROBING;
+      stateTime = millis();
+      return NAU7802_NOT_CONNECTED_ERROR;
+
+    case NAU7802_PROBING:
+    {
+      //A connector bounces while it is plugged in; ask again before touching the device
+      if ((millis() - stateTime) < NAU7802_PROBE_MIN_MS)
+        return NAU7802_NOT_CONNECTED_ERROR;
+      if (!isConnected())
+      {
+        connectionLost();
+        return NAU7802_NOT_CONNECTED_ERROR;
+      }
+
+      //A bus glitch that did not power cycle the device leaves it configured and powered up
+      nau7802_snapshot_t registers;
+      if ((err = snapshot(&registers)))
+      {
+        connectionLost();
+        return err;
+      }
+      if ((shadowValid == 0xFFFFFFFF) && (diffSnapshot(registers) == 0) && getField(registers, NAU7802_FIELD_PUR))
+        break;
+
+      //Reset without reset(), which would forget the shadow
+      value = 1 << NAU7802_PU_CTRL_RR;
+      if ((err = i2c_error(i2c_write(NAU7802_PU_CTRL, &value))))
+      {
+        connectionLost();
+        return err;
+      }
+      connectionState = NAU7802_INITIALIZING;
+      stateTime = millis();
+      poweringUp = false;
+      return NAU7802_NOT_CONNECTED_ERROR;
+    }
+
+    case NAU7802_INITIALIZING:
+      if (!poweringUp)
+      {
+        //Leave reset and power up both sections
+        value = (1 << NAU7802_PU_CTRL_PUD) | (1 << NAU7802_PU_CTRL_PUA);
+        if ((err = i2c_error(i2c_write(NAU7802_PU_CTRL, &value))))
+        {
+          connectionLost();
+          return err;
+        }
+        poweringUp = true;
+        return NAU7802_NOT_CONNECTED_ERROR;
+      }
+
+      if ((err = getBit(NAU7802_PU_CTRL_PUR, NAU7802_PU_CTRL, &value)))
+      {
+        connectionLost();
+        return err;
+      }
+      if (!value)
+      {
+        //powerUp() allows 100ms
+        if ((millis() - stateTime) > 100)
+        {
+          connectionLost();
+          return NAU7802_POWER_UP_ERROR;
+        }
+        return NAU7802_NOT_CONNECTED_ERROR;
+      }
+
+      //The configuration from before the outage, or the begin() defaults after a failed start
+      if (shadowValid == 0xFFFFFFFF)
+        err = restoreConfiguration();
+      else
+      {
+        err = configure();
+        if (!err)
+          err = syncShadow();
+      }
+      if (!err)
+        err = beginCalibrateAFE();
+      if (err)
+      {
+        connectionLost();
+        return err;
+      }
+      connectionState = NAU7802_CALIBRATING;
+      stateTime = millis();
+      return NAU7802_NOT_CONNECTED_ERROR;
+
+    case NAU7802_CALIBRATING:
+    {
+      NAU7802_Cal_Status status = calAFEStatus();
+      if (status == NAU7802_CAL_IN_PROGRESS)
+      {
+        //calibrateAFE() allows 1000ms
+        if ((millis() - stateTime) <= 1000)
+          return NAU7802_NOT_CONNECTED_ERROR;
+        status = (NAU7802_Cal_Status)NAU7802_CAL_AFE_ERROR;
+      }
+      if (status < 0)
+      {
+        connectionLost();
+        return (error_code_t)status;
+      }
+
+      //A failed calibration leaves a working device; report it once
+      err = (status == NAU7802_CAL_FAILURE) ? NAU7802_CAL_AFE_ERROR : NAU7802_OK;
+      break;
+    }
+  }
+
+  connectionState = NAU7802_READY;
+  reconnectCount++;
+  lastOutage = millis() - lostTime;
+  return err;
+}
+
+//Mark the device as gone. The first probe follows after NAU7802_PROBE_MIN_MS; every failure while
+//reconnecting doubles the interval.
+void NAU7802::connectionLost()
+{
+  if (connectionState == NAU7802_READY)
+  {
+    lostTime = millis();
+    probeInterval = NAU7802_PROBE_MIN_MS;
+  }
+  else
+  {
+    probeInterval = min(2 * (uint32_t)probeInterval, (uint32_t)NAU7802_PROBE_MAX_MS);
+  }
+  connectionState = NAU7802_ABSENT;
+  stateTime = millis();
+}
+
 //Returns true if Cycle Ready bit is set (conversion is complete)
 error_code_t NAU7802::available(bool *ready)
 {
-  uint8_t value;
+  uint8_t value = 0;
   error_code_t err = getBit(NAU7802_PU_CTRL_CR, NAU7802_PU_CTRL, &value);
 
   if (err) {
@@ -131,17 +304,18 @@ error_code_t NAU7802::calibrateAFE()
 // Poll for completion with calAFEStatus() or wait with waitForCalibrateAFE()
 error_code_t NAU7802::beginCalibrateAFE()
 {
+  calibrationPending = true;
   return setBit(NAU7802_CTRL2_CALS, NAU7802_CTRL2);
 }
 
 //Check calibration status.
 NAU7802_Cal_Status NAU7802::calAFEStatus()
 {
-  uint8_t value;
+  uint8_t value = 0;
   error_code_t err = getBit(NAU7802_CTRL2_CALS, NAU7802_CTRL2, &value);
 
   if (err)
-    return err;
+    return (NAU7802_Cal_Status)err;
 
   if (value)
   {
@@ -150,14 +324,25 @@ NAU7802_Cal_Status NAU7802::calAFEStatus()
 
   err = getBit(NAU7802_CTRL2_CAL_ERROR, NAU7802_CTRL2, &value);
   if (err)
-    return err;
+    return (NAU7802_Cal_Status)err;
 
   if (value)
   {
+    //Keep the last good calibration in the shadow, so restoreConfiguration() can put it back
+    calibrationPending = false;
     return NAU7802_CAL_FAILURE;
   }
 
-  // Calibration passed
+  // Calibration passed. The new calibration is what the shadow should expect from now on.
+  if (calibrationPending)
+  {
+    nau7802_afe_calibration_t calibration = {};
+    err = getAFECalibration(&calibration);
+    if (err)
+      return (NAU7802_Cal_Status)err;
+    updateShadow(NAU7802_OCAL1_B2, (const uint8_t *)&calibration, sizeof(calibration));
+    calibrationPending = false;
+  }
   return NAU7802_CAL_SUCCESS;
 }
 
@@ -187,7 +372,7 @@ error_code_t NAU7802::setSampleRate(uint8_t rate)
   if (rate > 0b111)
     rate = 0b111; //Error check
 
-  uint8_t value;
+  uint8_t value = 0;
   error_code_t err = getRegister(NAU7802_CTRL2, &value);
   if (err)
     return err;
@@ -198,6 +383,18 @@ error_code_t NAU7802::setSampleRate(uint8_t rate)
   return (setRegister(NAU7802_CTRL2, value));
 }
 
+//Get the CRS bits as set by setSampleRate()
+error_code_t NAU7802::getSampleRate(uint8_t *rate)
+{
+  uint8_t value = 0;
+  error_code_t err = getRegister(NAU7802_CTRL2, &value);
+  if (err)
+    return err;
+
+  *rate = (value >> 4) & 0b111;
+  return NAU7802_OK;
+}
+
 //Select between 1 and 2
 error_code_t NAU7802::setChannel(uint8_t channelNumber)
 {
@@ -207,6 +404,15 @@ error_code_t NAU7802::setChannel(uint8_t channelNumber)
     return (setBit(NAU7802_CTRL2_CHS, NAU7802_CTRL2)); //Channel 2
 }
 
+//The temperature sensor output is ~109mV at 25C; use gain x1 while it is selected
+error_code_t NAU7802::setTemperatureSensor(bool enable)
+{
+  if (enable)
+    return (setBit(NAU7802_I2C_CONTROL_TS, NAU7802_I2C_CONTROL));
+  else
+    return (clearBit(NAU7802_I2C_CONTROL_TS, NAU7802_I2C_CONTROL));
+}
+
 //Power up digital and analog sections of scale
 error_code_t NAU7802::powerUp()
 {
@@ -222,7 +428,7 @@ error_code_t NAU7802::powerUp()
   uint8_t counter = 0;
   while (1)
   {
-    uint8_t value;
+    uint8_t value = 0;
     err = getBit(NAU7802_PU_CTRL_PUR, NAU7802_PU_CTRL, &value);
     if (err)
       return err;
@@ -252,6 +458,7 @@ error_code_t NAU7802::reset()
   if (err)
     return err;
   delay(1);
+  shadowValid = 0; //Every register is back to its default
   return (clearBit(NAU7802_PU_CTRL_RR, NAU7802_PU_CTRL)); //Clear RR to leave reset state
 }
 
@@ -263,7 +470,7 @@ error_code_t NAU7802::setLDO(uint8_t ldoValue)
     ldoValue = 0b111; //Error check
 
   //Set the value of the LDO
-  uint8_t value;
+  uint8_t value = 0;
   error_code_t err = getRegister(NAU7802_CTRL1, &value);
   if (err)
     return err;
@@ -284,7 +491,7 @@ error_code_t NAU7802::setGain(uint8_t gainValue)
   if (gainValue > 0b111)
     gainValue = 0b111; //Error check
 
-  uint8_t value;
+  uint8_t value = 0;
   error_code_t err = getRegister(NAU7802_CTRL1, &value);
   if (err)
     return err;
@@ -295,6 +502,18 @@ error_code_t NAU7802::setGain(uint8_t gainValue)
   return (setRegister(NAU7802_CTRL1, value));
 }
 
+//Get the gain bits as set by setGain()
+error_code_t NAU7802::getGain(uint8_t *gainValue)
+{
+  uint8_t value = 0;
+  error_code_t err = getRegister(NAU7802_CTRL1, &value);
+  if (err)
+    return err;
+
+  *gainValue = value & 0b111;
+  return NAU7802_OK;
+}
+
 //Get the revision code of this IC
 error_code_t NAU7802::getRevisionCode(uint8_t *revisionCode)
 {
@@ -305,17 +524,25 @@ error_code_t NAU7802::getRevisionCode(uint8_t *revisionCode)
   return err;
 }
 
-byte NAU7802::i2c_write(uint8_t registerAddress, uint8_t* value) {
+byte NAU7802::i2c_write(uint8_t registerAddress, uint8_t* value, bool sendStop) {
+  return i2c_write_burst(registerAddress, value, (value != NULL) ? 1 : 0, sendStop);
+}
+
+//Write the register address followed by length values, which the NAU7802 stores in consecutive registers
+byte NAU7802::i2c_write_burst(uint8_t registerAddress, const uint8_t *values, uint8_t length, bool sendStop) {
   int tries = 3;
   byte ret;
 
+  if (length + 1 > NAU7802_WIRE_BUFFER_LENGTH)
+    return 1; //Data too long to fit in transmit buffer
+
   while (tries) {
     i2cPort->beginTransmission(deviceAddress);
     i2cPort->write(registerAddress);
-    if (value != NULL){
-      i2cPort->write(*value);
+    for (uint8_t i = 0; i < length; i++){
+      i2cPort->write(values[i]);
     }
-    ret = i2cPort->endTransmission();
+    ret = i2cPort->endTransmission(sendStop);
 
     switch (ret){
       case 1:
@@ -332,33 +559,227 @@ byte NAU7802::i2c_write(uint8_t registerAddress, uint8_t* value) {
   return ret;
 }
 
-//Returns 24-bit reading
-//Assumes CR Cycle Ready bit (ADC conversion complete) has been checked to be 1
-error_code_t NAU7802::getReading(int32_t *result)
+error_code_t NAU7802::i2c_error(byte status)
 {
-  byte ret = i2c_write(NAU7802_ADCO_B2, NULL);
+  switch (status){
+    case 0:
+      return NAU7802_OK;
+    case 1:
+      return NAU7802_I2C_DATA_TOO_BIG_ERROR;
+    case 2:
+      return NAU7802_I2C_NACK_ADDR_ERROR;
+    case 3:
+      return NAU7802_I2C_NACK_DATA_ERROR;
+    default:
+      // 4 is other error, some cores also return 5 for a timeout
+      return NAU7802_I2C_ERROR;
+  }
+}
+
+error_code_t NAU7802::getRegisters(uint8_t startAddress, uint8_t *values, uint8_t length)
+{
+  while (length > 0)
+  {
+    uint8_t chunk = min(length, (uint8_t)NAU7802_READ_CHUNK);
+    error_code_t err = i2c_read(startAddress, values, chunk);
+    if (err)
+      return err;
+
+    startAddress += chunk;
+    values += chunk;
+    length -= chunk;
+  }
+  return NAU7802_OK;
+}
+
+error_code_t NAU7802::setRegisters(uint8_t startAddress, const uint8_t *values, uint8_t length)
+{
+  while (length > 0)
+  {
+    uint8_t chunk = min(length, (uint8_t)NAU7802_WRITE_CHUNK);
+    error_code_t err = i2c_error(i2c_write_burst(startAddress, values, chunk, true));
+    if (err)
+      return err;
+    updateShadow(startAddress, values, chunk);
+
+    startAddress += chunk;
+    values += chunk;
+    length -= chunk;
+  }
+  return NAU7802_OK;
+}
+
+error_code_t NAU7802::snapshot(nau7802_snapshot_t *snapshot)
+{
+  uint8_t *registers = snapshot->registers;
+
+  error_code_t err = getRegisters(NAU7802_PU_CTRL, registers, NAU7802_ADCO_B2);
+  if (err)
+    return err;
+
+  registers[NAU7802_ADCO_B2] = 0;
+  registers[NAU7802_ADCO_B1] = 0;
+  registers[NAU7802_ADCO_B0] = 0;
+  return getRegisters(NAU7802_ADC, &registers[NAU7802_ADC], NAU7802_REGISTER_COUNT - NAU7802_ADC);
+}
+
+uint32_t NAU7802::diffSnapshot(const nau7802_snapshot_t &snapshot)
+{
+  uint32_t differences = 0;
+
+  for (uint8_t i = 0; i < NAU7802_REGISTER_COUNT; i++)
+  {
+    //The calibration registers change while a calibration runs
+    if (calibrationPending && (i >= NAU7802_OCAL1_B2) && (i <= NAU7802_GCAL2_B0))
+      continue;
+    if (((shadowValid >> i) & 1) && ((snapshot.registers[i] ^ shadow.registers[i]) & getCompareMask(i)))
+      differences |= (uint32_t)1 << i;
+  }
+  return differences;
+}
+
+error_code_t NAU7802::syncShadow()
+{
+  error_code_t err = snapshot(&shadow);
+  if (err)
+  {
+    shadowValid = 0;
+    return err;
+  }
+
+  shadowValid = 0xFFFFFFFF;
+  calibrationPending = false;
+  return NAU7802_OK;
+}
+
+error_code_t NAU7802::restoreConfiguration()
+{
+  //powerUp() and the writes below update the shadow, so work from a copy
+  nau7802_snapshot_t expected = shadow;
+  uint32_t known = shadowValid;
+  error_code_t err;
+
+  //The sections have to be powered up before the rest of the configuration is written
+  uint8_t power = (1 << NAU7802_PU_CTRL_PUD) | (1 << NAU7802_PU_CTRL_PUA);
+  if ((known & 1) && ((expected.registers[NAU7802_PU_CTRL] & power) == power))
+  {
+    if ((err = powerUp()))
+      return err;
+  }
+
+  //Status bits are masked off, which also keeps CALS from starting a calibration over the restored one
+  uint8_t values[NAU7802_REGISTER_COUNT];
+  uint8_t start = 0;
+  uint8_t length = 0;
+  for (uint8_t i = 0; i <= NAU7802_REGISTER_COUNT; i++)
+  {
+    uint8_t mask = (i < NAU7802_REGISTER_COUNT) ? getCompareMask(i) : 0;
+    if (mask && ((known >> i) & 1))
+    {
+      if (length == 0)
+        start = i;
+      values[length++] = expected.registers[i] & mask;
+      continue;
+    }
+
+    if (length > 0)
+    {
+      if ((err = setRegisters(start, values, length)))
+        return err;
+      length = 0;
+    }
+  }
+  return NAU7802_OK;
+}
+
+uint8_t NAU7802::getField(const nau7802_snapshot_t &snapshot, NAU7802_Fields field)
+{
+  uint8_t reg = (field >> 8) & 0x1F;
+  uint8_t shift = (field >> 4) & 0x07;
+  uint8_t width = field & 0x0F;
 
-  if (ret == 1){
-    return NAU7802_I2C_DATA_TOO_BIG_ERROR;
+  return (snapshot.registers[reg] >> shift) & ((1 << width) - 1);
+}
+
+uint8_t NAU7802::getCompareMask(uint8_t registerAddress)
+{
+  switch (registerAddress)
+  {
+    case NAU7802_PU_CTRL:
+      //Power up ready and cycle ready follow the device, not the configuration
+      return (uint8_t)~((1 << NAU7802_PU_CTRL_PUR) | (1 << NAU7802_PU_CTRL_CR));
+    case NAU7802_CTRL2:
+      //CALS clears itself when the calibration ends
+      return (uint8_t)~((1 << NAU7802_CTRL2_CALS) | (1 << NAU7802_CTRL2_CAL_ERROR));
+    case NAU7802_ADCO_B2:
+    case NAU7802_ADCO_B1:
+    case NAU7802_ADCO_B0:
+    case NAU7802_OTP_B1:
+    case NAU7802_OTP_B0:
+    case 0x18:
+    case 0x19:
+    case 0x1A:
+    case 0x1D:
+    case 0x1E:
+    case NAU7802_DEVICE_REV:
+      return 0;
+    default:
+      return 0xFF;
   }
-  else if (ret == 2){
-    return NAU7802_I2C_NACK_ADDR_ERROR;
+}
+
+void NAU7802::updateShadow(uint8_t registerAddress, const uint8_t *values, uint8_t length)
+{
+  for (uint8_t i = 0; (i < length) && (registerAddress < NAU7802_REGISTER_COUNT); i++, registerAddress++)
+  {
+    shadow.registers[registerAddress] = values[i];
+    shadowValid |= (uint32_t)1 << registerAddress;
   }
-  else if (ret == 3){
-    return NAU7802_I2C_NACK_DATA_ERROR;
+}
+
+error_code_t NAU7802::getAFECalibration(nau7802_afe_calibration_t *calibration)
+{
+  return getRegisters(NAU7802_OCAL1_B2, (uint8_t *)calibration, sizeof(nau7802_afe_calibration_t));
+}
+
+error_code_t NAU7802::setAFECalibration(const nau7802_afe_calibration_t &calibration)
+{
+  return setRegisters(NAU7802_OCAL1_B2, (const uint8_t *)&calibration, sizeof(nau7802_afe_calibration_t));
+}
+
+//Write the register pointer without a STOP, then read length bytes after a repeated START.
+//A short read means the device stopped answering in between.
+error_code_t NAU7802::i2c_read(uint8_t registerAddress, uint8_t *data, uint8_t length)
+{
+  error_code_t err = i2c_error(i2c_write(registerAddress, NULL, false));
+  if (err) {
+    return err;
   }
-  else if (ret == 4){
-    return NAU7802_I2C_ERROR;
+
+  uint8_t received = i2cPort->requestFrom((uint8_t)deviceAddress, length);
+  if (received != length) {
+    while (i2cPort->available())
+      i2cPort->read();
+    return NAU7802_I2C_NO_DATA_ERROR;
   }
 
+  for (uint8_t i = 0; i < length; i++)
+    data[i] = i2cPort->read();
+  return NAU7802_OK;
+}
 
-  i2cPort->requestFrom((uint8_t)deviceAddress, (uint8_t)3);
+//Returns 24-bit reading
+//Assumes CR Cycle Ready bit (ADC conversion complete) has been checked to be 1
+error_code_t NAU7802::getReading(int32_t *result)
+{
+  uint8_t data[3] = {0, 0, 0};
+  error_code_t err = i2c_read(NAU7802_ADCO_B2, data, 3);
 
-  if (i2cPort->available())
+  if (!err)
   {
-    uint32_t valueRaw = (uint32_t)i2cPort->read() << 16; //MSB
-    valueRaw |= (uint32_t)i2cPort->read() << 8;          //MidSB
-    valueRaw |= (uint32_t)i2cPort->read();               //LSB
+    uint32_t valueRaw = (uint32_t)data[0] << 16; //MSB
+    valueRaw |= (uint32_t)data[1] << 8;          //MidSB
+    valueRaw |= (uint32_t)data[2];               //LSB
 
     // the raw value coming from the ADC is a 24-bit number, so the sign bit now
     // resides on bit 23 (0 is LSB) of the uint32_t container. By shifting the
@@ -369,17 +790,15 @@ error_code_t NAU7802::getReading(int32_t *result)
 
     // shift the number back right to recover its intended magnitude
     *result = (valueShifted >> 8);
-
-    return NAU7802_OK;
   }
 
-  return NAU7802_I2C_NO_DATA_ERROR;
+  return err;
 }
 
-error_code_t NAU7802::getAverageReading(int32_t *average, uint8_t average_size)
+error_code_t NAU7802::getAverageReading(int32_t *average, uint8_t average_size, SampleStatistics *stats)
 {
   error_code_t err;
-  int32_t value;
+  int32_t value = 0;
   long total = 0;
   uint8_t samplesAquired = 0;
   bool ready = false;
@@ -398,11 +817,13 @@ error_code_t NAU7802::getAverageReading(int32_t *average, uint8_t average_size)
     if (ready == true)
     {
 
-      if (err = getReading(&value)) {
+      if ((err = getReading(&value))) {
         return err;
       }
 
       total += value;
+      if (stats != NULL)
+        stats->add(value);
       samplesAquired++;
       ready = false;
     }
@@ -431,7 +852,7 @@ error_code_t NAU7802::setIntPolarityLow()
 //Mask & set a given bit within a register
 error_code_t NAU7802::setBit(uint8_t bitNumber, uint8_t registerAddress)
 {
-  uint8_t value;
+  uint8_t value = 0;
   error_code_t err = getRegister(registerAddress, &value);
   if (err) {
     return err;
@@ -444,7 +865,7 @@ error_code_t NAU7802::setBit(uint8_t bitNumber, uint8_t registerAddress)
 //Mask & clear a given bit within a register
 error_code_t NAU7802::clearBit(uint8_t bitNumber, uint8_t registerAddress)
 {
-  uint8_t value;
+  uint8_t value = 0;
   error_code_t err = getRegister(registerAddress, &value);
   if (err) {
     return err;
@@ -470,49 +891,15 @@ error_code_t NAU7802::getBit(uint8_t bitNumber, uint8_t registerAddress, uint8_t
 //Get contents of a register
 error_code_t NAU7802::getRegister(uint8_t registerAddress, uint8_t *registerContents)
 {
-  byte ret = i2c_write(registerAddress, NULL);
-  if (ret == 1){
-    return NAU7802_I2C_DATA_TOO_BIG_ERROR;
-  }
-  else if (ret == 2){
-    return NAU7802_I2C_NACK_ADDR_ERROR;
-  }
-  else if (ret == 3){
-    return NAU7802_I2C_NACK_DATA_ERROR;
-  }
-  else if (ret == 4){
-    return NAU7802_I2C_ERROR;
-  }
-
-  i2cPort->requestFrom((uint8_t)deviceAddress, (uint8_t)1);
-
-  if (i2cPort->available()) {
-    *registerContents = i2cPort->read();
-    return NAU7802_OK;
-  }
-
-  return NAU7802_I2C_NO_DATA_ERROR;
+  return i2c_read(registerAddress, registerContents, 1);
 }
 
 //Send a given value to be written to given address
 //Return true if successful
 error_code_t NAU7802::setRegister(uint8_t registerAddress, uint8_t value)
 {
-
-  byte ret = i2c_write(registerAddress, &value);
-
-  if (ret == 1){
-    return NAU7802_I2C_DATA_TOO_BIG_ERROR;
-  }
-  else if (ret == 2){
-    return NAU7802_I2C_NACK_ADDR_ERROR;
-  }
-  else if (ret == 3){
-    return NAU7802_I2C_NACK_DATA_ERROR;
-  }
-  else if (ret == 4){
-    return NAU7802_I2C_ERROR;
-  }
-
-  return NAU7802_OK;
+  error_code_t err = i2c_error(i2c_write(registerAddress, &value));
+  if (!err)
+    updateShadow(registerAddress, &value, 1);
+  return err;
 }
@@ -26,6 +26,23 @@
 
 #include "Arduino.h"
 #include <Wire.h>
+#include "SampleStatistics.h"
+
+//Bytes Wire can move in one transaction. Burst transfers longer than this are split.
+#ifndef NAU7802_WIRE_BUFFER_LENGTH
+#if defined(BUFFER_LENGTH)
+#define NAU7802_WIRE_BUFFER_LENGTH BUFFER_LENGTH
+#elif defined(I2C_BUFFER_LENGTH)
+#define NAU7802_WIRE_BUFFER_LENGTH I2C_BUFFER_LENGTH
+#else
+#define NAU7802_WIRE_BUFFER_LENGTH 32
+#endif
+#endif
+
+//Longest burst in one transaction, capped to the uint8_t lengths used here. A write also carries
+//the register address.
+#define NAU7802_READ_CHUNK   ((NAU7802_WIRE_BUFFER_LENGTH) > 255 ? 255 : (NAU7802_WIRE_BUFFER_LENGTH))
+#define NAU7802_WRITE_CHUNK  ((NAU7802_WIRE_BUFFER_LENGTH) > 256 ? 255 : (NAU7802_WIRE_BUFFER_LENGTH) - 1)
 
 //Register Map
 typedef enum
@@ -91,6 +108,19 @@ typedef enum
   NAU7802_CTRL2_CHS = 7,
 } CTRL2_Bits;
 
+//Bits within the I2C_CONTROL register
+typedef enum
+{
+  NAU7802_I2C_CONTROL_BGPCP = 0,
+  NAU7802_I2C_CONTROL_TS,       //Internal temperature sensor as the ADC input
+  NAU7802_I2C_CONTROL_BOPGA,
+  NAU7802_I2C_CONTROL_SI,
+  NAU7802_I2C_CONTROL_WPD,
+  NAU7802_I2C_CONTROL_SPE,
+  NAU7802_I2C_CONTROL_FRD,
+  NAU7802_I2C_CONTROL_CRSD,
+} I2C_CONTROL_Bits;
+
 //Bits within the PGA register
 typedef enum
 {
@@ -163,6 +193,87 @@ typedef enum
 } NAU7802_Cal_Status;
 
 
+//Connection state, see NAU7802::serviceConnection()
+typedef enum
+{
+  NAU7802_ABSENT = 0,       //Not answering, probed with exponential backoff
+  NAU7802_PROBING,          //Answered a probe, confirming before it is initialized
+  NAU7802_INITIALIZING,     //Reset, waiting for power up, then configured
+  NAU7802_CALIBRATING,      //AFE calibration running
+  NAU7802_READY,
+} NAU7802_Connection_State;
+
+//Probe interval while the device is absent, doubling from MIN to MAX with each failed probe
+#ifndef NAU7802_PROBE_MIN_MS
+#define NAU7802_PROBE_MIN_MS    10
+#endif
+#ifndef NAU7802_PROBE_MAX_MS
+#define NAU7802_PROBE_MAX_MS    2000
+#endif
+
+//Offset and gain calibration registers of both channels, OCAL1_B2 to GCAL2_B0 in register order
+typedef struct
+{
+  uint8_t offset1[3];
+  uint8_t gain1[4];
+  uint8_t offset2[3];
+  uint8_t gain2[4];
+} nau7802_afe_calibration_t;
+
+#define NAU7802_REGISTER_COUNT 0x20
+
+//Registers 0x00 to 0x1F as read by NAU7802::snapshot(), indexed by Scale_Registers
+typedef struct
+{
+  uint8_t registers[NAU7802_REGISTER_COUNT];
+} nau7802_snapshot_t;
+
+//Bitfields of a snapshot, decoded with NAU7802::getField(). Each value packs the register, the
+//lowest bit and the width, so decoding needs no table.
+#define NAU7802_FIELD(reg, shift, width) (((reg) << 8) | ((shift) << 4) | (width))
+typedef enum
+{
+  NAU7802_FIELD_RR = NAU7802_FIELD(NAU7802_PU_CTRL, NAU7802_PU_CTRL_RR, 1),
+  NAU7802_FIELD_PUD = NAU7802_FIELD(NAU7802_PU_CTRL, NAU7802_PU_CTRL_PUD, 1),
+  NAU7802_FIELD_PUA = NAU7802_FIELD(NAU7802_PU_CTRL, NAU7802_PU_CTRL_PUA, 1),
+  NAU7802_FIELD_PUR = NAU7802_FIELD(NAU7802_PU_CTRL, NAU7802_PU_CTRL_PUR, 1),
+  NAU7802_FIELD_CS = NAU7802_FIELD(NAU7802_PU_CTRL, NAU7802_PU_CTRL_CS, 1),
+  NAU7802_FIELD_CR = NAU7802_FIELD(NAU7802_PU_CTRL, NAU7802_PU_CTRL_CR, 1),
+  NAU7802_FIELD_OSCS = NAU7802_FIELD(NAU7802_PU_CTRL, NAU7802_PU_CTRL_OSCS, 1),
+  NAU7802_FIELD_AVDDS = NAU7802_FIELD(NAU7802_PU_CTRL, NAU7802_PU_CTRL_AVDDS, 1),
+  NAU7802_FIELD_GAIN = NAU7802_FIELD(NAU7802_CTRL1, 0, 3),            //NAU7802_Gain_Values
+  NAU7802_FIELD_VLDO = NAU7802_FIELD(NAU7802_CTRL1, 3, 3),            //NAU7802_LDO_Values
+  NAU7802_FIELD_DRDY_SEL = NAU7802_FIELD(NAU7802_CTRL1, NAU7802_CTRL1_DRDY_SEL, 1),
+  NAU7802_FIELD_CRP = NAU7802_FIELD(NAU7802_CTRL1, NAU7802_CTRL1_CRP, 1),
+  NAU7802_FIELD_CALMOD = NAU7802_FIELD(NAU7802_CTRL2, NAU7802_CTRL2_CALMOD, 2),
+  NAU7802_FIELD_CALS = NAU7802_FIELD(NAU7802_CTRL2, NAU7802_CTRL2_CALS, 1),
+  NAU7802_FIELD_CAL_ERROR = NAU7802_FIELD(NAU7802_CTRL2, NAU7802_CTRL2_CAL_ERROR, 1),
+  NAU7802_FIELD_CRS = NAU7802_FIELD(NAU7802_CTRL2, NAU7802_CTRL2_CRS, 3), //NAU7802_SPS_Values
+  NAU7802_FIELD_CHS = NAU7802_FIELD(NAU7802_CTRL2, NAU7802_CTRL2_CHS, 1), //NAU7802_Channels
+  NAU7802_FIELD_BGPCP = NAU7802_FIELD(NAU7802_I2C_CONTROL, NAU7802_I2C_CONTROL_BGPCP, 1),
+  NAU7802_FIELD_TS = NAU7802_FIELD(NAU7802_I2C_CONTROL, NAU7802_I2C_CONTROL_TS, 1),
+  NAU7802_FIELD_BOPGA = NAU7802_FIELD(NAU7802_I2C_CONTROL, NAU7802_I2C_CONTROL_BOPGA, 1),
+  NAU7802_FIELD_SI = NAU7802_FIELD(NAU7802_I2C_CONTROL, NAU7802_I2C_CONTROL_SI, 1),
+  NAU7802_FIELD_WPD = NAU7802_FIELD(NAU7802_I2C_CONTROL, NAU7802_I2C_CONTROL_WPD, 1),
+  NAU7802_FIELD_SPE = NAU7802_FIELD(NAU7802_I2C_CONTROL, NAU7802_I2C_CONTROL_SPE, 1),
+  NAU7802_FIELD_FRD = NAU7802_FIELD(NAU7802_I2C_CONTROL, NAU7802_I2C_CONTROL_FRD, 1),
+  NAU7802_FIELD_CRSD = NAU7802_FIELD(NAU7802_I2C_CONTROL, NAU7802_I2C_CONTROL_CRSD, 1),
+  NAU7802_FIELD_PGA_CHP_DIS = NAU7802_FIELD(NAU7802_PGA, NAU7802_PGA_CHP_DIS, 1),
+  NAU7802_FIELD_PGA_INV = NAU7802_FIELD(NAU7802_PGA, NAU7802_PGA_INV, 1),
+  NAU7802_FIELD_PGA_BYPASS_EN = NAU7802_FIELD(NAU7802_PGA, NAU7802_PGA_BYPASS_EN, 1),
+  NAU7802_FIELD_PGA_OUT_EN = NAU7802_FIELD(NAU7802_PGA, NAU7802_PGA_OUT_EN, 1),
+  NAU7802_FIELD_PGA_LDOMODE = NAU7802_FIELD(NAU7802_PGA, NAU7802_PGA_LDOMODE, 1),
+  NAU7802_FIELD_RD_OTP_SEL = NAU7802_FIELD(NAU7802_PGA, NAU7802_PGA_RD_OTP_SEL, 1),
+  NAU7802_FIELD_PGA_CURR = NAU7802_FIELD(NAU7802_PGA_PWR, NAU7802_PGA_PWR_PGA_CURR, 2),
+  NAU7802_FIELD_ADC_CURR = NAU7802_FIELD(NAU7802_PGA_PWR, NAU7802_PGA_PWR_ADC_CURR, 2),
+  NAU7802_FIELD_MSTR_BIAS_CURR = NAU7802_FIELD(NAU7802_PGA_PWR, NAU7802_PGA_PWR_MSTR_BIAS_CURR, 3),
+  NAU7802_FIELD_PGA_CAP_EN = NAU7802_FIELD(NAU7802_PGA_PWR, NAU7802_PGA_PWR_PGA_CAP_EN, 1),
+  NAU7802_FIELD_REVISION = NAU7802_FIELD(NAU7802_DEVICE_REV, 0, 4),
+} NAU7802_Fields;
+
+//Bytes on the bus per NAU7802::snapshot(), with the address and register pointer of each transaction
+#define NAU7802_SNAPSHOT_BUS_BYTES 35
+
 typedef int error_code_t;
 #define NAU7802_OK               0
 #define NAU7802_I2C_DATA_TOO_BIG_ERROR -1
@@ -173,6 +284,7 @@ typedef int error_code_t;
 #define NAU7802_TIMEOUT_ERROR   -6
 #define NAU7802_POWER_UP_ERROR  -7
 #define NAU7802_CAL_AFE_ERROR   -8
+#define NAU7802_NOT_CONNECTED_ERROR -9
 
 class NAU7802
 {
@@ -181,18 +293,33 @@ class NAU7802
     error_code_t begin(TwoWire &wirePort = Wire, bool reset = true); //Check communication and initialize sensor
     bool isConnected();                                      //Returns true if device acks at the I2C address
 
+    //Reconnection without blocking. After an I2C error, e.g. the cable was unplugged, call
+    //connectionLost(); serviceConnection() then probes with isConnected() at growing intervals and, once
+    //the device answers, resets it, writes the shadow configuration back (or the begin() defaults if
+    //there is none) and recalibrates the AFE, one step per call. It returns NAU7802_NOT_CONNECTED_ERROR
+    //until the device is ready. begin() leaves the state ready, or absent if it fails.
+    error_code_t serviceConnection();
+    void connectionLost();
+    NAU7802_Connection_State getConnectionState() {return connectionState;}
+    uint16_t getReconnectCount() {return reconnectCount;}       //Times the device came back
+    uint32_t getLastOutage() {return lastOutage;}               //Milliseconds it was gone the last time
+    static bool isConnectionError(error_code_t err) {return (err <= NAU7802_I2C_NACK_ADDR_ERROR) && (err >= NAU7802_I2C_NO_DATA_ERROR);}
+
     error_code_t available(bool *ready);                          //Returns true if Cycle Ready bit is set (conversion is complete)
 
     //Returns 24-bit reading. Assumes CR Cycle Ready bit (ADC conversion complete) has been checked by .available()
     error_code_t getReading(int32_t *result);
 
-    //Return the average of a given number of readings
-    error_code_t getAverageReading(int32_t *average_reading, uint8_t average_size = 8);
+    //Return the average of a given number of readings. The same readings are added to stats if given.
+    error_code_t getAverageReading(int32_t *average_reading, uint8_t average_size = 8, SampleStatistics *stats = NULL);
 
     error_code_t setGain(uint8_t gainValue);        //Set the gain. x1, 2, 4, 8, 16, 32, 64, 128 are available
+    error_code_t getGain(uint8_t *gainValue);       //Get the configured NAU7802_Gain_Values
     error_code_t setLDO(uint8_t ldoValue);          //Set the onboard Low-Drop-Out voltage regulator to a given value. 2.4, 2.7, 3.0, 3.3, 3.6, 3.9, 4.2, 4.5V are avaialable
     error_code_t setSampleRate(uint8_t rate);       //Set the readings per second. 10, 20, 40, 80, and 320 samples per second is available
+    error_code_t getSampleRate(uint8_t *rate);      //Get the configured NAU7802_SPS_Values
     error_code_t setChannel(uint8_t channelNumber); //Select between 1 and 2
+    error_code_t setTemperatureSensor(bool enable);  //Convert the internal temperature sensor instead of the selected channel
 
     error_code_t calibrateAFE();                               //Synchronous calibration of the analog front end of the NAU7802. Returns true if CAL_ERR bit is 0 (no error)
     error_code_t beginCalibrateAFE();                          //Begin asynchronous calibration of the analog front end of the NAU7802. Poll for completion with calAFEStatus() or wait with waitForCalibrateAFE().
@@ -216,9 +343,60 @@ class NAU7802
     error_code_t getRegister(uint8_t registerAddress, uint8_t *contents);             //Get contents of a register
     error_code_t setRegister(uint8_t registerAddress, uint8_t value); //Send a given value to be written to given address. Return true if successful
 
-    byte i2c_write(uint8_t registerAddress, uint8_t* value);
+    //Burst access to length consecutive registers from startAddress using the register auto-increment.
+    //Transfers longer than the Wire buffer are split into as few transactions as fit.
+    error_code_t getRegisters(uint8_t startAddress, uint8_t *values, uint8_t length);
+    error_code_t setRegisters(uint8_t startAddress, const uint8_t *values, uint8_t length);
+
+    //Offset and gain calibration of both channels, e.g. to restore a calibration without recalibrating
+    error_code_t getAFECalibration(nau7802_afe_calibration_t *calibration);
+    error_code_t setAFECalibration(const nau7802_afe_calibration_t &calibration);
+
+    //Burst read of all registers into snapshot in two transactions. The conversion result is skipped
+    //so that a snapshot never takes a conversion from available()/getReading(); ADCO_B2..B0 read as 0.
+    error_code_t snapshot(nau7802_snapshot_t *snapshot);
+    //Registers whose configuration bits differ from the shadow, as a mask with bit n for register n.
+    //Status bits, the conversion result, OTP and reserved registers are not compared.
+    uint32_t diffSnapshot(const nau7802_snapshot_t &snapshot);
+    //The expected configuration: what begin() left, updated by every register write since and by the
+    //result of each AFE calibration. Registers not known since the last reset() are not compared.
+    const nau7802_snapshot_t &getShadow() {return shadow;}
+    uint32_t getShadowValid() {return shadowValid;}
+    error_code_t syncShadow();   //Take the shadow from the device, e.g. after configuring it directly
+    //Write the shadow back to the device, e.g. after a brown-out reset it to its defaults: power up if
+    //the shadow is powered up, then one burst write per run of known registers, including the AFE
+    //calibration, so no recalibration is needed
+    error_code_t restoreConfiguration();
+
+    static uint8_t getField(const nau7802_snapshot_t &snapshot, NAU7802_Fields field);
+    static uint8_t getCompareMask(uint8_t registerAddress);  //Bits of a register that diffSnapshot() compares
+    static uint16_t decodeGain(uint8_t gainValue) {return 1 << (gainValue & 0b111);}
+    static uint16_t decodeLDO(uint8_t ldoValue) {return 4500 - 300 * (ldoValue & 0b111);}   //mV
+    static uint16_t decodeSampleRate(uint8_t rate) {return ((rate & 0b111) == NAU7802_SPS_320) ? 320 : 10 << (rate & 0b11);}
+
+    byte i2c_write(uint8_t registerAddress, uint8_t* value, bool sendStop = true);
+    //Read length registers from registerAddress in one transaction: the register pointer is written and
+    //the data read back after a repeated start, so no other master can move the pointer in between
+    error_code_t i2c_read(uint8_t registerAddress, uint8_t *data, uint8_t length);
   protected:
+    error_code_t i2c_error(byte status);   //Wire endTransmission() status to error code
+    byte i2c_write_burst(uint8_t registerAddress, const uint8_t *values, uint8_t length, bool sendStop);
+    void updateShadow(uint8_t registerAddress, const uint8_t *values, uint8_t length);
+    error_code_t initializeDevice();   //Reset, power up, configure() and calibrate, blocking
+    error_code_t configure();          //Default configuration: LDO 3.3V, gain 128, 80 SPS
     TwoWire *i2cPort;                   //This stores the user's requested i2c port
     const uint8_t deviceAddress = 0x2A; //Default unshifted 7-bit address of the NAU7802
+    nau7802_snapshot_t shadow = {};     //Expected register contents
+    uint32_t shadowValid = 0;           //Bit n set when shadow register n is known
+    bool calibrationPending = false;    //AFE calibration running, calibration registers not compared
+
+    //Connection state machine, see serviceConnection()
+    NAU7802_Connection_State connectionState = NAU7802_ABSENT;
+    uint32_t stateTime = 0;             //millis() of the last probe or of entering the state
+    uint16_t probeInterval = NAU7802_PROBE_MIN_MS;
+    bool poweringUp = false;
+    uint32_t lostTime = 0;
+    uint16_t reconnectCount = 0;
+    uint32_t lastOutage = 0;
 };
 #endif
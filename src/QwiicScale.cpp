@@ -1,5 +1,6 @@
 #include <Arduino.h>
 #include "QwiicScale.h"
+#include "TaskScheduler.h"
 
 const __FlashStringHelper* QwiicScale::strerror_f(error_code_t err) {
   switch (err) {
@@ -21,12 +22,46 @@ const __FlashStringHelper* QwiicScale::strerror_f(error_code_t err) {
       return F("NAU7802 sensor encountered an error powering up.");
     case NAU7802_CAL_AFE_ERROR:
       return F("NAU7802 sensor encountered an error calibrbating afe.");
+    case NAU7802_NOT_CONNECTED_ERROR:
+      return F("NAU7802 sensor is not connected, reconnecting.");
     case SCALE_EEPROM_READ_CAL_ERROR:
       return F("Unable to read cal factor from eeprom");
     case SCALE_EEPROM_READ_OFFSET_ERROR:
       return F("Unable to read zero offset from eeprom.");
     case SCALE_NOT_CALIBRATED_ERROR:
       return F("Scale is not calibrated");
+    case SCALE_NO_WEIGHER_ERROR:
+      return F("Dynamic weighing has not been started.");
+    case SCALE_NO_CLASSIFIER_ERROR:
+      return F("Classification has not been started.");
+    case SCALE_NO_FLOW_ESTIMATOR_ERROR:
+      return F("No flow rate estimator attached.");
+    case SCALE_FLOW_RATE_NOT_READY_ERROR:
+      return F("Not enough samples for a flow rate.");
+    case SCALE_NO_DOSING_CONTROLLER_ERROR:
+      return F("No dosing controller attached.");
+    case SCALE_NO_CAPTURE_ENGINE_ERROR:
+      return F("No capture engine attached.");
+    case SCALE_NO_BIQUAD_ERROR:
+      return F("No biquad filter attached.");
+    case SCALE_NO_NOTCH_ERROR:
+      return F("No mains notch filter attached.");
+    case SCALE_INVALID_SAMPLE_RATE_ERROR:
+      return F("NAU7802 sample rate setting is reserved.");
+    case SCALE_NO_TEMPERATURE_ERROR:
+      return F("No temperature reading available.");
+    case SCALE_NO_CREEP_COMPENSATOR_ERROR:
+      return F("No creep compensator attached.");
+    case SCALE_NO_HUB_ERROR:
+      return F("No acquisition hub attached.");
+    case SCALE_CONFIG_RESTORED_ERROR:
+      return F("Device configuration was lost and has been restored.");
+    case SCALE_NOTCH_INTERLEAVE_ERROR:
+      return F("Mains rejection needs channel 1 at an even rate, not interleaved.");
+    case SCHEDULER_TABLE_FULL_ERROR:
+      return F("Scheduler task table is full.");
+    case SCHEDULER_INVALID_TASK_ERROR:
+      return F("Scheduler task does not exist.");
     default:
       return F("Unknown error.");
   }
@@ -34,15 +69,22 @@ const __FlashStringHelper* QwiicScale::strerror_f(error_code_t err) {
 
 
 //Call when scale is setup, level, at running temperature, with nothing on it
-error_code_t QwiicScale::calculateZeroOffset(uint8_t average_size)
+error_code_t QwiicScale::calculateZeroOffset(uint8_t average_size, bool empty_platform)
 {
   int32_t avg_offset = 0;
-  error_code_t err = getAverageReading(&avg_offset, average_size);
+  error_code_t err = getPrimaryAverage(&avg_offset, average_size);
   if (err) {
     isCalibrated = false;
     return err;
   }
+  //A tare with a load on the platform says nothing about the drift of the empty cell
+  if ((temperatureCompensator != NULL) && empty_platform)
+    temperatureCompensator->learnZero(avg_offset);
+  else if (temperatureCompensator != NULL)
+    temperatureCompensator->setZeroReference();
   setZeroOffset(avg_offset);
+  if (creepCompensator != NULL)
+    creepCompensator->reset();
   if (useEEPROM)
     storeCalibration();
   return SCALE_OK;
@@ -52,13 +94,20 @@ error_code_t QwiicScale::calculateZeroOffset(uint8_t average_size)
 error_code_t QwiicScale::calculateCalibrationFactor(float calibration_weight_grams, uint8_t average_size)
 {
   int32_t avg_reading = 0;
-  error_code_t err = getAverageReading(&avg_reading, average_size);
+  error_code_t err = getPrimaryAverage(&avg_reading, average_size);
   if (err) {
     isCalibrated = false;
     return err;
   }
+  //Zero drift since the tare is removed, the span is measured at the current temperature
+  if (temperatureCompensator != NULL)
+    avg_reading = temperatureCompensator->compensateZero(avg_reading);
+  if (creepCompensator != NULL)
+    avg_reading -= lround(creepCompensator->getCreep());
   float newCalFactor = (avg_reading - zeroOffset) / (float)calibration_weight_grams;
   setCalibrationFactor(newCalFactor);
+  if (temperatureCompensator != NULL)
+    temperatureCompensator->learnSpan(newCalFactor);
   if (useEEPROM)
     storeCalibration();
   isCalibrated = true;
@@ -75,21 +124,662 @@ error_code_t QwiicScale::getAverageWeight(float* avg_weight, uint8_t average_siz
     return SCALE_NOT_CALIBRATED_ERROR;
   }
 
-  error_code_t err = getAverageReading(&avg_reading, average_size);
+  error_code_t err = getPrimaryAverage(&avg_reading, average_size);
   if (err) {
     return err;
   }
 
+  return getWeight(avg_weight, compensatePrimary(avg_reading), allow_negative);
+}
+
+int32_t QwiicScale::compensatePrimary(int32_t average_reading)
+{
+  if (temperatureCompensator != NULL)
+    average_reading = temperatureCompensator->compensate(average_reading, zeroOffset);
+  if (creepCompensator != NULL)
+    average_reading -= lround(creepCompensator->getCreep());
+  return average_reading;
+}
+
+//Blocking average of channel 1 on the same scale as the per-sample pipeline, before temperature
+//compensation. If interleaving left the input on channel 2 or the temperature sensor, or still
+//settling, it is switched back and settled first. A recalibration in progress is waited for.
+error_code_t QwiicScale::getPrimaryAverage(int32_t *average_reading, uint8_t average_size, SampleStatistics *stats)
+{
+  //update() takes care of the input, settling, recalibration and reconnection
+  if (hub != NULL)
+    return getHubAverage(average_reading, average_size, false, stats);
+
+  //Each call while the NAU7802 is gone takes one reconnection step, so the averages come back
+  //without update()
+  error_code_t err;
+  if (getConnectionState() != NAU7802_READY)
+  {
+    err = serviceReconnection();
+    if (getConnectionState() != NAU7802_READY)
+      return err;
+  }
+
+  err = readPrimaryAverage(average_reading, average_size, stats);
+  if (isConnectionError(err))
+    disconnected();
+  return err;
+}
+
+//stats gets the readings before excitation compensation, which is applied to the average only
+error_code_t QwiicScale::readPrimaryAverage(int32_t *average_reading, uint8_t average_size, SampleStatistics *stats)
+{
+  error_code_t err;
+  int32_t discard;
+
+  //These conversions bypass processSample(), so a running fill could not be cut off
+  if (dosingController != NULL)
+    dosingController->abort();
+
+  if (afeRecalibrating)
+  {
+    afeRecalibrating = false;
+    err = waitForCalibrateAFE(1000);
+    if (err)
+      return err;
+    if (temperatureCompensator != NULL)
+      temperatureCompensator->recalibrated();
+  }
+
+  if (source != SCALE_SOURCE_CHANNEL_1)
+  {
+    err = selectSource(SCALE_SOURCE_CHANNEL_1);
+    if (err)
+      return err;
+  }
+
+  if (settleRemaining > 0)
+  {
+    err = getAverageReading(&discard, settleRemaining);
+    if (err)
+      return err;
+    settleRemaining = 0;
+  }
+  primaryCount = 0;
+
+  err = getAverageReading(average_reading, average_size, stats);
+  if (err)
+    return err;
+
+  if (excitationCompensator != NULL)
+    *average_reading = excitationCompensator->compensate(*average_reading, micros());
+  return SCALE_OK;
+}
+
+error_code_t QwiicScale::getHubAverage(int32_t *average_reading, uint8_t average_size, bool filtered,
+                                       SampleStatistics *stats)
+{
+  if (hub == NULL) {
+    return SCALE_NO_HUB_ERROR;
+  }
+
+  hub_cursor_t cursor;
+  hub_sample_t sample;
+  long total = 0;
+  uint8_t count = 0;
+  hub->subscribe(&cursor);
+
+  unsigned long lastTime = millis();
+  while (count < average_size)
+  {
+    error_code_t err = update();
+    if (err)
+      return err;
+
+    while ((count < average_size) && hub->read(&cursor, &sample))
+    {
+      int32_t value = filtered ? sample.reading : sample.primary;
+      total += value;
+      if (stats != NULL)
+        stats->add(value);
+      count++;
+      lastTime = millis();
+    }
+
+    if ((millis() - lastTime) > SCALE_HUB_TIMEOUT_MS)
+      return NAU7802_TIMEOUT_ERROR;
+  }
+
+  *average_reading = total / average_size;
+  return SCALE_OK;
+}
+
+//Returns the y of y = mx + b for a reading the caller already has.
+error_code_t QwiicScale::getWeight(float* weight, int32_t reading, bool allow_negative)
+{
+  if (!isCalibrated) {
+    return SCALE_NOT_CALIBRATED_ERROR;
+  }
+
   //Prevent the current reading from being less than zero offset
   //This happens when the scale is zero'd, unloaded, and the load cell reports a value slightly less than zero value
   //causing the weight to be negative or jump to millions of pounds
   if (allow_negative == false)
   {
-    if (avg_reading < zeroOffset)
-      avg_reading = zeroOffset; //Force reading to zero
+    if (reading < zeroOffset)
+      reading = zeroOffset; //Force reading to zero
+  }
+
+  *weight = (reading - zeroOffset) / calibrationFactor;
+  return SCALE_OK;
+}
+
+//Poll for a conversion without blocking and run it through the per-sample consumers
+error_code_t QwiicScale::update(bool *newSample, int32_t *reading)
+{
+  if (newSample != NULL)
+    *newSample = false;
+
+  //The fill timeouts hold even when no conversion arrives
+  if (dosingController != NULL)
+    dosingController->service(micros());
+
+  if (getConnectionState() != NAU7802_READY)
+    return serviceReconnection();
+
+  error_code_t err = pollConversion(newSample, reading);
+  if (isConnectionError(err))
+    disconnected();
+  return err;
+}
+
+//The NAU7802 stopped answering. The valve must not wait for a cutoff that can no longer come.
+void QwiicScale::disconnected()
+{
+  connectionLost();
+  if (dosingController != NULL)
+    dosingController->abort();
+}
+
+//One step of NAU7802::serviceConnection(). When the device is back, configured and calibrated, the
+//state kept here is brought in line with it: the notches are retuned to its rate and the first
+//conversions are discarded.
+error_code_t QwiicScale::serviceReconnection()
+{
+  error_code_t err = serviceConnection();
+  if (getConnectionState() != NAU7802_READY)
+    return err;
+
+  afeRecalibrating = false;
+  settleRemaining = interleaveSettle;
+  if (temperatureCompensator != NULL)
+    temperatureCompensator->recalibrated();
+  if ((notch != NULL) && !err)
+    err = tuneNotch();
+  return err;
+}
+
+error_code_t QwiicScale::pollConversion(bool *newSample, int32_t *reading)
+{
+  bool ready = false;
+  int32_t value = 0;
+
+  if (afeRecalibrating)
+    return serviceRecalibration();
+
+  error_code_t err = available(&ready);
+  if (err)
+    return err;
+  if (!ready)
+    return serviceIntegrityCheck();
+
+  err = getReading(&value);
+  if (err)
+    return err;
+
+  //Conversions that started before the input mux settled
+  if (settleRemaining > 0)
+  {
+    settleRemaining--;
+    return SCALE_OK;
+  }
+
+  if (source == SCALE_SOURCE_TEMPERATURE)
+  {
+    processTemperature(value);
+    err = selectSource(SCALE_SOURCE_CHANNEL_1);
+    if (err)
+      return err;
+
+    //The input is back on channel 1 and would be settling anyway
+    if ((temperatureCompensator != NULL) && temperatureCompensator->isRecalibrationDue())
+    {
+      err = beginCalibrateAFE();
+      if (err)
+        return err;
+      afeRecalibrating = true;
+    }
+    return SCALE_OK;
+  }
+
+  if (source != SCALE_SOURCE_CHANNEL_1)
+  {
+    processReference(value, micros());
+    return selectSource(SCALE_SOURCE_CHANNEL_1);
+  }
+
+  processSample(value, micros());
+
+  if (newSample != NULL)
+    *newSample = true;
+  if (reading != NULL)
+    *reading = lastReading;
+
+  //When both are due the temperature goes first; channel 2 follows the next channel 1 conversion
+  if (interleavePeriod && (primaryCount < interleavePeriod))
+    primaryCount++;
+  if (temperatureInterval && (++temperatureCount >= temperatureInterval))
+  {
+    temperatureCount = 0;
+    return selectSource(SCALE_SOURCE_TEMPERATURE);
+  }
+  if (interleavePeriod && (primaryCount >= interleavePeriod))
+  {
+    primaryCount = 0;
+    return selectSource(SCALE_SOURCE_CHANNEL_2);
+  }
+  return SCALE_OK;
+}
+
+//Poll a recalibration started by update(). Conversions are not read until it completes.
+error_code_t QwiicScale::serviceRecalibration()
+{
+  NAU7802_Cal_Status status = calAFEStatus();
+  if (status == NAU7802_CAL_IN_PROGRESS)
+    return SCALE_OK;
+
+  afeRecalibrating = false;
+  if (status < 0)
+    return (error_code_t)status;
+  if (status == NAU7802_CAL_FAILURE)
+    return NAU7802_CAL_AFE_ERROR;
+
+  if (temperatureCompensator != NULL)
+    temperatureCompensator->recalibrated();
+  settleRemaining = interleaveSettle;
+  return SCALE_OK;
+}
+
+error_code_t QwiicScale::beginIntegrityCheck(uint16_t bus_bytes_per_second)
+{
+  if (bus_bytes_per_second == 0)
+    bus_bytes_per_second = 1;
+  integrityPeriod = (NAU7802_SNAPSHOT_BUS_BYTES * 1000UL + bus_bytes_per_second - 1) / bus_bytes_per_second;
+  integrityTime = millis();
+  return SCALE_OK;
+}
+
+//Run a due check from update(), between conversions
+error_code_t QwiicScale::serviceIntegrityCheck()
+{
+  if ((integrityPeriod == 0) || ((millis() - integrityTime) < integrityPeriod))
+    return SCALE_OK;
+
+  integrityTime = millis();
+  return checkIntegrity();
+}
+
+error_code_t QwiicScale::checkIntegrity()
+{
+  nau7802_snapshot_t registers;
+  error_code_t err = snapshot(&registers);
+  if (err)
+    return err;
+
+  uint32_t mismatch = diffSnapshot(registers);
+  if (mismatch == 0)
+    return SCALE_OK;
+
+  lastMismatch = mismatch;
+  if (integrityFaults < 0xFFFF)
+    integrityFaults++;
+
+  err = restoreConfiguration();
+  if (err)
+    return err;
+
+  //Conversions in progress were taken with the wrong configuration
+  settleRemaining = interleaveSettle;
+  return SCALE_CONFIG_RESTORED_ERROR;
+}
+
+error_code_t QwiicScale::beginTemperatureSampling(uint16_t interval_samples)
+{
+  temperatureInterval = max(interval_samples, (uint16_t)1);
+  temperatureCount = 0;
+  return SCALE_OK;
+}
+
+error_code_t QwiicScale::endTemperatureSampling()
+{
+  temperatureInterval = 0;
+  if (source == SCALE_SOURCE_TEMPERATURE)
+    return selectSource(SCALE_SOURCE_CHANNEL_1);
+  return SCALE_OK;
+}
+
+void QwiicScale::processTemperature(int32_t reading)
+{
+  if (temperatureCompensator != NULL)
+    temperatureCompensator->addTemperature(reading);
+}
+
+error_code_t QwiicScale::getTemperature(float *celsius)
+{
+  if ((temperatureCompensator == NULL) || !temperatureCompensator->hasTemperature()) {
+    return SCALE_NO_TEMPERATURE_ERROR;
+  }
+  *celsius = temperatureCompensator->getTemperature();
+  return SCALE_OK;
+}
+
+error_code_t QwiicScale::beginInterleave(uint8_t primary_samples, uint8_t settle_samples)
+{
+  if ((notch != NULL) && mainsFrequency) {
+    return SCALE_NOTCH_INTERLEAVE_ERROR;
+  }
+
+  interleavePeriod = max(primary_samples, (uint8_t)1);
+  interleaveSettle = settle_samples;
+  primaryCount = 0;
+  return SCALE_OK;
+}
+
+error_code_t QwiicScale::endInterleave()
+{
+  interleavePeriod = 0;
+  if (source != SCALE_SOURCE_CHANNEL_1)
+    return selectSource(SCALE_SOURCE_CHANNEL_1);
+  return SCALE_OK;
+}
+
+//The temperature sensor is converted at gain x1; the gain in use is restored when leaving it
+error_code_t QwiicScale::selectSource(Scale_Source next)
+{
+  error_code_t err;
+
+  if (source == SCALE_SOURCE_TEMPERATURE)
+  {
+    if ((err = setTemperatureSensor(false)))
+      return err;
+    if ((err = setGain(savedGain)))
+      return err;
+  }
+
+  if (next == SCALE_SOURCE_TEMPERATURE)
+  {
+    if ((err = getGain(&savedGain)))
+      return err;
+    if ((err = setGain(NAU7802_GAIN_1)))
+      return err;
+    if ((err = setTemperatureSensor(true)))
+      return err;
   }
+  else
+  {
+    err = setChannel((next == SCALE_SOURCE_CHANNEL_2) ? NAU7802_CHANNEL_2 : NAU7802_CHANNEL_1);
+    if (err)
+      return err;
+  }
+
+  source = next;
+  settleRemaining = interleaveSettle;
+  return SCALE_OK;
+}
+
+void QwiicScale::processReference(int32_t reading, uint32_t timestamp_us)
+{
+  lastReference = reading;
+  lastReferenceTime = timestamp_us;
+
+  if (vibrationCanceller != NULL)
+    vibrationCanceller->addReference(reading);
+
+  if (excitationCompensator != NULL)
+    excitationCompensator->addReference(reading, timestamp_us);
+}
+
+void QwiicScale::processSample(int32_t reading, uint32_t timestamp_us)
+{
+  lastRawReading = reading;
+  lastSampleTime = timestamp_us;
+
+  if (captureEngine != NULL)
+    captureEngine->addSample(reading, timestamp_us);
+
+  if (excitationCompensator != NULL)
+    reading = excitationCompensator->compensate(reading, timestamp_us);
+  int32_t primary = reading;
+  if (temperatureCompensator != NULL)
+    reading = temperatureCompensator->compensate(reading, zeroOffset);
+  if (creepCompensator != NULL)
+    reading = creepCompensator->compensate(reading, zeroOffset, timestamp_us);
+  if (vibrationCanceller != NULL)
+    reading = vibrationCanceller->cancel(reading);
+  if (notch != NULL)
+    reading = notch->filter(reading);
+  if (biquad != NULL)
+    reading = biquad->filter(reading);
+  lastReading = reading;
+
+  if (hub != NULL)
+    hub->publish(reading, primary, timestamp_us);
+
+  if (dynamicWeigher != NULL)
+    dynamicWeigher->addSample(reading, timestamp_us);
+
+  if ((classifier != NULL) && !classifier->isDecided())
+    classifier->addSample((reading - zeroOffset) / calibrationFactor);
+
+  if (flowEstimator != NULL)
+    flowEstimator->addSample(reading, timestamp_us);
+
+  //Runs after the flow estimator so the cutoff uses a rate that includes this sample
+  if (dosingController != NULL)
+  {
+    Dose_State state = dosingController->getState();
+    if ((state == DOSE_FILLING) || (state == DOSE_SETTLING))
+    {
+      //startDose() needs an estimator, but it can be detached while a dose runs
+      float rate = 0, uncertainty;
+      if ((flowEstimator == NULL) || !flowEstimator->getRate(&rate, &uncertainty))
+        rate = 0;
+      dosingController->addSample((reading - zeroOffset) / calibrationFactor, rate / calibrationFactor, timestamp_us);
+    }
+  }
+}
+
+error_code_t QwiicScale::setSampleRate(uint8_t rate)
+{
+  error_code_t err = NAU7802::setSampleRate(rate);
+  if (err)
+    return err;
 
-  *avg_weight = (avg_reading - zeroOffset) / calibrationFactor;
+  if ((notch != NULL) && mainsFrequency)
+    return tuneNotch();
+  return SCALE_OK;
+}
+
+error_code_t QwiicScale::getSamplesPerSecond(float *sps)
+{
+  uint8_t rate;
+  error_code_t err = getSampleRate(&rate);
+  if (err)
+    return err;
+
+  switch (rate)
+  {
+    case NAU7802_SPS_10: *sps = 10; break;
+    case NAU7802_SPS_20: *sps = 20; break;
+    case NAU7802_SPS_40: *sps = 40; break;
+    case NAU7802_SPS_80: *sps = 80; break;
+    case NAU7802_SPS_320: *sps = 320; break;
+    default: return SCALE_INVALID_SAMPLE_RATE_ERROR;
+  }
+  return SCALE_OK;
+}
+
+error_code_t QwiicScale::setMainsRejection(uint8_t mains_hz, float width_hz)
+{
+  if (notch == NULL) {
+    return SCALE_NO_NOTCH_ERROR;
+  }
+
+  if (mains_hz && isInterleaving()) {
+    return SCALE_NOTCH_INTERLEAVE_ERROR;
+  }
+
+  mainsFrequency = mains_hz;
+  mainsNotchWidth = width_hz;
+  if (mains_hz == 0)
+  {
+    notch->setSectionCount(0);
+    return SCALE_OK;
+  }
+  return tuneNotch();
+}
+
+//Notches for the rate the NAU7802 is configured for
+error_code_t QwiicScale::tuneNotch()
+{
+  float sps;
+  error_code_t err = getSamplesPerSecond(&sps);
+  if (err)
+    return err;
+
+  biquadMainsNotches(notch, mainsFrequency, sps, mainsNotchWidth);
+  return SCALE_OK;
+}
+
+//Thresholds and results are converted between weight units and counts with the current calibration
+error_code_t QwiicScale::beginDynamicWeighing(DynamicWeigherBase *weigher, float entry_threshold, float exit_threshold,
+                                              uint16_t window_size, uint8_t debounce)
+{
+  if (!isCalibrated) {
+    return SCALE_NOT_CALIBRATED_ERROR;
+  }
+
+  weigher->configure(zeroOffset, (int32_t)(entry_threshold * calibrationFactor),
+                     (int32_t)(exit_threshold * calibrationFactor), window_size, debounce);
+  dynamicWeigher = weigher;
+  return SCALE_OK;
+}
+
+error_code_t QwiicScale::getDynamicWeight(dynamic_weight_t *result, bool *ready)
+{
+  dynamic_weight_raw_t raw;
+
+  *ready = false;
+  if (dynamicWeigher == NULL) {
+    return SCALE_NO_WEIGHER_ERROR;
+  }
+
+  if (!dynamicWeigher->readResult(&raw)) {
+    return SCALE_OK;
+  }
+
+  error_code_t err = getWeight(&result->weight, raw.reading);
+  if (err) {
+    return err;
+  }
+
+  result->noise = raw.noise / fabs(calibrationFactor);
+  result->windowStart = raw.windowStart;
+  result->windowLength = raw.windowLength;
+  result->itemSamples = raw.itemSamples;
+  result->entryTime = raw.entryTime;
+  result->exitTime = raw.exitTime;
+  result->overflow = raw.overflow;
+  *ready = true;
+  return SCALE_OK;
+}
+
+error_code_t QwiicScale::beginClassification(SequentialClassifier *newClassifier)
+{
+  if (!isCalibrated) {
+    return SCALE_NOT_CALIBRATED_ERROR;
+  }
+
+  newClassifier->restart();
+  classifier = newClassifier;
+  return SCALE_OK;
+}
+
+error_code_t QwiicScale::getClassification(classification_t *result, bool *ready)
+{
+  if (classifier == NULL) {
+    *ready = false;
+    return SCALE_NO_CLASSIFIER_ERROR;
+  }
+
+  *result = classifier->getResult();
+  *ready = classifier->isDecided();
+  return SCALE_OK;
+}
+
+error_code_t QwiicScale::getFlowRate(float *rate, float *uncertainty)
+{
+  float raw_rate, raw_uncertainty;
+
+  if (flowEstimator == NULL) {
+    return SCALE_NO_FLOW_ESTIMATOR_ERROR;
+  }
+
+  if (!isCalibrated) {
+    return SCALE_NOT_CALIBRATED_ERROR;
+  }
+
+  if (!flowEstimator->getRate(&raw_rate, &raw_uncertainty)) {
+    return SCALE_FLOW_RATE_NOT_READY_ERROR;
+  }
+
+  *rate = raw_rate / calibrationFactor;
+  if (uncertainty != NULL)
+    *uncertainty = raw_uncertainty / fabs(calibrationFactor);
+  return SCALE_OK;
+}
+
+error_code_t QwiicScale::startDose(float target)
+{
+  if (dosingController == NULL) {
+    return SCALE_NO_DOSING_CONTROLLER_ERROR;
+  }
+
+  if (!isCalibrated) {
+    return SCALE_NOT_CALIBRATED_ERROR;
+  }
+
+  if (flowEstimator == NULL) {
+    return SCALE_NO_FLOW_ESTIMATOR_ERROR;
+  }
+
+  dosingController->start(target);
+  return SCALE_OK;
+}
+
+error_code_t QwiicScale::abortDose()
+{
+  if (dosingController == NULL) {
+    return SCALE_NO_DOSING_CONTROLLER_ERROR;
+  }
+
+  dosingController->abort();
+  return SCALE_OK;
+}
+
+error_code_t QwiicScale::getDose(Dose_State *state, dose_result_t *result)
+{
+  if (dosingController == NULL) {
+    return SCALE_NO_DOSING_CONTROLLER_ERROR;
+  }
+
+  *state = dosingController->getState();
+  *result = dosingController->getResult();
   return SCALE_OK;
 }
 
@@ -148,13 +838,36 @@ error_code_t QwiicScale::readCalibration(void)
 //Record the current system settings to EEPROM
 void QwiicScale::storeCalibration(void)
 {
-  if (useEEPROM){
+  if (useEEPROM && deferEEPROM){
+      //Take a snapshot now, serviceEEPROM() commits it later
+      memcpy(eepromPending, &calibrationFactor, sizeof(float));
+      memcpy(eepromPending + sizeof(float), &zeroOffset, sizeof(int32_t));
+      eepromPendingIndex = 0;
+  }
+  else if (useEEPROM){
       //Get various values from the library and commit them to NVM
       EEPROM.put(calFactorLocation, getCalibrationFactor());
       EEPROM.put(zeroOffsetLocation, getZeroOffset());
   }
 }
 
+//Write one pending calibration byte. Unchanged bytes are skipped without an EEPROM write cycle.
+bool QwiicScale::serviceEEPROM(void)
+{
+  if (!isEEPROMPending())
+    return false;
+
+  int location;
+  if (eepromPendingIndex < sizeof(float))
+    location = calFactorLocation + eepromPendingIndex;
+  else
+    location = zeroOffsetLocation + (eepromPendingIndex - sizeof(float));
+
+  EEPROM.update(location, eepromPending[eepromPendingIndex]);
+  eepromPendingIndex++;
+  return isEEPROMPending();
+}
+
 void QwiicScale::readEEPROM(float* cal_factor, long *offset) {
 
   EEPROM.get(calFactorLocation, *cal_factor);
@@ -3,6 +3,17 @@
 #include <Arduino.h>
 #include <EEPROM.h>
 #include "NAU7802.h"
+#include "DynamicWeigher.h"
+#include "SequentialClassifier.h"
+#include "FlowRateEstimator.h"
+#include "DosingController.h"
+#include "CaptureEngine.h"
+#include "BiquadCascade.h"
+#include "VibrationCanceller.h"
+#include "ExcitationCompensator.h"
+#include "TemperatureCompensator.h"
+#include "CreepCompensator.h"
+#include "AcquisitionHub.h"
 
 /* This class improves the error handling of the NAU7802 class from which it inherits.
   It overloads certain methods to provide unambiguous error information. These new methods require
@@ -14,16 +25,210 @@
 #define SCALE_EEPROM_READ_CAL_ERROR       -1001
 #define SCALE_EEPROM_READ_OFFSET_ERROR    -1002
 #define SCALE_NOT_CALIBRATED_ERROR        -1003
+#define SCALE_NO_WEIGHER_ERROR            -1004
+#define SCALE_NO_CLASSIFIER_ERROR         -1005
+#define SCALE_NO_FLOW_ESTIMATOR_ERROR     -1006
+#define SCALE_FLOW_RATE_NOT_READY_ERROR   -1007
+#define SCALE_NO_DOSING_CONTROLLER_ERROR  -1008
+#define SCALE_NO_CAPTURE_ENGINE_ERROR     -1009
+#define SCALE_NO_BIQUAD_ERROR             -1010
+#define SCALE_NO_NOTCH_ERROR              -1011
+#define SCALE_INVALID_SAMPLE_RATE_ERROR   -1012
+#define SCALE_NO_TEMPERATURE_ERROR        -1013
+#define SCALE_NO_CREEP_COMPENSATOR_ERROR  -1014
+#define SCALE_NO_HUB_ERROR                -1015
+#define SCALE_CONFIG_RESTORED_ERROR       -1016
+#define SCALE_NOTCH_INTERLEAVE_ERROR      -1017
+
+#define SCALE_HUB_TIMEOUT_MS  1000  //Longest wait for one conversion in getHubAverage(), e.g. across an AFE recalibration
+
+//Inputs that update() interleaves with channel 1
+typedef enum
+{
+  SCALE_SOURCE_CHANNEL_1 = 0,   //Load cell, the weighing input
+  SCALE_SOURCE_CHANNEL_2,       //Reference input
+  SCALE_SOURCE_TEMPERATURE,     //Internal temperature sensor, converted at gain x1
+} Scale_Source;
+
+//Result of one item weighed in motion, see beginDynamicWeighing()
+typedef struct
+{
+  float weight;             //Mean weight over the flattest window
+  float noise;              //Standard deviation over that window, in weight units
+  uint16_t windowStart;     //First sample of the window, counted from item entry
+  uint16_t windowLength;    //Samples averaged
+  uint16_t itemSamples;     //Samples the item was on the platform
+  uint32_t entryTime;       //micros() when the item arrived
+  uint32_t exitTime;        //micros() when the item left
+  bool overflow;            //Item stayed longer than the weigher buffer
+} dynamic_weight_t;
 
 class QwiicScale : public NAU7802
 {
   public:
 
     QwiicScale(){};
-    error_code_t calculateZeroOffset(uint8_t average_size = 64);
+    //empty_platform marks a zero calibration with nothing on the platform, which the temperature
+    //compensator learns zero drift from. Other tares, e.g. of a container, only move the zero.
+    error_code_t calculateZeroOffset(uint8_t average_size = 64, bool empty_platform = false);
     error_code_t calculateCalibrationFactor(float calibration_weight, uint8_t average_size = 64);
     error_code_t getAverageWeight(float *average_weight, uint8_t average_size = 8,  bool allow_negative = true);
 
+    //Convert a reading that was already acquired (e.g. by a scheduler task) to weight
+    error_code_t getWeight(float *weight, int32_t reading, bool allow_negative = true);
+
+    //Poll the ADC once. If a conversion is ready it is read, timestamped and passed to the attached
+    //per-sample consumers. Call at least as often as the sample rate to see every conversion.
+    //reading is the conversion after the filter stages.
+    //If the NAU7802 stops answering, update() returns the I2C error once and then
+    //NAU7802_NOT_CONNECTED_ERROR while it reconnects without blocking (see
+    //NAU7802::serviceConnection()); a running dose is aborted. Conversions resume by themselves
+    //and getReconnectCount() tells consumers that there was a gap.
+    error_code_t update(bool *newSample = NULL, int32_t *reading = NULL);
+    //Feed a conversion that was read elsewhere through the filter stages to the per-sample consumers
+    void processSample(int32_t reading, uint32_t timestamp_us);
+    const int32_t getLastReading(){return lastReading;};
+    //The last conversion as read from the ADC, before the filter stages
+    const int32_t getLastRawReading(){return lastRawReading;};
+    const uint32_t getLastSampleTime(){return lastSampleTime;};
+
+    //Publish every channel 1 conversion to a hub shared by several consumers. While a hub is attached
+    //the blocking averages (tare, calibration, getAverageWeight(), getPrimaryAverage() and with it the
+    //get_average_reading and get_statistics methods) read their conversions from it, pumping
+    //update(), instead of from the ADC directly.
+    void attachHub(AcquisitionHubBase *acquisitionHub){hub = acquisitionHub;};
+    void detachHub(){hub = NULL;};
+    AcquisitionHubBase *getHub(){return hub;};
+    //Blocking average of the next average_size conversions published to the hub, of the primary values
+    //(before temperature compensation and filtering) or of the filtered readings. Times out when no
+    //conversion arrives for SCALE_HUB_TIMEOUT_MS. The readings are added to stats if given.
+    error_code_t getHubAverage(int32_t *average_reading, uint8_t average_size, bool filtered = false,
+                               SampleStatistics *stats = NULL);
+    //Blocking average of channel 1 before temperature compensation, the value tare and calibration
+    //use. Through the hub when one is attached; otherwise the input is switched back to channel 1 and
+    //settled first and a running fill is aborted. The readings are added to stats if given.
+    error_code_t getPrimaryAverage(int32_t *average_reading, uint8_t average_size, SampleStatistics *stats = NULL);
+    //Temperature and creep corrections getAverageWeight() applies to a primary average
+    int32_t compensatePrimary(int32_t average_reading);
+
+    //Interleaved acquisition. After every primary_samples channel 1 conversions update() switches the
+    //input to channel 2, discards settle_samples conversions taken while the input settles, passes
+    //one channel 2 conversion to processReference() and switches back, again discarding
+    //settle_samples. newSample is only set for channel 1 conversions. The gaps leave channel 1 unevenly
+    //sampled, so it fails with SCALE_NOTCH_INTERLEAVE_ERROR while mains rejection is on.
+    error_code_t beginInterleave(uint8_t primary_samples, uint8_t settle_samples = 2);
+    error_code_t endInterleave();
+    bool isInterleaving(){return interleavePeriod > 0;};
+    //Feed a channel 2 conversion that was read elsewhere to the reference consumers
+    void processReference(int32_t reading, uint32_t timestamp_us);
+    const int32_t getLastReference(){return lastReference;};
+    const uint32_t getLastReferenceTime(){return lastReferenceTime;};
+
+    //Adaptive vibration cancellation from the channel 2 reference, applied before the filter stages
+    void attachCanceller(VibrationCancellerBase *canceller){vibrationCanceller = canceller;};
+    void detachCanceller(){vibrationCanceller = NULL;};
+    VibrationCancellerBase *getCanceller(){return vibrationCanceller;};
+
+    //Ratiometric excitation drift correction from the channel 2 reference. Applied to every channel 1
+    //conversion ahead of the other stages and to the averages taken for tare and calibration, so
+    //zeroOffset and calibrationFactor are relative to the compensator's nominal reference.
+    void attachExcitationCompensator(ExcitationCompensator *compensator){excitationCompensator = compensator;};
+    void detachExcitationCompensator(){excitationCompensator = NULL;};
+    ExcitationCompensator *getExcitationCompensator(){return excitationCompensator;};
+
+    //Temperature sampling. After every interval_samples channel 1 conversions update() switches to the
+    //internal temperature sensor at gain x1, passes one conversion to processTemperature() and restores
+    //the input and gain, discarding settle conversions as for channel 2. The attached compensator
+    //corrects zero and span drift and learns its coefficients from empty-platform calculateZeroOffset()
+    //and from calculateCalibrationFactor(). When the temperature has moved past its recalibration threshold,
+    //update() recalibrates the AFE without blocking, returning no samples until it is done.
+    void attachTemperatureCompensator(TemperatureCompensator *compensator){temperatureCompensator = compensator;};
+    void detachTemperatureCompensator(){temperatureCompensator = NULL;};
+    TemperatureCompensator *getTemperatureCompensator(){return temperatureCompensator;};
+    error_code_t beginTemperatureSampling(uint16_t interval_samples);
+    error_code_t endTemperatureSampling();
+    //Feed a temperature sensor conversion that was read elsewhere to the compensator
+    void processTemperature(int32_t reading);
+    error_code_t getTemperature(float *celsius);
+    bool isRecalibratingAFE(){return afeRecalibrating;};
+
+    //Configuration integrity check. While enabled, update() uses the polls between conversions to
+    //compare a register snapshot with the configuration the driver expects (see NAU7802::diffSnapshot()),
+    //as often as bus_bytes_per_second allows, e.g. once a second for NAU7802_SNAPSHOT_BUS_BYTES. On a
+    //mismatch, e.g. after a brown-out reset the NAU7802 to its defaults, the configuration and AFE
+    //calibration are written back, the settle conversions are discarded and update() returns
+    //SCALE_CONFIG_RESTORED_ERROR once, so that averages spanning the fault are reported, not used.
+    error_code_t beginIntegrityCheck(uint16_t bus_bytes_per_second = NAU7802_SNAPSHOT_BUS_BYTES);
+    void endIntegrityCheck(){integrityPeriod = 0;};
+    uint32_t getIntegrityPeriod(){return integrityPeriod;};
+    //Check now, restoring the configuration on a mismatch
+    error_code_t checkIntegrity();
+    uint16_t getIntegrityFaults(){return integrityFaults;};
+    //Registers that differed at the last fault, bit n for register n
+    uint32_t getLastMismatch(){return lastMismatch;};
+
+    //Creep correction for long static loads, applied to every channel 1 conversion after the
+    //excitation and temperature corrections and to getAverageWeight(). Restarted by calculateZeroOffset().
+    void attachCreepCompensator(CreepCompensator *compensator){creepCompensator = compensator;};
+    void detachCreepCompensator(){creepCompensator = NULL;};
+    CreepCompensator *getCreepCompensator(){return creepCompensator;};
+
+    //Fixed-point IIR filter stage applied to every conversion before the consumers below, except the
+    //capture engine, which records the unfiltered waveform
+    void attachBiquad(BiquadCascadeBase *cascade){biquad = cascade;};
+    void detachBiquad(){biquad = NULL;};
+    BiquadCascadeBase *getBiquad(){return biquad;};
+
+    //Mains hum rejection ahead of the biquad stage. Each section of the notch cascade removes one
+    //harmonic of mains_hz at the frequency it aliases to at the configured sample rate, e.g. 30 Hz
+    //and 20 Hz for 50 Hz mains at 80 SPS. Harmonics that alias to DC are left to the ADC's own sinc
+    //filter. mains_hz 0 bypasses the notches. Retuned by setSampleRate(). The notches assume channel 1
+    //is converted at the nominal rate: turning them on while interleaving fails with
+    //SCALE_NOTCH_INTERLEAVE_ERROR. Temperature conversions leave a gap of a few conversions, rare
+    //enough to keep the nominal tuning; the notches ring for about 1 / width_hz seconds after each.
+    void attachNotch(BiquadCascadeBase *cascade){notch = cascade;};
+    void detachNotch(){notch = NULL;};
+    BiquadCascadeBase *getNotch(){return notch;};
+    error_code_t setMainsRejection(uint8_t mains_hz, float width_hz = 2.0f);
+    uint8_t getMainsFrequency(){return mainsFrequency;};
+    float getMainsNotchWidth(){return mainsNotchWidth;};
+
+    //As NAU7802::setSampleRate(), and retunes the mains notches
+    error_code_t setSampleRate(uint8_t rate);
+    //Nominal conversions per second of the configured rate
+    error_code_t getSamplesPerSecond(float *sps);
+
+    //Dynamic (in-motion) weighing on every conversion. Thresholds are in calibrated units above zero.
+    //The weigher buffer must hold the samples of one item, e.g. DynamicWeigher<128> for 300ms at 320 SPS.
+    error_code_t beginDynamicWeighing(DynamicWeigherBase *weigher, float entry_threshold, float exit_threshold,
+                                      uint16_t window_size, uint8_t debounce = 2);
+    void endDynamicWeighing(){dynamicWeigher = NULL;};
+    error_code_t getDynamicWeight(dynamic_weight_t *result, bool *ready);
+
+    //Below/within/above tolerance decision with a sequential probability ratio test on every conversion.
+    //Configure the classifier first; each call to beginClassification() starts a new item.
+    error_code_t beginClassification(SequentialClassifier *classifier);
+    void endClassification(){classifier = NULL;};
+    error_code_t getClassification(classification_t *result, bool *ready);
+
+    //Flow rate (dW/dt) from a least-squares fit over the last conversions, in weight units per second
+    void attachFlowEstimator(FlowRateEstimatorBase *estimator){flowEstimator = estimator;};
+    void detachFlowEstimator(){flowEstimator = NULL;};
+    error_code_t getFlowRate(float *rate, float *uncertainty = NULL);
+
+    //On-device dosing to a target weight. The valve GPIO is switched from processSample(), so the
+    //cutoff does not depend on host latency. Needs an attached flow estimator. update() closes the
+    //valve on the fill and stall timeouts even without conversions; a blocking average that does not
+    //go through a hub aborts the fill, as its conversions never reach the controller.
+    void attachDosingController(DosingController *controller){dosingController = controller;};
+    error_code_t startDose(float target);
+    error_code_t abortDose();
+    error_code_t getDose(Dose_State *state, dose_result_t *result);
+
+    //Triggered capture of raw conversions around an event. Arm and read it through getCaptureEngine().
+    void attachCaptureEngine(CaptureEngineBase *engine){captureEngine = engine;};
+    CaptureEngineBase *getCaptureEngine(){return captureEngine;};
+
     //Pass a known calibration factor into library. Helpful if users is loading settings from NVM.
     void setCalibrationFactor(float newCalFactor){calibrationFactor = newCalFactor;};
     const float getCalibrationFactor(){return calibrationFactor;};
@@ -39,7 +244,13 @@ class QwiicScale : public NAU7802
     bool useEEPROM = true;
     void storeCalibration(void);
     error_code_t readCalibration(void);
-    void QwiicScale::readEEPROM(float* cal_factor, long *offset);
+    void readEEPROM(float* cal_factor, long *offset);
+
+    // Deferred storage. When set, storeCalibration() only queues the values and serviceEEPROM()
+    // writes them one byte per call so that a scheduler loop is not blocked for ~27ms.
+    bool deferEEPROM = false;
+    bool serviceEEPROM(void); //Writes the next pending byte. Returns true while bytes remain.
+    bool isEEPROMPending(void) {return eepromPendingIndex < sizeof(eepromPending);}
 
     // Flag to indicate whether settings were read from eeprom. Note: May not be valid.
     bool calibrationDetected = false;
@@ -58,5 +269,61 @@ class QwiicScale : public NAU7802
     //y = mx + b
     float calibrationFactor = 1.0f; //This is m.
     int32_t zeroOffset = 0;      //This is b
+
+    int32_t lastReading = 0;
+    int32_t lastRawReading = 0;
+    uint32_t lastSampleTime = 0;
+
+    error_code_t tuneNotch();
+    error_code_t selectSource(Scale_Source next);
+    error_code_t readPrimaryAverage(int32_t *average_reading, uint8_t average_size, SampleStatistics *stats);
+    error_code_t pollConversion(bool *newSample, int32_t *reading);
+    error_code_t serviceReconnection();
+    void disconnected();
+    error_code_t serviceRecalibration();
+    error_code_t serviceIntegrityCheck();
+
+    //Interleaved acquisition, see beginInterleave()
+    Scale_Source source = SCALE_SOURCE_CHANNEL_1;
+    uint8_t interleavePeriod = 0;     //Channel 1 conversions between channel 2 conversions, 0 for none
+    uint8_t interleaveSettle = 2;
+    uint8_t primaryCount = 0;
+    uint8_t settleRemaining = 0;
+    int32_t lastReference = 0;
+    uint32_t lastReferenceTime = 0;
+    VibrationCancellerBase *vibrationCanceller = NULL;
+    ExcitationCompensator *excitationCompensator = NULL;
+
+    //Temperature sampling, see beginTemperatureSampling()
+    uint16_t temperatureInterval = 0;  //Channel 1 conversions between temperature conversions, 0 for none
+    uint16_t temperatureCount = 0;
+    uint8_t savedGain = NAU7802_GAIN_128;
+    bool afeRecalibrating = false;
+    TemperatureCompensator *temperatureCompensator = NULL;
+    CreepCompensator *creepCompensator = NULL;
+
+    //Configuration integrity check, see beginIntegrityCheck()
+    uint32_t integrityPeriod = 0;     //Milliseconds between checks, 0 for none
+    uint32_t integrityTime = 0;       //millis() of the last check
+    uint16_t integrityFaults = 0;
+    uint32_t lastMismatch = 0;
+
+    //Filter stages, NULL when not in use
+    BiquadCascadeBase *notch = NULL;
+    BiquadCascadeBase *biquad = NULL;
+    uint8_t mainsFrequency = 0;
+    float mainsNotchWidth = 2.0f;
+
+    //Per-sample consumers, NULL when not in use
+    AcquisitionHubBase *hub = NULL;
+    DynamicWeigherBase *dynamicWeigher = NULL;
+    SequentialClassifier *classifier = NULL;
+    FlowRateEstimatorBase *flowEstimator = NULL;
+    DosingController *dosingController = NULL;
+    CaptureEngineBase *captureEngine = NULL;
+
+    //Snapshot of calFactor followed by zeroOffset waiting to be written by serviceEEPROM()
+    uint8_t eepromPending[sizeof(float) + sizeof(int32_t)];
+    uint8_t eepromPendingIndex = sizeof(eepromPending);
 };
 #endif //QWIIC_SCALE_H
@@ -0,0 +1,257 @@
+#ifndef SAMPLE_PIPELINE_H
+#define SAMPLE_PIPELINE_H
+#include <Arduino.h>
+#include "BiquadCascade.h"
+#include "SampleStorage.h"
+
+/* Per-sample filter chain composed at compile time, e.g.
+
+    Pipeline<Median<5>, Biquad<2>, Boxcar<16>, Units> Filter;
+    ...
+    if (Scale.update(&new_sample, &reading) == SCALE_OK && new_sample)
+      weight_cg = Filter.process(reading);
+
+  Each stage is a class with int32_t process(int32_t) and void reset(). Pipeline<A, B, C> holds one
+  of each by value and process() calls them in order, so the chain is resolved by the compiler into
+  one function with no virtual calls and no heap, and a sketch only pays for the stages it names.
+  Stages are reached with Filter.stage<I>() to configure them, e.g. Filter.stage<1>().setSection(...).
+  User-defined stages only need the two methods.
+
+  Everything is integer; Units converts counts to fixed-point weight units at the end of the chain.
+  The Biquad stage wraps BiquadCascade, whose filter() lives in BiquadCascade.cpp. Median and Boxcar
+  take a storage policy, e.g. Boxcar<64, Packed24Storage>, to keep their history in 3 bytes a sample.*/
+
+//Running median of the last N readings, rejecting spikes shorter than N / 2 samples.
+//Costs O(N) per sample, 8N bytes or 6N with Packed24Storage.
+template <uint8_t N, typename Storage = Int32Storage>
+class Median
+{
+  static_assert((N & 1) && (N >= 3), "Median window must be odd and at least 3");
+
+  public:
+    Median() {reset();}
+
+    void reset() {count = 0; head = 0;}
+
+    int32_t process(int32_t reading)
+    {
+      const uint8_t W = Storage::BYTES;
+      uint8_t i;
+
+      //Drop the oldest reading from the sorted copy, then insert the new one in order. Both are
+      //compared as stored, so a clamped reading still matches its sorted copy.
+      if (count == N)
+      {
+        int32_t oldest = Storage::load(&window[head * W]);
+        for (i = 0; Storage::load(&sorted[i * W]) != oldest; i++)
+          continue;
+        memmove(&sorted[i * W], &sorted[(i + 1) * W], (count - 1 - i) * W);
+        count--;
+      }
+      Storage::store(&window[head * W], reading);
+      reading = Storage::load(&window[head * W]);
+      head = (head + 1 < N) ? head + 1 : 0;
+
+      for (i = count; (i > 0) && (Storage::load(&sorted[(i - 1) * W]) > reading); i--)
+        continue;
+      memmove(&sorted[(i + 1) * W], &sorted[i * W], (count - i) * W);
+      Storage::store(&sorted[i * W], reading);
+      count++;
+
+      return Storage::load(&sorted[(count / 2) * W]);
+    }
+
+  private:
+    uint8_t window[N * Storage::BYTES];   //Readings in arrival order
+    uint8_t sorted[N * Storage::BYTES];   //The same readings in ascending order
+    uint8_t count;
+    uint8_t head;
+};
+
+//Fixed-point IIR cascade, see BiquadCascade. Passes readings through until sections are set.
+template <uint8_t SECTIONS>
+class Biquad : public BiquadCascade<SECTIONS>
+{
+  public:
+    int32_t process(int32_t reading) {return this->filter(reading);}
+};
+
+//Moving average of the last N readings, rounded to the nearest count. Averages what it has until
+//the window is full.
+template <uint8_t N, typename Storage = Int32Storage>
+class Boxcar
+{
+  static_assert((N >= 1) && (N <= 128), "Boxcar sum of 24-bit readings must fit in 32 bits");
+
+  public:
+    Boxcar() {reset();}
+
+    void reset() {count = 0; head = 0; total = 0;}
+
+    int32_t process(int32_t reading)
+    {
+      uint8_t *slot = &window[head * Storage::BYTES];
+      if (count == N)
+        total -= Storage::load(slot);
+      else
+        count++;
+      Storage::store(slot, reading);
+      total += Storage::load(slot);
+      head = (head + 1 < N) ? head + 1 : 0;
+
+      int32_t half = count / 2;
+      return (total >= 0) ? (total + half) / count : (total - half) / count;
+    }
+
+  private:
+    uint8_t window[N * Storage::BYTES];
+    int32_t total;
+    uint8_t count;
+    uint8_t head;
+};
+
+//Subtracts the zero and keeps it tracking slow drift: while the output stays within band counts of
+//zero, the zero moves towards the reading by 1/2^SHIFT per sample. Loads outside the band are not
+//tracked, so an item left on the platform is not zeroed away unless it is within the band.
+template <uint8_t SHIFT = 6>
+class ZeroTrack
+{
+  public:
+    void setZero(int32_t zero_offset) {zero = (int64_t)zero_offset << SHIFT;}
+    int32_t getZero() {return (int32_t)(zero >> SHIFT);}
+    void setBand(int32_t counts) {band = counts;}
+
+    void reset() {}
+
+    int32_t process(int32_t reading)
+    {
+      int32_t net = reading - getZero();
+      if ((net <= band) && (net >= -band))
+        zero += net;
+      return net;
+    }
+
+  private:
+    int64_t zero = 0;     //Zero in counts / 2^SHIFT, so the fractional part of each step is kept
+    int32_t band = 0;
+};
+
+//Piecewise-linear correction through POINTS (input, output) pairs with ascending inputs, for load
+//cell non-linearity measured with reference weights. Readings beyond the table follow the end segments.
+template <uint8_t POINTS>
+class Linearize
+{
+  static_assert(POINTS >= 2, "Linearize needs at least two points");
+
+  public:
+    Linearize()
+    {
+      for (uint8_t i = 0; i < POINTS; i++)
+        setPoint(i, i, i);
+    }
+
+    //Returns false if index is beyond the table
+    bool setPoint(uint8_t index, int32_t input, int32_t output)
+    {
+      if (index >= POINTS)
+        return false;
+      inputs[index] = input;
+      outputs[index] = output;
+      return true;
+    }
+
+    void reset() {}
+
+    int32_t process(int32_t reading)
+    {
+      uint8_t i = 1;
+      while ((i < POINTS - 1) && (reading > inputs[i]))
+        i++;
+
+      int32_t span = inputs[i] - inputs[i - 1];
+      if (span == 0)
+        return outputs[i];
+      int64_t step = (int64_t)(reading - inputs[i - 1]) * (outputs[i] - outputs[i - 1]);
+      return outputs[i - 1] + (int32_t)(step / span);
+    }
+
+  private:
+    int32_t inputs[POINTS];
+    int32_t outputs[POINTS];
+};
+
+//(reading - offset) * unitsPerCount in Q16.16, rounded, e.g. centigrams for unitsPerCount =
+//100 / calibrationFactor. Put ZeroTrack ahead of it to have the zero tracked instead of fixed.
+class Units
+{
+  public:
+    void setScale(float units_per_count, int32_t offset = 0)
+    {
+      scale = (int32_t)lround(units_per_count * 65536.0f);
+      this->offset = offset;
+    }
+
+    void reset() {}
+
+    int32_t process(int32_t reading)
+    {
+      int64_t product = (int64_t)(reading - offset) * scale;
+      return (int32_t)((product + 0x8000) >> 16);
+    }
+
+  private:
+    int32_t scale = 65536;
+    int32_t offset = 0;
+};
+
+template <typename... Stages>
+class Pipeline;
+
+template <uint8_t I, typename P>
+struct PipelineStage;
+
+//End of the chain
+template <>
+class Pipeline<>
+{
+  public:
+    void reset() {}
+    int32_t process(int32_t reading) {return reading;}
+};
+
+template <typename First, typename... Rest>
+class Pipeline<First, Rest...> : public Pipeline<Rest...>
+{
+  public:
+    void reset()
+    {
+      first.reset();
+      Pipeline<Rest...>::reset();
+    }
+
+    int32_t process(int32_t reading) {return Pipeline<Rest...>::process(first.process(reading));}
+
+    //The stage at position I, counted from 0
+    template <uint8_t I>
+    typename PipelineStage<I, Pipeline>::type &stage() {return PipelineStage<I, Pipeline>::get(*this);}
+
+  private:
+    template <uint8_t, typename> friend struct PipelineStage;
+    First first;
+};
+
+template <typename First, typename... Rest>
+struct PipelineStage<0, Pipeline<First, Rest...> >
+{
+  typedef First type;
+  static type &get(Pipeline<First, Rest...> &pipeline) {return pipeline.first;}
+};
+
+template <uint8_t I, typename First, typename... Rest>
+struct PipelineStage<I, Pipeline<First, Rest...> >
+{
+  static_assert(I <= sizeof...(Rest), "Pipeline stage index out of range");
+  typedef typename PipelineStage<I - 1, Pipeline<Rest...> >::type type;
+  static type &get(Pipeline<First, Rest...> &pipeline) {return PipelineStage<I - 1, Pipeline<Rest...> >::get(pipeline);}
+};
+#endif //SAMPLE_PIPELINE_H
@@ -0,0 +1,33 @@
+#include <Arduino.h>
+#include "SampleStatistics.h"
+
+void SampleStatistics::reset()
+{
+  count = 0;
+  origin = 0;
+  mean = 0;
+  m2 = 0;
+  minimum = 0;
+  maximum = 0;
+}
+
+void SampleStatistics::add(int32_t reading)
+{
+  if (count == 0)
+  {
+    origin = reading;
+    minimum = reading;
+    maximum = reading;
+  }
+
+  if (reading < minimum)
+    minimum = reading;
+  if (reading > maximum)
+    maximum = reading;
+
+  float x = reading - origin;
+  count++;
+  float delta = x - mean;
+  mean += delta / count;
+  m2 += delta * (x - mean);
+}
@@ -0,0 +1,32 @@
+#ifndef SAMPLE_STATISTICS_H
+#define SAMPLE_STATISTICS_H
+#include <Arduino.h>
+
+/* Single-pass statistics of a window of raw readings: count, mean, min, max, variance and
+  peak-to-peak. The variance uses Welford's update on readings taken relative to the first one,
+  so float keeps full 24-bit resolution even when the readings are far from zero.*/
+class SampleStatistics
+{
+  public:
+    SampleStatistics() {reset();};
+
+    void reset();
+    void add(int32_t reading);
+
+    uint16_t getCount() {return count;}
+    float getMean() {return origin + mean;}
+    int32_t getMin() {return minimum;}
+    int32_t getMax() {return maximum;}
+    int32_t getPeakToPeak() {return count ? maximum - minimum : 0;}
+    float getVariance() {return (count > 1) ? m2 / (count - 1) : 0;} //Sample variance
+    float getStdDev() {return sqrt(getVariance());}
+
+  private:
+    uint16_t count;
+    int32_t origin;
+    float mean;      //Relative to origin
+    float m2;        //Sum of squared deviations from the mean
+    int32_t minimum;
+    int32_t maximum;
+};
+#endif //SAMPLE_STATISTICS_H
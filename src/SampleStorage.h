@@ -0,0 +1,114 @@
+#ifndef SAMPLE_STORAGE_H
+#define SAMPLE_STORAGE_H
+#include <Arduino.h>
+
+/* Storage policies for sample history buffers, chosen by template parameter, e.g.
+  CaptureEngine<256, Packed24Storage>. Conversions are 24-bit, so Packed24Storage keeps them in
+  3 bytes instead of 4 without losing anything and fits a third more history in the same RAM.
+  Values outside the 24-bit range, e.g. sums, are clamped when packed.
+
+  Templates use the policy's load() and store() directly. The non-template classes that use a buffer
+  see it through a SampleBuffer, which knows the width.
+  Random access multiplies the index by the width; SampleIterator walks a buffer, or a ring that
+  wraps at the end of it, by moving a pointer, which is the cheaper way to unpack in order.
+  Samples are stored little-endian, the byte order of AVR, ARM and x86.*/
+
+#define SAMPLE_INT24_MAX  8388607L
+#define SAMPLE_INT24_MIN  (-8388608L)
+
+//4 bytes per sample, no conversion
+struct Int32Storage
+{
+  static const uint8_t BYTES = 4;
+
+  static int32_t load(const uint8_t *p)
+  {
+    int32_t value;
+    memcpy(&value, p, 4);   //The buffer is a byte array and may not be aligned
+    return value;
+  }
+
+  static void store(uint8_t *p, int32_t value) {memcpy(p, &value, 4);}
+};
+
+//3 bytes per sample, sign-extended when read
+struct Packed24Storage
+{
+  static const uint8_t BYTES = 3;
+
+  static int32_t load(const uint8_t *p)
+  {
+    union {int32_t value; uint8_t bytes[4];} sample;
+    sample.bytes[0] = p[0];
+    sample.bytes[1] = p[1];
+    sample.bytes[2] = p[2];
+    sample.bytes[3] = (p[2] & 0x80) ? 0xFF : 0x00;
+    return sample.value;
+  }
+
+  static void store(uint8_t *p, int32_t value)
+  {
+    if (value > SAMPLE_INT24_MAX)
+      value = SAMPLE_INT24_MAX;
+    else if (value < SAMPLE_INT24_MIN)
+      value = SAMPLE_INT24_MIN;
+    p[0] = (uint8_t)value;
+    p[1] = (uint8_t)(value >> 8);
+    p[2] = (uint8_t)(value >> 16);
+  }
+};
+
+class SampleBuffer
+{
+  public:
+    SampleBuffer(uint8_t *data, uint8_t width) : data(data), width(width) {};
+
+    uint8_t getWidth() const {return width;}
+    uint8_t *getData() const {return data;}
+    //Address of sample index, e.g. to memmove a run of samples
+    uint8_t *at(uint16_t index) const {return data + (size_t)index * width;}
+
+    int32_t get(uint16_t index) const {return load(at(index));}
+    void set(uint16_t index, int32_t value) {store(at(index), value);}
+
+    int32_t load(const uint8_t *p) const
+    {
+      return (width == Packed24Storage::BYTES) ? Packed24Storage::load(p) : Int32Storage::load(p);
+    }
+
+    void store(uint8_t *p, int32_t value) const
+    {
+      if (width == Packed24Storage::BYTES)
+        Packed24Storage::store(p, value);
+      else
+        Int32Storage::store(p, value);
+    }
+
+  private:
+    uint8_t *data;
+    uint8_t width;
+};
+
+//Reads samples in order from index onwards. With a capacity, the iterator wraps to sample 0 after
+//sample capacity - 1, for reading a ring buffer from its oldest sample.
+class SampleIterator
+{
+  public:
+    SampleIterator(const SampleBuffer &buffer, uint16_t index, uint16_t capacity = 0)
+      : buffer(buffer), p(buffer.at(index)), end(capacity ? buffer.at(capacity) : NULL) {};
+
+    int32_t next()
+    {
+      int32_t value = buffer.load(p);
+      p += buffer.getWidth();
+      if (p == end)
+        p = buffer.getData();
+      return value;
+    }
+
+  private:
+    SampleBuffer buffer;
+    const uint8_t *p;
+    const uint8_t *end;
+};
+#endif //SAMPLE_STORAGE_H
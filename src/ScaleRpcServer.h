@@ -0,0 +1,1340 @@
+#ifndef SCALE_RPC_SERVER_H
+#define SCALE_RPC_SERVER_H
+#include <Arduino.h>
+#include "ArduinoJson.h"
+#include "QwiicScale.h"
+
+/* JSON-RPC server for a QwiicScale. One line of JSON per request and per reply.
+  The server is templated on the stream and scale types so that one MCU can serve several scales on
+  several ports (Serial, Serial1, ...) and so that the protocol can be run against an in-memory stream
+  and a simulated scale on a host. StreamT needs available(), read(), write(const uint8_t*, size_t) and
+  availableForWrite(). ScaleT needs the QwiicScale interface used by the built-in methods.
+
+  None of the calls block on the stream. The owner calls acquire(), filter(), pollRequests() and
+  drainReplies() periodically, typically as separate TaskScheduler tasks. Methods that take several
+  conversions (tare, calibrate, get_average_*) still block inside pollRequests() until done.
+
+  When the scale has an AcquisitionHub attached, filter() takes the conversions from the hub with
+  its own cursor, so the conversions a blocking method averages also reach the stream afterwards,
+  as many as the hub holds. A blocking average longer than the hub overwrites the oldest before
+  filter() runs again; those are counted in getSamplesDropped() and the stream skips them.*/
+
+// jsonrpc error codes
+#define JSONRPC_PARSE_ERROR       -32700
+#define JSONRPC_INVALID_REQUEST   -32600
+#define JSONRPC_METHOD_NOT_FOUND  -32601
+#define JSONRPC_INVALID_PARAMS    -32602
+#define JSONRPC_INTERNAL_ERROR    -32603
+
+//NOTE: Make sure not to collide with error codes defined by NAU7802 and QwiicScale
+#define SCALE_RPC_METHOD_TABLE_FULL_ERROR  -1201
+
+// operation modes
+#define SCALE_RPC_REQUEST     0
+#define SCALE_RPC_CONTINUOUS  1
+#define SCALE_RPC_RAW         2   //Every conversion with its micros() timestamp, for recording traces
+
+// buffer sizes, may be overridden before including this header
+#ifndef SCALE_RPC_MAX_METHODS
+#define SCALE_RPC_MAX_METHODS     28
+#endif
+#ifndef SCALE_RPC_RX_LINE_SIZE
+#define SCALE_RPC_RX_LINE_SIZE    160
+#endif
+#ifndef SCALE_RPC_REQUEST_DOC_SIZE
+#define SCALE_RPC_REQUEST_DOC_SIZE 256  //Parsed request, e.g. set_biquad with 5 coefficients
+#endif
+#ifndef SCALE_RPC_TX_LINE_SIZE
+#define SCALE_RPC_TX_LINE_SIZE    240
+#endif
+#ifndef SCALE_RPC_TX_QUEUE_SIZE
+#define SCALE_RPC_TX_QUEUE_SIZE   320
+#endif
+#ifndef SCALE_RPC_FLUSH_TIMEOUT_MS
+#define SCALE_RPC_FLUSH_TIMEOUT_MS 1000  //Longest flushReplies() waits for the stream to take a byte
+#endif
+#ifndef SCALE_RPC_CAPTURE_CHUNK
+#define SCALE_RPC_CAPTURE_CHUNK   10
+#endif
+#ifndef SCALE_RPC_SAMPLE_FIFO_SIZE
+#define SCALE_RPC_SAMPLE_FIFO_SIZE 8
+#endif
+
+template <typename StreamT, typename ScaleT = QwiicScale>
+class ScaleRpcServer
+{
+  public:
+    //All methods must have this signature. Replies are sent with the send* helpers.
+    typedef void (*Handler)(ScaleRpcServer &server, const unsigned long id, const JsonVariant &params);
+
+    ScaleRpcServer(StreamT &stream, ScaleT &scale, unsigned long serverId = 0, uint8_t streamAverageSize = 8);
+
+    //Register a method. A method that already exists is replaced, so built-ins can be overridden.
+    error_code_t addMethod(const char *name, Handler handler);
+
+    //Poll the scale once and queue a conversion if one is ready
+    error_code_t acquire(bool *newSample = NULL);
+    //Queue a conversion that was read elsewhere
+    void addSample(int32_t reading);
+    //Report an acquisition error to get_sensors and the stream
+    void addSampleError(error_code_t err);
+    //Average queued conversions, or those published to the scale's hub. Streams each completed
+    //average in continuous mode.
+    void filter();
+
+    //Read up to max_chars request characters and handle at most one complete line
+    void pollRequests(uint16_t max_chars = SCALE_RPC_RX_LINE_SIZE);
+    //Parse and dispatch a single request line
+    void handleRequest(const char *request_line);
+    //Write as much of the reply queue as the stream accepts without blocking
+    void drainReplies();
+    //Block until the reply queue is empty, for use before a scheduler is running. Gives up, leaving
+    //the rest queued, when the stream takes nothing for SCALE_RPC_FLUSH_TIMEOUT_MS.
+    void flushReplies();
+
+    //Reply helpers for method handlers
+    void sendReply(const JsonDocument &reply);
+    void sendAck(const unsigned long id);
+    void sendCalibration(const unsigned long id);
+    void sendScaleError(const unsigned long id, error_code_t scale_err);
+    void sendParseError(const DeserializationError &error);
+    void sendInvalidRequest(void);
+    void sendMethodNotFound(const unsigned long id);
+    void sendInvalidParams(const unsigned long id, const __FlashStringHelper *data);
+
+    StreamT &getStream() {return stream;}
+    ScaleT &getScale() {return scale;}
+    unsigned long getServerId() {return serverId;}
+
+    int getMode() {return mode;}
+    void setMode(int newMode) {mode = newMode;}
+    uint8_t getStreamAverageSize() {return streamAverageSize;}
+
+    //Latest completed average, as returned by get_sensors
+    error_code_t getLatestWeight(float *weight, unsigned long *timestamp = NULL);
+
+    uint32_t getTxDropped() {return txDropped;}
+    uint32_t getSamplesDropped() {return samplesDropped;}
+    uint16_t getTxPending() {return txCount;}
+
+  private:
+    static void calibrate(ScaleRpcServer &server, const unsigned long id, const JsonVariant &params);
+    static void tare(ScaleRpcServer &server, const unsigned long id, const JsonVariant &params);
+    static void changeMode(ScaleRpcServer &server, const unsigned long id, const JsonVariant &params);
+    static void resetCalibration(ScaleRpcServer &server, const unsigned long id, const JsonVariant &params);
+    static void getCalibration(ScaleRpcServer &server, const unsigned long id, const JsonVariant &params);
+    static void getAverageReading(ScaleRpcServer &server, const unsigned long id, const JsonVariant &params);
+    static void getAverageWeight(ScaleRpcServer &server, const unsigned long id, const JsonVariant &params);
+    static void getStatistics(ScaleRpcServer &server, const unsigned long id, const JsonVariant &params);
+    static void getStatus(ScaleRpcServer &server, const unsigned long id, const JsonVariant &params);
+    static void getSensors(ScaleRpcServer &server, const unsigned long id, const JsonVariant &params);
+    static void startDose(ScaleRpcServer &server, const unsigned long id, const JsonVariant &params);
+    static void abortDose(ScaleRpcServer &server, const unsigned long id, const JsonVariant &params);
+    static void getDose(ScaleRpcServer &server, const unsigned long id, const JsonVariant &params);
+    static void armCapture(ScaleRpcServer &server, const unsigned long id, const JsonVariant &params);
+    static void triggerCapture(ScaleRpcServer &server, const unsigned long id, const JsonVariant &params);
+    static void getCapture(ScaleRpcServer &server, const unsigned long id, const JsonVariant &params);
+    static void setBiquad(ScaleRpcServer &server, const unsigned long id, const JsonVariant &params);
+    static void getBiquad(ScaleRpcServer &server, const unsigned long id, const JsonVariant &params);
+    static void setMainsFilter(ScaleRpcServer &server, const unsigned long id, const JsonVariant &params);
+    static void getTemperature(ScaleRpcServer &server, const unsigned long id, const JsonVariant &params);
+    static void setTemperatureCompensation(ScaleRpcServer &server, const unsigned long id, const JsonVariant &params);
+    static void setCreep(ScaleRpcServer &server, const unsigned long id, const JsonVariant &params);
+    static void getRegisters(ScaleRpcServer &server, const unsigned long id, const JsonVariant &params);
+
+    void dispatch(const unsigned long id, const char *method, const JsonVariant &params);
+    void streamSensors();
+    void addToAverage(int32_t reading);
+    void streamRaw(int32_t reading, uint32_t timestamp_us);
+    void addSensorFields(JsonObject &result);
+    void addGapMarker(JsonObject &result);
+
+    struct Method
+    {
+      const char *name;
+      Handler handler;
+    };
+
+    StreamT &stream;
+    ScaleT &scale;
+    unsigned long serverId;
+    uint8_t streamAverageSize;
+    int mode = SCALE_RPC_REQUEST;
+
+    Method methods[SCALE_RPC_MAX_METHODS];
+    uint8_t methodCount = 0;
+
+    // conversions handed from acquire() to filter()
+    int32_t sampleFifo[SCALE_RPC_SAMPLE_FIFO_SIZE];
+    uint8_t sampleHead = 0;
+    uint8_t sampleCount = 0;
+    uint32_t samplesDropped = 0;
+    error_code_t sampleError = NAU7802_OK;
+
+    // stream consumer of the scale's acquisition hub, if it has one
+    AcquisitionHubBase *streamHub = NULL;
+    hub_cursor_t streamCursor;
+
+    // latest boxcar result produced by filter()
+    long filterTotal = 0;
+    uint8_t filterCount = 0;
+    float latestWeight = 0;
+    unsigned long latestTimestamp = 0;
+    error_code_t latestError = SCALE_NOT_CALIBRATED_ERROR;
+    bool streamingError = false;
+    uint16_t streamReconnects = 0;   //Scale reconnections already marked in the stream
+
+    // partial request line
+    char rxLine[SCALE_RPC_RX_LINE_SIZE];
+    uint8_t rxLength = 0;
+    bool rxOverflow = false;
+
+    // replies waiting for drainReplies()
+    char txQueue[SCALE_RPC_TX_QUEUE_SIZE];
+    uint16_t txHead = 0;
+    uint16_t txCount = 0;
+    uint32_t txDropped = 0;
+};
+
+template <typename StreamT, typename ScaleT>
+ScaleRpcServer<StreamT, ScaleT>::ScaleRpcServer(StreamT &stream, ScaleT &scale, unsigned long serverId, uint8_t streamAverageSize)
+  : stream(stream), scale(scale), serverId(serverId), streamAverageSize(streamAverageSize)
+{
+  if (this->streamAverageSize == 0)
+    this->streamAverageSize = 1;
+
+  addMethod("tare", tare);
+  addMethod("calibrate", calibrate);
+  addMethod("reset_calibration", resetCalibration);
+  addMethod("get_calibration", getCalibration);
+  addMethod("get_average_weight", getAverageWeight);
+  addMethod("get_average_reading", getAverageReading);
+  addMethod("get_statistics", getStatistics);
+  addMethod("get_status", getStatus);
+  addMethod("get_sensors", getSensors);
+  addMethod("change_mode", changeMode);
+  addMethod("start_dose", startDose);
+  addMethod("abort_dose", abortDose);
+  addMethod("get_dose", getDose);
+  addMethod("arm_capture", armCapture);
+  addMethod("trigger_capture", triggerCapture);
+  addMethod("get_capture", getCapture);
+  addMethod("set_biquad", setBiquad);
+  addMethod("get_biquad", getBiquad);
+  addMethod("set_mains_filter", setMainsFilter);
+  addMethod("get_temperature", getTemperature);
+  addMethod("set_temperature_compensation", setTemperatureCompensation);
+  addMethod("set_creep", setCreep);
+  addMethod("get_registers", getRegisters);
+}
+
+template <typename StreamT, typename ScaleT>
+error_code_t ScaleRpcServer<StreamT, ScaleT>::addMethod(const char *name, Handler handler)
+{
+  for (uint8_t i = 0; i < methodCount; i++)
+  {
+    if (!strcasecmp(methods[i].name, name))
+    {
+      methods[i].handler = handler;
+      return SCALE_OK;
+    }
+  }
+
+  if (methodCount >= SCALE_RPC_MAX_METHODS)
+    return SCALE_RPC_METHOD_TABLE_FULL_ERROR;
+
+  methods[methodCount].name = name;
+  methods[methodCount].handler = handler;
+  methodCount++;
+  return SCALE_OK;
+}
+
+// Dispatches on the requested jsonrpc method
+template <typename StreamT, typename ScaleT>
+void ScaleRpcServer<StreamT, ScaleT>::dispatch(const unsigned long id, const char *method, const JsonVariant &params)
+{
+  for (uint8_t i = 0; i < methodCount; i++)
+  {
+    if (!strcasecmp(methods[i].name, method))
+    {
+      methods[i].handler(*this, id, params);
+      return;
+    }
+  }
+
+  sendMethodNotFound(id);
+}
+
+template <typename StreamT, typename ScaleT>
+void ScaleRpcServer<StreamT, ScaleT>::handleRequest(const char *request_line)
+{
+  StaticJsonDocument<SCALE_RPC_REQUEST_DOC_SIZE> request;
+
+  DeserializationError err = deserializeJson(request, request_line);
+  if (err)
+  {
+    sendParseError(err);
+    return;
+  }
+
+  // Parse the request
+  const char *method = request["method"] | "?";
+  JsonVariant params = request["params"];
+  unsigned long id = request["id"] | 0uL;
+
+  if ((strcmp(method, "?") != 0) && (id > 0))
+  {
+    dispatch(id, method, params);
+  }
+  else
+  {
+    sendInvalidRequest();
+  }
+}
+
+template <typename StreamT, typename ScaleT>
+void ScaleRpcServer<StreamT, ScaleT>::pollRequests(uint16_t max_chars)
+{
+  while (max_chars-- && stream.available())
+  {
+    char c = stream.read();
+
+    if (c == '\r')
+      continue;
+
+    if (c != '\n')
+    {
+      if (rxLength < (SCALE_RPC_RX_LINE_SIZE - 1))
+        rxLine[rxLength++] = c;
+      else
+        rxOverflow = true;
+      continue;
+    }
+
+    rxLine[rxLength] = '\0';
+    bool overflow = rxOverflow;
+    rxLength = 0;
+    rxOverflow = false;
+
+    if (overflow)
+    {
+      sendInvalidRequest();
+      continue;
+    }
+
+    handleRequest(rxLine);
+    // Methods may block; give the caller a turn before parsing the next line
+    return;
+  }
+}
+
+template <typename StreamT, typename ScaleT>
+error_code_t ScaleRpcServer<StreamT, ScaleT>::acquire(bool *newSample)
+{
+  bool ready = false;
+  int32_t value;
+
+  if (newSample != NULL)
+    *newSample = false;
+
+  error_code_t err = scale.update(&ready, &value);
+
+  if (err)
+  {
+    addSampleError(err);
+    return err;
+  }
+
+  if (ready)
+  {
+    //With a hub, filter() reads the conversion from it
+    if (scale.getHub() == NULL)
+      addSample(value);
+    if (mode == SCALE_RPC_RAW)
+      streamRaw(scale.getLastRawReading(), scale.getLastSampleTime());
+    if (newSample != NULL)
+      *newSample = true;
+  }
+  return NAU7802_OK;
+}
+
+template <typename StreamT, typename ScaleT>
+void ScaleRpcServer<StreamT, ScaleT>::addSample(int32_t reading)
+{
+  if (sampleCount == SCALE_RPC_SAMPLE_FIFO_SIZE)
+  {
+    samplesDropped++;
+    return;
+  }
+
+  sampleFifo[(sampleHead + sampleCount) % SCALE_RPC_SAMPLE_FIFO_SIZE] = reading;
+  sampleCount++;
+}
+
+template <typename StreamT, typename ScaleT>
+void ScaleRpcServer<StreamT, ScaleT>::addSampleError(error_code_t err)
+{
+  sampleError = err;
+}
+
+// Boxcar average of streamAverageSize conversions
+template <typename StreamT, typename ScaleT>
+void ScaleRpcServer<StreamT, ScaleT>::filter()
+{
+  if (sampleError)
+  {
+    latestError = sampleError;
+    latestTimestamp = millis();
+    sampleError = NAU7802_OK;
+    filterTotal = 0;
+    filterCount = 0;
+    if (mode == SCALE_RPC_CONTINUOUS)
+      streamSensors();
+  }
+
+  while (sampleCount)
+  {
+    addToAverage(sampleFifo[sampleHead]);
+    sampleHead = (sampleHead + 1) % SCALE_RPC_SAMPLE_FIFO_SIZE;
+    sampleCount--;
+  }
+
+  AcquisitionHubBase *hub = scale.getHub();
+  if (hub != NULL)
+  {
+    if (hub != streamHub)
+    {
+      streamHub = hub;
+      hub->subscribe(&streamCursor);
+    }
+
+    hub_sample_t sample;
+    uint32_t dropped = streamCursor.dropped;
+    while (hub->read(&streamCursor, &sample))
+      addToAverage(sample.reading);
+    samplesDropped += streamCursor.dropped - dropped;
+  }
+}
+
+template <typename StreamT, typename ScaleT>
+void ScaleRpcServer<StreamT, ScaleT>::addToAverage(int32_t reading)
+{
+  filterTotal += reading;
+  if (++filterCount < streamAverageSize)
+    return;
+
+  latestError = scale.getWeight(&latestWeight, filterTotal / streamAverageSize);
+  latestTimestamp = millis();
+  filterTotal = 0;
+  filterCount = 0;
+
+  if (mode == SCALE_RPC_CONTINUOUS)
+    streamSensors();
+}
+
+template <typename StreamT, typename ScaleT>
+error_code_t ScaleRpcServer<StreamT, ScaleT>::getLatestWeight(float *weight, unsigned long *timestamp)
+{
+  if (latestError)
+    return latestError;
+
+  *weight = latestWeight;
+  if (timestamp != NULL)
+    *timestamp = latestTimestamp;
+  return SCALE_OK;
+}
+
+// Transmit Queue
+// Serializes a reply and queues it. Whole messages are dropped when the queue is full.
+template <typename StreamT, typename ScaleT>
+void ScaleRpcServer<StreamT, ScaleT>::sendReply(const JsonDocument &reply)
+{
+  char line[SCALE_RPC_TX_LINE_SIZE];
+
+  if (measureJson(reply) >= sizeof(line))
+  {
+    txDropped++;
+    return;
+  }
+
+  size_t len = serializeJson(reply, line, sizeof(line));
+  line[len++] = '\n';
+
+  if (len > (size_t)(SCALE_RPC_TX_QUEUE_SIZE - txCount))
+  {
+    txDropped++;
+    return;
+  }
+
+  for (size_t i = 0; i < len; i++)
+  {
+    txQueue[(txHead + txCount) % SCALE_RPC_TX_QUEUE_SIZE] = line[i];
+    txCount++;
+  }
+}
+
+template <typename StreamT, typename ScaleT>
+void ScaleRpcServer<StreamT, ScaleT>::drainReplies()
+{
+  int space = stream.availableForWrite();
+
+  while (txCount && (space > 0))
+  {
+    uint16_t chunk = min((uint16_t)(SCALE_RPC_TX_QUEUE_SIZE - txHead), txCount);
+    chunk = min(chunk, (uint16_t)space);
+    stream.write((const uint8_t *)&txQueue[txHead], chunk);
+    txHead = (txHead + chunk) % SCALE_RPC_TX_QUEUE_SIZE;
+    txCount -= chunk;
+    space -= chunk;
+  }
+}
+
+template <typename StreamT, typename ScaleT>
+void ScaleRpcServer<StreamT, ScaleT>::flushReplies()
+{
+  //Blocking writes rather than drainReplies(): some streams, and the Stream default, report no
+  //space for writing at all
+  unsigned long progressTime = millis();
+
+  while (txCount && ((millis() - progressTime) < SCALE_RPC_FLUSH_TIMEOUT_MS))
+  {
+    uint16_t chunk = min((uint16_t)(SCALE_RPC_TX_QUEUE_SIZE - txHead), txCount);
+    uint16_t written = stream.write((const uint8_t *)&txQueue[txHead], chunk);
+    if (written == 0)
+      continue;
+
+    txHead = (txHead + written) % SCALE_RPC_TX_QUEUE_SIZE;
+    txCount -= written;
+    progressTime = millis();
+  }
+}
+
+// Scale RPC Methods
+template <typename StreamT, typename ScaleT>
+void ScaleRpcServer<StreamT, ScaleT>::calibrate(ScaleRpcServer &server, const unsigned long id, const JsonVariant &params)
+{
+  float weight = params["calibration_weight"] | -1.0f;
+  long num_readings = params["average_size"] | -1L;
+
+  if ((weight < 1) || (weight > 500))
+  {
+    server.sendInvalidParams(id, F("By-name parameter 'weight' is missing or outside range."));
+    return;
+  }
+  else if ((num_readings < 1) || (num_readings > 64))
+  {
+    server.sendInvalidParams(id, F("By-name parameter 'average_size' is missing or > 64."));
+    return;
+  }
+
+  error_code_t err = server.scale.calculateCalibrationFactor(weight, num_readings);
+
+  if (!err)
+    server.sendCalibration(id);
+  else
+    server.sendScaleError(id, err);
+}
+
+// Tare the scale so that current value is new zero point. Pass "empty": true when nothing is on the
+// platform, so the temperature compensator learns zero drift from it.
+template <typename StreamT, typename ScaleT>
+void ScaleRpcServer<StreamT, ScaleT>::tare(ScaleRpcServer &server, const unsigned long id, const JsonVariant &params)
+{
+  long num_readings = params["average_size"] | -1L;
+
+  if ((num_readings < 1) || (num_readings > 64))
+  {
+    server.sendInvalidParams(id, F("By-name parameter 'average_size' is missing or > 64."));
+    return;
+  }
+
+  bool empty = params["empty"] | false;
+  error_code_t err = server.scale.calculateZeroOffset(num_readings, empty);
+
+  if (!err)
+    server.sendCalibration(id);
+  else
+    server.sendScaleError(id, err);
+}
+
+// Change the mode the microcontroller
+template <typename StreamT, typename ScaleT>
+void ScaleRpcServer<StreamT, ScaleT>::changeMode(ScaleRpcServer &server, const unsigned long id, const JsonVariant &params)
+{
+  const char *mode = params["mode"] | "invalid";
+
+  if (!strcasecmp(mode, "invalid"))
+  {
+    server.sendInvalidParams(id, F("By-name parameter 'mode' is missing or invalid"));
+    return;
+  }
+  if (!strcasecmp(mode, "request"))
+    server.mode = SCALE_RPC_REQUEST;
+  else if (!strcasecmp(mode, "continuous"))
+    server.mode = SCALE_RPC_CONTINUOUS;
+  else if (!strcasecmp(mode, "raw"))
+    server.mode = SCALE_RPC_RAW;
+
+  server.sendAck(id);
+}
+
+template <typename StreamT, typename ScaleT>
+void ScaleRpcServer<StreamT, ScaleT>::resetCalibration(ScaleRpcServer &server, const unsigned long id, const JsonVariant &params)
+{
+  float cal_factor = params["cal_factor"] | 1.0f;
+  long zero_offset = params["zero_offset"] | 0L;
+  bool cal_state = params["is_calibrated"] | false;
+
+  server.scale.setCalibrationFactor(cal_factor);
+  server.scale.setZeroOffset(zero_offset);
+  server.scale.isCalibrated = cal_state;
+  server.scale.calibrationDetected = false;
+  server.scale.storeCalibration();
+
+  server.sendCalibration(id);
+}
+
+template <typename StreamT, typename ScaleT>
+void ScaleRpcServer<StreamT, ScaleT>::getCalibration(ScaleRpcServer &server, const unsigned long id, const JsonVariant &params)
+{
+  server.sendCalibration(id);
+}
+
+template <typename StreamT, typename ScaleT>
+void ScaleRpcServer<StreamT, ScaleT>::getAverageReading(ScaleRpcServer &server, const unsigned long id, const JsonVariant &params)
+{
+  StaticJsonDocument<128> reply;
+  long num_readings = params["average_size"] | -1L;
+
+  if ((num_readings < 1) || (num_readings > 64))
+  {
+    server.sendInvalidParams(id, F("By-name parameter 'average_size' is missing or > 64."));
+    return;
+  }
+
+  int32_t avg_reading;
+  error_code_t err = server.scale.getPrimaryAverage(&avg_reading, num_readings);
+
+  if (!err)
+  {
+    reply["id"] = id;
+    JsonObject result = reply.createNestedObject("result");
+    result["timestamp"] = millis();
+    result["raw_avg"] = avg_reading;
+    result["num_samples"] = num_readings;
+    server.sendReply(reply);
+  }
+  else
+  {
+    server.sendScaleError(id, err);
+  }
+}
+
+template <typename StreamT, typename ScaleT>
+void ScaleRpcServer<StreamT, ScaleT>::getAverageWeight(ScaleRpcServer &server, const unsigned long id, const JsonVariant &params)
+{
+  StaticJsonDocument<128> reply;
+  long num_readings = params["average_size"] | -1L;
+  bool allow_negative = params["allow_negative"] | true;
+
+  if ((num_readings < 1) || (num_readings > 64))
+  {
+    server.sendInvalidParams(id, F("By-name parameter 'num_readings' is missing or > 64."));
+    return;
+  }
+
+  float avg_weight;
+  error_code_t err = server.scale.getAverageWeight(&avg_weight, num_readings, allow_negative);
+
+  if (!err)
+  {
+    reply["id"] = id;
+    JsonObject result = reply.createNestedObject("result");
+    result["timestamp"] = millis();
+    result["weight_avg"] = avg_weight;
+    result["num_samples"] = num_readings;
+    server.sendReply(reply);
+  }
+  else
+  {
+    server.sendScaleError(id, err);
+  }
+}
+
+// Average plus its quality in one round trip. Weight fields are included when the scale is calibrated.
+template <typename StreamT, typename ScaleT>
+void ScaleRpcServer<StreamT, ScaleT>::getStatistics(ScaleRpcServer &server, const unsigned long id, const JsonVariant &params)
+{
+  long num_readings = params["average_size"] | -1L;
+
+  if ((num_readings < 1) || (num_readings > 64))
+  {
+    server.sendInvalidParams(id, F("By-name parameter 'average_size' is missing or > 64."));
+    return;
+  }
+
+  int32_t avg_reading;
+  SampleStatistics stats;
+  error_code_t err = server.scale.getPrimaryAverage(&avg_reading, num_readings, &stats);
+
+  if (err)
+  {
+    server.sendScaleError(id, err);
+    return;
+  }
+
+  StaticJsonDocument<256> reply;
+  reply["id"] = id;
+  JsonObject result = reply.createNestedObject("result");
+  result["timestamp"] = millis();
+  result["num_samples"] = stats.getCount();
+  result["raw_avg"] = stats.getMean();
+  result["raw_min"] = stats.getMin();
+  result["raw_max"] = stats.getMax();
+  result["raw_p2p"] = stats.getPeakToPeak();
+  result["raw_sd"] = stats.getStdDev();
+
+  float weight;
+  if (!server.scale.getWeight(&weight, server.scale.compensatePrimary(avg_reading)))
+  {
+    result["weight_avg"] = weight;
+    result["weight_sd"] = stats.getStdDev() / fabs(server.scale.getCalibrationFactor());
+  }
+  server.sendReply(reply);
+}
+
+template <typename StreamT, typename ScaleT>
+void ScaleRpcServer<StreamT, ScaleT>::getStatus(ScaleRpcServer &server, const unsigned long id, const JsonVariant &params)
+{
+  StaticJsonDocument<160> reply;
+  reply["id"] = id;
+  JsonObject result = reply.createNestedObject("result");
+  result["timestamp"] = millis();
+  result["is_scale_connected"] = server.scale.isConnected();
+  result["is_calibrated"] = server.scale.isCalibrated;
+  result["is_cal_detected"] = server.scale.calibrationDetected;
+  result["config_faults"] = server.scale.getIntegrityFaults();
+  result["connection"] = server.scale.getConnectionState();
+  server.sendReply(reply);
+}
+
+// Returns the latest result of filter() without waiting for new conversions
+template <typename StreamT, typename ScaleT>
+void ScaleRpcServer<StreamT, ScaleT>::getSensors(ScaleRpcServer &server, const unsigned long id, const JsonVariant &params)
+{
+  StaticJsonDocument<192> reply;
+
+  if (!server.latestError)
+  {
+    reply["id"] = id;
+    JsonObject result = reply.createNestedObject("result");
+    server.addSensorFields(result);
+    server.sendReply(reply);
+  }
+  else
+  {
+    server.sendScaleError(server.serverId, server.latestError);
+  }
+}
+
+// Open the dosing valve and fill to "target". The cutoff is made on the device.
+template <typename StreamT, typename ScaleT>
+void ScaleRpcServer<StreamT, ScaleT>::startDose(ScaleRpcServer &server, const unsigned long id, const JsonVariant &params)
+{
+  float target = params["target"] | -1.0f;
+
+  if (target <= 0)
+  {
+    server.sendInvalidParams(id, F("By-name parameter 'target' is missing or not positive."));
+    return;
+  }
+
+  error_code_t err = server.scale.startDose(target);
+
+  if (!err)
+    server.sendAck(id);
+  else
+    server.sendScaleError(id, err);
+}
+
+template <typename StreamT, typename ScaleT>
+void ScaleRpcServer<StreamT, ScaleT>::abortDose(ScaleRpcServer &server, const unsigned long id, const JsonVariant &params)
+{
+  error_code_t err = server.scale.abortDose();
+
+  if (!err)
+    server.sendAck(id);
+  else
+    server.sendScaleError(id, err);
+}
+
+template <typename StreamT, typename ScaleT>
+void ScaleRpcServer<StreamT, ScaleT>::getDose(ScaleRpcServer &server, const unsigned long id, const JsonVariant &params)
+{
+  Dose_State state;
+  dose_result_t dose;
+  error_code_t err = server.scale.getDose(&state, &dose);
+
+  if (err)
+  {
+    server.sendScaleError(id, err);
+    return;
+  }
+
+  const char *states[] = {"idle", "filling", "settling", "done", "aborted"};
+
+  StaticJsonDocument<256> reply;
+  reply["id"] = id;
+  JsonObject result = reply.createNestedObject("result");
+  result["timestamp"] = millis();
+  result["state"] = states[state];
+  result["target"] = dose.target;
+  result["cutoff_weight"] = dose.cutoffWeight;
+  result["cutoff_rate"] = dose.cutoffRate;
+  result["final_weight"] = dose.finalWeight;
+  result["in_flight_time"] = dose.inFlightTime;
+  result["fill_time_ms"] = dose.fillTime_ms;
+  server.sendReply(reply);
+}
+
+// Arm the capture engine. "trigger" is manual, rising, falling, slope or gpio; "level" is in raw counts
+// (a jump between samples for slope). "pre" and "post" are the samples kept around the trigger.
+template <typename StreamT, typename ScaleT>
+void ScaleRpcServer<StreamT, ScaleT>::armCapture(ScaleRpcServer &server, const unsigned long id, const JsonVariant &params)
+{
+  CaptureEngineBase *engine = server.scale.getCaptureEngine();
+  if (engine == NULL)
+  {
+    server.sendScaleError(id, SCALE_NO_CAPTURE_ENGINE_ERROR);
+    return;
+  }
+
+  const char *trigger = params["trigger"] | "invalid";
+  long level = params["level"] | 0L;
+  long pre = params["pre"] | -1L;
+  long post = params["post"] | -1L;
+  long pin = params["pin"] | 0L;
+  long pin_level = params["pin_level"] | (long)HIGH;
+
+  Capture_Trigger type;
+  if (!strcasecmp(trigger, "manual"))
+    type = CAPTURE_TRIGGER_MANUAL;
+  else if (!strcasecmp(trigger, "rising"))
+    type = CAPTURE_TRIGGER_RISING;
+  else if (!strcasecmp(trigger, "falling"))
+    type = CAPTURE_TRIGGER_FALLING;
+  else if (!strcasecmp(trigger, "slope"))
+    type = CAPTURE_TRIGGER_SLOPE;
+  else if (!strcasecmp(trigger, "gpio"))
+    type = CAPTURE_TRIGGER_GPIO;
+  else
+  {
+    server.sendInvalidParams(id, F("By-name parameter 'trigger' is missing or invalid"));
+    return;
+  }
+
+  if ((pre < 0) || (post < 0) || (pre + post + 1 > engine->getCapacity()))
+  {
+    server.sendInvalidParams(id, F("By-name parameters 'pre' and 'post' are missing or exceed the buffer."));
+    return;
+  }
+
+  engine->arm(type, level, pre, post, pin, pin_level);
+  server.sendAck(id);
+}
+
+template <typename StreamT, typename ScaleT>
+void ScaleRpcServer<StreamT, ScaleT>::triggerCapture(ScaleRpcServer &server, const unsigned long id, const JsonVariant &params)
+{
+  CaptureEngineBase *engine = server.scale.getCaptureEngine();
+  if (engine == NULL)
+  {
+    server.sendScaleError(id, SCALE_NO_CAPTURE_ENGINE_ERROR);
+    return;
+  }
+
+  engine->trigger();
+  server.sendAck(id);
+}
+
+// Capture status and up to SCALE_RPC_CAPTURE_CHUNK samples from "offset". Samples are only
+// returned once the capture is done; the trigger sample is at index "pre".
+template <typename StreamT, typename ScaleT>
+void ScaleRpcServer<StreamT, ScaleT>::getCapture(ScaleRpcServer &server, const unsigned long id, const JsonVariant &params)
+{
+  CaptureEngineBase *engine = server.scale.getCaptureEngine();
+  if (engine == NULL)
+  {
+    server.sendScaleError(id, SCALE_NO_CAPTURE_ENGINE_ERROR);
+    return;
+  }
+
+  long offset = params["offset"] | 0L;
+  long count = params["count"] | (long)SCALE_RPC_CAPTURE_CHUNK;
+  if ((offset < 0) || (count < 0) || (count > SCALE_RPC_CAPTURE_CHUNK))
+  {
+    server.sendInvalidParams(id, F("By-name parameter 'offset' or 'count' is outside range."));
+    return;
+  }
+
+  int32_t samples[SCALE_RPC_CAPTURE_CHUNK];
+  count = engine->read(offset, samples, count);
+
+  const char *states[] = {"idle", "armed", "triggered", "done"};
+
+  StaticJsonDocument<384> reply;
+  reply["id"] = id;
+  JsonObject result = reply.createNestedObject("result");
+  result["state"] = states[engine->getState()];
+  result["length"] = engine->getLength();
+  result["pre"] = engine->getPreTriggerCount();
+  result["trigger_us"] = engine->getTriggerTime();
+  result["period_us"] = engine->getSamplePeriod();
+  result["offset"] = offset;
+  JsonArray data = result.createNestedArray("samples");
+  for (long i = 0; i < count; i++)
+    data.add(samples[i]);
+  server.sendReply(reply);
+}
+
+// Loads one section of the biquad cascade: {"section": 0, "q30": [b0, b1, b2, a1, a2]} with
+// coefficients scaled by 2^30, or "coefficients" with the same values as numbers in [-2, 2).
+// a0 is 1. {"sections": n} alone sets how many sections are applied; 0 bypasses the filter.
+template <typename StreamT, typename ScaleT>
+void ScaleRpcServer<StreamT, ScaleT>::setBiquad(ScaleRpcServer &server, const unsigned long id, const JsonVariant &params)
+{
+  BiquadCascadeBase *cascade = server.scale.getBiquad();
+  if (cascade == NULL)
+  {
+    server.sendScaleError(id, SCALE_NO_BIQUAD_ERROR);
+    return;
+  }
+
+  JsonArray q30 = params["q30"].as<JsonArray>();
+  JsonArray values = params["coefficients"].as<JsonArray>();
+  long section = params["section"] | -1L;
+  long sections = params["sections"] | -1L;
+
+  if (q30.isNull() && values.isNull())
+  {
+    if ((sections < 0) || (sections > cascade->getCapacity()))
+    {
+      server.sendInvalidParams(id, F("By-name parameter 'q30', 'coefficients' or 'sections' is missing or outside range."));
+      return;
+    }
+    cascade->setSectionCount(sections);
+    server.sendAck(id);
+    return;
+  }
+
+  if ((section < 0) || (section >= cascade->getCapacity()))
+  {
+    server.sendInvalidParams(id, F("By-name parameter 'section' is missing or outside range."));
+    return;
+  }
+
+  int32_t c[5];
+  JsonArray source = q30.isNull() ? values : q30;
+  if (source.size() != 5)
+  {
+    server.sendInvalidParams(id, F("Coefficients must be [b0, b1, b2, a1, a2]."));
+    return;
+  }
+  for (uint8_t i = 0; i < 5; i++)
+  {
+    JsonVariant v = source[i];
+    if (!q30.isNull())
+    {
+      if (!v.is<long>())
+      {
+        server.sendInvalidParams(id, F("By-name parameter 'q30' must hold 32-bit integers."));
+        return;
+      }
+      c[i] = v.as<long>();
+    }
+    else
+    {
+      float value = v | NAN;
+      if (!(value >= -2.0f) || !(value < 2.0f))
+      {
+        server.sendInvalidParams(id, F("By-name parameter 'coefficients' must hold numbers in [-2, 2)."));
+        return;
+      }
+      //Clamp the rounding of values just below 2 into range
+      float scaled = value * BIQUAD_ONE;
+      c[i] = (scaled >= 2147483647.0f) ? 2147483647L : (int32_t)lround(scaled);
+    }
+  }
+
+  biquad_coefficients_t coefficients;
+  coefficients.b0 = c[0];
+  coefficients.b1 = c[1];
+  coefficients.b2 = c[2];
+  coefficients.a1 = c[3];
+  coefficients.a2 = c[4];
+  cascade->setSection(section, coefficients);
+  if (sections >= 0)
+    cascade->setSectionCount(sections);
+  server.sendAck(id);
+}
+
+// Coefficients of one section in Q2.30, and the number of sections applied
+template <typename StreamT, typename ScaleT>
+void ScaleRpcServer<StreamT, ScaleT>::getBiquad(ScaleRpcServer &server, const unsigned long id, const JsonVariant &params)
+{
+  BiquadCascadeBase *cascade = server.scale.getBiquad();
+  if (cascade == NULL)
+  {
+    server.sendScaleError(id, SCALE_NO_BIQUAD_ERROR);
+    return;
+  }
+
+  long section = params["section"] | 0L;
+  biquad_coefficients_t c;
+  bool valid = (section >= 0) && (section < 256) && cascade->getSection(section, &c);
+
+  StaticJsonDocument<192> reply;
+  reply["id"] = id;
+  JsonObject result = reply.createNestedObject("result");
+  result["sections"] = cascade->getSectionCount();
+  result["capacity"] = cascade->getCapacity();
+  if (valid)
+  {
+    result["section"] = section;
+    JsonArray q30 = result.createNestedArray("q30");
+    q30.add(c.b0);
+    q30.add(c.b1);
+    q30.add(c.b2);
+    q30.add(c.a1);
+    q30.add(c.a2);
+  }
+  server.sendReply(reply);
+}
+
+// Mains hum notches: {"mains": 50} or 60, 0 to bypass, optional "width" in Hz.
+// Replies with the notches in use at the current sample rate.
+template <typename StreamT, typename ScaleT>
+void ScaleRpcServer<StreamT, ScaleT>::setMainsFilter(ScaleRpcServer &server, const unsigned long id, const JsonVariant &params)
+{
+  long mains = params["mains"] | -1L;
+  float width = params["width"] | server.scale.getMainsNotchWidth();
+
+  if ((mains != 0) && (mains != 50) && (mains != 60))
+  {
+    server.sendInvalidParams(id, F("By-name parameter 'mains' must be 0, 50 or 60."));
+    return;
+  }
+  if (!(width > 0) || (width > 10))
+  {
+    server.sendInvalidParams(id, F("By-name parameter 'width' must be above 0 and at most 10 Hz."));
+    return;
+  }
+
+  error_code_t err = server.scale.setMainsRejection(mains, width);
+  if (err)
+  {
+    server.sendScaleError(id, err);
+    return;
+  }
+
+  StaticJsonDocument<128> reply;
+  reply["id"] = id;
+  JsonObject result = reply.createNestedObject("result");
+  result["mains"] = server.scale.getMainsFrequency();
+  result["width"] = server.scale.getMainsNotchWidth();
+  result["sections"] = server.scale.getNotch()->getSectionCount();
+  server.sendReply(reply);
+}
+
+// Temperature and the compensation coefficients, learned or loaded with set_temperature_compensation
+template <typename StreamT, typename ScaleT>
+void ScaleRpcServer<StreamT, ScaleT>::getTemperature(ScaleRpcServer &server, const unsigned long id, const JsonVariant &params)
+{
+  TemperatureCompensator *compensator = server.scale.getTemperatureCompensator();
+  if (compensator == NULL)
+  {
+    server.sendScaleError(id, SCALE_NO_TEMPERATURE_ERROR);
+    return;
+  }
+
+  float celsius;
+  error_code_t err = server.scale.getTemperature(&celsius);
+  if (err)
+  {
+    server.sendScaleError(id, err);
+    return;
+  }
+
+  StaticJsonDocument<192> reply;
+  reply["id"] = id;
+  JsonObject result = reply.createNestedObject("result");
+  result["temperature"] = celsius;
+  result["counts"] = compensator->getTemperatureCounts();
+  result["zero_tc"] = compensator->getZeroCoefficient();
+  result["span_tc"] = compensator->getSpanCoefficient();
+  result["zero_t"] = compensator->getZeroTemperature();
+  result["span_t"] = compensator->getSpanTemperature();
+  server.sendReply(reply);
+}
+
+// Load "zero_tc" (counts/C) and/or "span_tc" (1/C) measured elsewhere, and "recal" (C), the change
+// that triggers an AFE recalibration. Omitted parameters are kept.
+template <typename StreamT, typename ScaleT>
+void ScaleRpcServer<StreamT, ScaleT>::setTemperatureCompensation(ScaleRpcServer &server, const unsigned long id, const JsonVariant &params)
+{
+  TemperatureCompensator *compensator = server.scale.getTemperatureCompensator();
+  if (compensator == NULL)
+  {
+    server.sendScaleError(id, SCALE_NO_TEMPERATURE_ERROR);
+    return;
+  }
+
+  float zero_tc = params["zero_tc"] | compensator->getZeroCoefficient();
+  float span_tc = params["span_tc"] | compensator->getSpanCoefficient();
+  float recal = params["recal"] | compensator->getRecalibrationThreshold();
+  if (recal < 0)
+  {
+    server.sendInvalidParams(id, F("By-name parameter 'recal' is negative."));
+    return;
+  }
+  compensator->setCoefficients(zero_tc, span_tc);
+  compensator->setRecalibrationThreshold(recal);
+
+  StaticJsonDocument<128> reply;
+  reply["id"] = id;
+  JsonObject result = reply.createNestedObject("result");
+  result["zero_tc"] = compensator->getZeroCoefficient();
+  result["span_tc"] = compensator->getSpanCoefficient();
+  result["recal"] = compensator->getRecalibrationThreshold();
+  server.sendReply(reply);
+}
+
+// Load the creep model, e.g. as fitted by qwiic_replay --fit-creep: "coefficient" (fraction of the
+// load), "time_constant" (s) and "threshold" (counts). Omitted parameters are kept. Replies with the
+// model and the creep currently removed, in counts.
+template <typename StreamT, typename ScaleT>
+void ScaleRpcServer<StreamT, ScaleT>::setCreep(ScaleRpcServer &server, const unsigned long id, const JsonVariant &params)
+{
+  CreepCompensator *creep = server.scale.getCreepCompensator();
+  if (creep == NULL)
+  {
+    server.sendScaleError(id, SCALE_NO_CREEP_COMPENSATOR_ERROR);
+    return;
+  }
+
+  float coefficient = params["coefficient"] | creep->getCoefficient();
+  float time_constant = params["time_constant"] | creep->getTimeConstant();
+  long threshold = params["threshold"] | (long)creep->getThreshold();
+
+  if (!(time_constant > 0) || (fabs(coefficient) > 0.1f) || (threshold < 0))
+  {
+    server.sendInvalidParams(id, F("Need |coefficient| <= 0.1, time_constant > 0 and threshold >= 0."));
+    return;
+  }
+  creep->setModel(coefficient, time_constant);
+  creep->setThreshold(threshold);
+
+  StaticJsonDocument<128> reply;
+  reply["id"] = id;
+  JsonObject result = reply.createNestedObject("result");
+  result["coefficient"] = creep->getCoefficient();
+  result["time_constant"] = creep->getTimeConstant();
+  result["threshold"] = creep->getThreshold();
+  result["creep"] = creep->getCreep();
+  server.sendReply(reply);
+}
+
+// Register dump for field diagnostics: every register as hex in one string, the main settings decoded,
+// and "mismatch", a mask with bit n set when register n differs from the configuration the driver
+// expects. "channel" is 0 while the temperature sensor is selected. Pass "shadow": true to dump and
+// decode the expected registers instead.
+template <typename StreamT, typename ScaleT>
+void ScaleRpcServer<StreamT, ScaleT>::getRegisters(ScaleRpcServer &server, const unsigned long id, const JsonVariant &params)
+{
+  bool shadow = params["shadow"] | false;
+  nau7802_snapshot_t snapshot;
+
+  error_code_t err = server.scale.snapshot(&snapshot);
+  if (err)
+  {
+    server.sendScaleError(id, err);
+    return;
+  }
+  uint32_t mismatch = server.scale.diffSnapshot(snapshot);
+  if (shadow)
+    snapshot = server.scale.getShadow();
+
+  static const char digits[] = "0123456789abcdef";
+  char hex[2 * NAU7802_REGISTER_COUNT + 1];
+  for (uint8_t i = 0; i < NAU7802_REGISTER_COUNT; i++)
+  {
+    hex[2 * i] = digits[snapshot.registers[i] >> 4];
+    hex[2 * i + 1] = digits[snapshot.registers[i] & 0x0F];
+  }
+  hex[2 * NAU7802_REGISTER_COUNT] = '\0';
+
+  StaticJsonDocument<384> reply;
+  reply["id"] = id;
+  JsonObject result = reply.createNestedObject("result");
+  result["timestamp"] = millis();
+  result["registers"] = hex;
+  result["mismatch"] = mismatch;
+  result["gain"] = NAU7802::decodeGain(NAU7802::getField(snapshot, NAU7802_FIELD_GAIN));
+  result["ldo_mv"] = NAU7802::decodeLDO(NAU7802::getField(snapshot, NAU7802_FIELD_VLDO));
+  result["sps"] = NAU7802::decodeSampleRate(NAU7802::getField(snapshot, NAU7802_FIELD_CRS));
+  result["channel"] = NAU7802::getField(snapshot, NAU7802_FIELD_TS) ? 0 : NAU7802::getField(snapshot, NAU7802_FIELD_CHS) + 1;
+  result["calmod"] = NAU7802::getField(snapshot, NAU7802_FIELD_CALMOD);
+  result["cal_error"] = NAU7802::getField(snapshot, NAU7802_FIELD_CAL_ERROR);
+  server.sendReply(reply);
+}
+
+// Fields shared by get_sensors and the stream. The flow rate is included when the scale has an estimator.
+template <typename StreamT, typename ScaleT>
+void ScaleRpcServer<StreamT, ScaleT>::addSensorFields(JsonObject &result)
+{
+  float rate, rate_sd;
+
+  result["timestamp"] = latestTimestamp;
+  result["weight_avg"] = latestWeight;
+  result["num_samples"] = streamAverageSize;
+
+  if (!scale.getFlowRate(&rate, &rate_sd))
+  {
+    result["flow_rate"] = rate;
+    result["flow_rate_sd"] = rate_sd;
+  }
+}
+
+// The first line streamed after the scale reconnected carries "gap_ms", how long it was gone, so that
+// the host does not join the data across the gap
+template <typename StreamT, typename ScaleT>
+void ScaleRpcServer<StreamT, ScaleT>::addGapMarker(JsonObject &result)
+{
+  uint16_t reconnects = scale.getReconnectCount();
+  if (reconnects == streamReconnects)
+    return;
+
+  streamReconnects = reconnects;
+  result["gap_ms"] = scale.getLastOutage();
+}
+
+// Continuous Streaming Mode. Called by filter() for every completed average.
+template <typename StreamT, typename ScaleT>
+void ScaleRpcServer<StreamT, ScaleT>::streamSensors()
+{
+  StaticJsonDocument<192> reply;
+
+  if (!latestError)
+  {
+    streamingError = false;
+    reply["id"] = serverId;
+    JsonObject result = reply.createNestedObject("result");
+    addSensorFields(result);
+    addGapMarker(result);
+    sendReply(reply);
+  }
+  else
+  {
+    // Only send the first error encountered
+    if (!streamingError)
+    {
+      sendScaleError(serverId, latestError);
+      streamingError = true;
+    }
+  }
+}
+
+// Raw Streaming Mode. One line per conversion; this is the trace format read by extras/replay.
+// At 115200 baud there is room for about 250 lines per second, faster rates will drop lines.
+template <typename StreamT, typename ScaleT>
+void ScaleRpcServer<StreamT, ScaleT>::streamRaw(int32_t reading, uint32_t timestamp_us)
+{
+  StaticJsonDocument<96> reply;
+  reply["id"] = serverId;
+  JsonObject result = reply.createNestedObject("result");
+  result["t"] = timestamp_us;
+  result["raw"] = reading;
+  addGapMarker(result);
+  sendReply(reply);
+}
+
+// Acknowledgement Response
+template <typename StreamT, typename ScaleT>
+void ScaleRpcServer<StreamT, ScaleT>::sendAck(const unsigned long id)
+{
+  StaticJsonDocument<128> reply;
+  reply["id"] = id;
+  JsonObject result = reply.createNestedObject("result");
+  result["timestamp"] = millis();
+  sendReply(reply);
+}
+
+template <typename StreamT, typename ScaleT>
+void ScaleRpcServer<StreamT, ScaleT>::sendCalibration(const unsigned long id)
+{
+  StaticJsonDocument<128> reply;
+  reply["id"] = id;
+  JsonObject result = reply.createNestedObject("result");
+  result["timestamp"] = millis();
+  result["calibration_factor"] = scale.getCalibrationFactor();
+  result["zero_offset"] = scale.getZeroOffset();
+  sendReply(reply);
+}
+
+// Error Response Helper Functions
+template <typename StreamT, typename ScaleT>
+void ScaleRpcServer<StreamT, ScaleT>::sendScaleError(const unsigned long id, error_code_t scale_err)
+{
+  StaticJsonDocument<128> reply;
+  JsonObject err = reply.createNestedObject("error");
+  err["timestamp"] = millis();
+  err["code"] = static_cast<int>(scale_err);
+  err["message"] = scale.strerror_f(scale_err);
+  reply["id"] = id;
+  sendReply(reply);
+}
+
+template <typename StreamT, typename ScaleT>
+void ScaleRpcServer<StreamT, ScaleT>::sendParseError(const DeserializationError &error)
+{
+  StaticJsonDocument<128> reply;
+  JsonObject err = reply.createNestedObject("error");
+  err["code"] = JSONRPC_PARSE_ERROR;
+  err["message"] = F("Error parsing received JSON.");
+  err["data"] = error.f_str();
+  sendReply(reply);
+}
+
+template <typename StreamT, typename ScaleT>
+void ScaleRpcServer<StreamT, ScaleT>::sendInvalidRequest(void)
+{
+  StaticJsonDocument<128> reply;
+  JsonObject err = reply.createNestedObject("error");
+  err["code"] = JSONRPC_INVALID_REQUEST;
+  err["message"] = F("The JSON sent is not a valid Request object.");
+  sendReply(reply);
+}
+
+template <typename StreamT, typename ScaleT>
+void ScaleRpcServer<StreamT, ScaleT>::sendMethodNotFound(const unsigned long id)
+{
+  StaticJsonDocument<128> reply;
+  JsonObject err = reply.createNestedObject("error");
+  err["code"] = JSONRPC_METHOD_NOT_FOUND;
+  err["message"] = F("The method does not exist.");
+  reply["id"] = id;
+  sendReply(reply);
+}
+
+template <typename StreamT, typename ScaleT>
+void ScaleRpcServer<StreamT, ScaleT>::sendInvalidParams(const unsigned long id, const __FlashStringHelper *data)
+{
+  StaticJsonDocument<128> reply;
+  JsonObject err = reply.createNestedObject("error");
+  err["code"] = JSONRPC_INVALID_PARAMS;
+  err["message"] = F("Invalid method parameter(s).");
+  err["data"] = data;
+  reply["id"] = id;
+  sendReply(reply);
+}
+#endif //SCALE_RPC_SERVER_H
@@ -0,0 +1,89 @@
+#include <Arduino.h>
+#include "SequentialClassifier.h"
+
+void SequentialClassifier::configure(float lower_limit, float upper_limit, float sigma, float indifference,
+                                     float error_rate, uint16_t max_samples)
+{
+  if (lower_limit > upper_limit)
+  {
+    float swap = lower_limit;
+    lower_limit = upper_limit;
+    upper_limit = swap;
+  }
+  lowerLimit = lower_limit;
+  upperLimit = upper_limit;
+
+  //Error check. Keep the ratio finite and the test able to decide.
+  error_rate = constrain(error_rate, 1e-6f, 0.49f);
+  if (sigma <= 0)
+    sigma = 1e-6f;
+  if (indifference <= 0)
+    indifference = sigma;
+
+  //Log-likelihood ratio of N(limit + d, s) against N(limit - d, s) for one sample x is
+  //2d / s^2 * (x - limit), so each test only needs the limit as its midpoint.
+  gain = 2.0f * indifference / (sigma * sigma);
+  threshold = log((1.0f - error_rate) / error_rate);
+  maxSamples = max(max_samples, (uint16_t)1);
+
+  lowerTest.midpoint = lowerLimit;
+  upperTest.midpoint = upperLimit;
+  restart();
+}
+
+void SequentialClassifier::restart()
+{
+  lowerTest.llr = 0;
+  lowerTest.outcome = 0;
+  upperTest.llr = 0;
+  upperTest.outcome = 0;
+  sum = 0;
+  result.decision = CLASS_UNDECIDED;
+  result.samples = 0;
+  result.mean = 0;
+  result.truncated = false;
+}
+
+void SequentialClassifier::step(limit_test_t *test, float value)
+{
+  if (test->outcome)
+    return;
+
+  test->llr += gain * (value - test->midpoint);
+  if (test->llr >= threshold)
+    test->outcome = 1;
+  else if (test->llr <= -threshold)
+    test->outcome = -1;
+}
+
+bool SequentialClassifier::addSample(float value)
+{
+  if (result.decision != CLASS_UNDECIDED)
+    return true;
+
+  step(&lowerTest, value);
+  step(&upperTest, value);
+  sum += value;
+  result.samples++;
+  result.mean = sum / result.samples;
+
+  //Being below the lower limit implies being below the upper one, and vice versa
+  if (lowerTest.outcome < 0)
+    result.decision = CLASS_BELOW;
+  else if (upperTest.outcome > 0)
+    result.decision = CLASS_ABOVE;
+  else if ((lowerTest.outcome > 0) && (upperTest.outcome < 0))
+    result.decision = CLASS_WITHIN;
+  else if (result.samples >= maxSamples)
+  {
+    result.truncated = true;
+    if (result.mean < lowerLimit)
+      result.decision = CLASS_BELOW;
+    else if (result.mean > upperLimit)
+      result.decision = CLASS_ABOVE;
+    else
+      result.decision = CLASS_WITHIN;
+  }
+
+  return result.decision != CLASS_UNDECIDED;
+}
@@ -0,0 +1,71 @@
+#ifndef SEQUENTIAL_CLASSIFIER_H
+#define SEQUENTIAL_CLASSIFIER_H
+#include <Arduino.h>
+
+/* Checkweigher accept/reject decision with Wald's sequential probability ratio test.
+  Two tests run side by side on every sample, one at the lower and one at the upper tolerance
+  limit. Each tests mean = limit - indifference against mean = limit + indifference assuming
+  Gaussian noise with the configured standard deviation, and stops when its log-likelihood ratio
+  leaves +/- ln((1 - error_rate) / error_rate). The decision is made as soon as both tests agree,
+  which for items well inside or outside the limits takes only a few samples.
+
+  Values are in weight units; QwiicScale converts each conversion before calling addSample().*/
+
+typedef enum
+{
+  CLASS_UNDECIDED = 0,
+  CLASS_BELOW,        //Below the lower limit
+  CLASS_WITHIN,       //Between the limits
+  CLASS_ABOVE,        //Above the upper limit
+} Classification_Decision;
+
+typedef struct
+{
+  Classification_Decision decision;
+  uint16_t samples;     //Samples used for the decision
+  float mean;           //Mean of those samples
+  bool truncated;       //Hit max_samples; decision taken from the mean against the limits
+} classification_t;
+
+class SequentialClassifier
+{
+  public:
+    SequentialClassifier() {};
+
+    //sigma is the noise standard deviation of one sample. indifference is the half-width of the zone
+    //around each limit in which either decision is acceptable. error_rate applies to both error types.
+    void configure(float lower_limit, float upper_limit, float sigma, float indifference,
+                   float error_rate = 0.01f, uint16_t max_samples = 64);
+
+    //Forget the current item and start a new decision
+    void restart();
+
+    //Feed one sample. Returns true when the decision has been made.
+    bool addSample(float value);
+
+    bool isDecided() {return result.decision != CLASS_UNDECIDED;}
+    classification_t getResult() {return result;}
+
+  private:
+    //One Wald test at a single limit. +1 when above, -1 when below, 0 while undecided.
+    typedef struct
+    {
+      float midpoint;
+      float llr;
+      int8_t outcome;
+    } limit_test_t;
+
+    void step(limit_test_t *test, float value);
+
+    float lowerLimit = 0;
+    float upperLimit = 0;
+    float gain = 0;          //(mu1 - mu0) / sigma^2, the same for both tests
+    float threshold = 0;     //ln((1 - error_rate) / error_rate)
+    uint16_t maxSamples = 64;
+
+    limit_test_t lowerTest = {0, 0, 0};
+    limit_test_t upperTest = {0, 0, 0};
+    double sum = 0;
+    classification_t result = {CLASS_UNDECIDED, 0, 0, false};
+};
+#endif //SEQUENTIAL_CLASSIFIER_H
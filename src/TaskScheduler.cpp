@@ -0,0 +1,181 @@
+#include <Arduino.h>
+#include "TaskScheduler.h"
+
+TaskSchedulerBase::TaskSchedulerBase(scheduler_task_t *table, uint8_t capacity)
+  : tasks(table), capacity(capacity)
+{
+}
+
+error_code_t TaskSchedulerBase::addTask(task_id_t *id, const char *name, scheduler_task_fn_t fn, void *context,
+                                        uint32_t period_us, uint32_t budget_us)
+{
+  if (fn == NULL)
+    return SCHEDULER_INVALID_TASK_ERROR;
+
+  if (taskCount >= capacity)
+    return SCHEDULER_TABLE_FULL_ERROR;
+
+  scheduler_task_t *task = &tasks[taskCount];
+  memset(task, 0, sizeof(scheduler_task_t));
+  task->name = name;
+  task->fn = fn;
+  task->context = context;
+  task->period_us = period_us;
+  task->budget_us = budget_us;
+  task->deadline_us = micros();
+  task->enabled = true;
+
+  if (taskCount == 0)
+    resetStats();
+
+  if (id != NULL)
+    *id = taskCount;
+  taskCount++;
+  return SCHEDULER_OK;
+}
+
+error_code_t TaskSchedulerBase::enableTask(task_id_t id, bool enabled)
+{
+  if ((id < 0) || (id >= taskCount))
+    return SCHEDULER_INVALID_TASK_ERROR;
+
+  //Release on enable so the task does not try to catch up on the time it was disabled
+  if (enabled && !tasks[id].enabled)
+    tasks[id].deadline_us = micros();
+  tasks[id].enabled = enabled;
+  return SCHEDULER_OK;
+}
+
+error_code_t TaskSchedulerBase::setPeriod(task_id_t id, uint32_t period_us)
+{
+  if ((id < 0) || (id >= taskCount))
+    return SCHEDULER_INVALID_TASK_ERROR;
+
+  tasks[id].period_us = period_us;
+  return SCHEDULER_OK;
+}
+
+error_code_t TaskSchedulerBase::trigger(task_id_t id)
+{
+  if ((id < 0) || (id >= taskCount))
+    return SCHEDULER_INVALID_TASK_ERROR;
+
+  tasks[id].deadline_us = micros();
+  return SCHEDULER_OK;
+}
+
+const scheduler_task_t *TaskSchedulerBase::getTask(task_id_t id)
+{
+  if ((id < 0) || (id >= taskCount))
+    return NULL;
+  return &tasks[id];
+}
+
+void TaskSchedulerBase::resetStats()
+{
+  for (uint8_t i = 0; i < taskCount; i++)
+  {
+    tasks[i].runs = 0;
+    tasks[i].overruns = 0;
+    tasks[i].missed = 0;
+    tasks[i].cpu_us = 0;
+    tasks[i].max_run_us = 0;
+    tasks[i].max_latency_us = 0;
+  }
+  idle_us = 0;
+  idling = false;
+  stats_start_us = micros();
+}
+
+uint32_t TaskSchedulerBase::remainingBudget()
+{
+  if (current < 0)
+    return 0;
+
+  uint32_t budget = tasks[current].budget_us;
+  if (budget == 0)
+    return 0xFFFFFFFF;
+
+  uint32_t elapsed = micros() - current_start_us;
+  if (elapsed >= budget)
+    return 0;
+  return budget - elapsed;
+}
+
+//Earliest deadline first among the tasks that are ready. Ties go to the lower table index,
+//so tasks should be added in order of priority.
+bool TaskSchedulerBase::run()
+{
+  uint32_t now = micros();
+  task_id_t next = -1;
+  uint32_t most_late = 0;
+
+  for (uint8_t i = 0; i < taskCount; i++)
+  {
+    if (!tasks[i].enabled)
+      continue;
+
+    //Signed difference handles micros() wrapping every ~71 minutes
+    int32_t late = (int32_t)(now - tasks[i].deadline_us);
+    if (late < 0)
+      continue;
+
+    if ((next < 0) || ((uint32_t)late > most_late))
+    {
+      next = i;
+      most_late = late;
+    }
+  }
+
+  if (next < 0)
+  {
+    if (!idling)
+    {
+      idling = true;
+      idle_since_us = now;
+    }
+    return false;
+  }
+
+  if (idling)
+  {
+    idle_us += now - idle_since_us;
+    idling = false;
+  }
+
+  scheduler_task_t *task = &tasks[next];
+  current = next;
+  current_start_us = now;
+  task->fn(task->context);
+  current = -1;
+
+  uint32_t run_time = micros() - now;
+  task->runs++;
+  task->cpu_us += run_time;
+  if (run_time > task->max_run_us)
+    task->max_run_us = run_time;
+  if ((task->budget_us > 0) && (run_time > task->budget_us))
+    task->overruns++;
+
+  //Background tasks have no release time to be late against
+  if (task->period_us == 0)
+  {
+    task->deadline_us = now;
+    return true;
+  }
+
+  if (most_late > task->max_latency_us)
+    task->max_latency_us = most_late;
+
+  //Keep a fixed release grid so periodic output does not drift. If the task fell a full
+  //period behind, drop the missed releases instead of running it back to back.
+  task->deadline_us += task->period_us;
+  if ((int32_t)(micros() - task->deadline_us) >= (int32_t)task->period_us)
+  {
+    uint32_t behind = micros() - task->deadline_us;
+    task->missed += behind / task->period_us;
+    task->deadline_us += (behind / task->period_us) * task->period_us;
+  }
+
+  return true;
+}
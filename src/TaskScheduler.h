@@ -0,0 +1,95 @@
+#ifndef TASK_SCHEDULER_H
+#define TASK_SCHEDULER_H
+#include <Arduino.h>
+#include "NAU7802.h"
+
+/* Small cooperative scheduler for a fixed table of periodic tasks.
+  Each task has a period and a time budget, both in microseconds. Deadlines are kept in micros()
+  and the most overdue ready task is run on every call to run(). Tasks are never pre-empted, so a
+  task that needs longer than its budget should do its work in slices and check remainingBudget().
+  The scheduler records per-task CPU time, worst-case run time, start latency and overruns so that
+  request latency and stream jitter can be bounded from the measured numbers.*/
+
+//NOTE: Make sure not to collide with error codes defined by NAU7802 and QwiicScale
+#define SCHEDULER_OK                       0
+#define SCHEDULER_TABLE_FULL_ERROR        -1101
+#define SCHEDULER_INVALID_TASK_ERROR      -1102
+
+typedef void (*scheduler_task_fn_t)(void *context);
+
+typedef struct
+{
+  const char *name;          //Short label used in reports
+  scheduler_task_fn_t fn;    //Task body
+  void *context;             //Passed to fn on every run
+  uint32_t period_us;        //0 runs the task on every pass (background task)
+  uint32_t budget_us;        //Allowed run time per invocation. 0 disables overrun checking
+  uint32_t deadline_us;      //Next release time in micros()
+  bool enabled;
+
+  //Statistics
+  uint32_t runs;             //Number of invocations
+  uint32_t overruns;         //Invocations that exceeded budget_us
+  uint32_t missed;           //Releases skipped because the task fell a full period behind
+  uint32_t cpu_us;           //Total run time (wraps after ~71 minutes of CPU time)
+  uint32_t max_run_us;       //Worst-case run time
+  uint32_t max_latency_us;   //Worst-case delay between release and start
+} scheduler_task_t;
+
+typedef int8_t task_id_t;
+
+class TaskSchedulerBase
+{
+  public:
+    //Add a task to the table. Returns SCHEDULER_TABLE_FULL_ERROR if there is no room.
+    error_code_t addTask(task_id_t *id, const char *name, scheduler_task_fn_t fn, void *context,
+                         uint32_t period_us, uint32_t budget_us = 0);
+
+    error_code_t enableTask(task_id_t id, bool enabled = true);
+    error_code_t setPeriod(task_id_t id, uint32_t period_us);
+
+    //Release a task immediately, e.g. when a producer has queued work for it
+    error_code_t trigger(task_id_t id);
+
+    //Run the most overdue ready task, if any. Returns true if a task was run.
+    bool run();
+
+    //Time left in the budget of the task currently running, for tasks that work in slices.
+    //Returns 0xFFFFFFFF if the task has no budget and 0 once the budget is used up.
+    uint32_t remainingBudget();
+
+    const scheduler_task_t *getTask(task_id_t id);
+    uint8_t getTaskCount() {return taskCount;}
+    task_id_t getCurrentTask() {return current;}
+
+    //Total time spent in run() without a ready task, and the time statistics were last reset
+    uint32_t getIdleTime() {return idle_us;}
+    uint32_t getStatsStartTime() {return stats_start_us;}
+    void resetStats();
+
+  protected:
+    TaskSchedulerBase(scheduler_task_t *table, uint8_t capacity);
+
+  private:
+    scheduler_task_t *tasks;
+    uint8_t capacity;
+    uint8_t taskCount = 0;
+    task_id_t current = -1;
+    uint32_t current_start_us = 0;
+    uint32_t idle_us = 0;
+    uint32_t idle_since_us = 0;
+    bool idling = false;
+    uint32_t stats_start_us = 0;
+};
+
+//Scheduler with room for MAX_TASKS tasks. The table lives inside the object, no heap is used.
+template <uint8_t MAX_TASKS>
+class TaskScheduler : public TaskSchedulerBase
+{
+  public:
+    TaskScheduler() : TaskSchedulerBase(table, MAX_TASKS) {};
+
+  private:
+    scheduler_task_t table[MAX_TASKS];
+};
+#endif //TASK_SCHEDULER_H
@@ -0,0 +1,147 @@
+#include <Arduino.h>
+#include "TemperatureCompensator.h"
+
+TemperatureCompensator::TemperatureCompensator()
+{
+  resetLearning();
+}
+
+void TemperatureCompensator::setSensorScale(int32_t counts_at_25c, float counts_per_degree)
+{
+  countsAt25 = counts_at_25c;
+  if (counts_per_degree != 0)
+    countsPerDegree = counts_per_degree;
+  if (temperatureValid)
+    addTemperature(temperatureCounts);
+}
+
+void TemperatureCompensator::addTemperature(int32_t counts)
+{
+  temperatureCounts = counts;
+  temperature = 25 + (counts - countsAt25) / countsPerDegree;
+
+  if (!temperatureValid)
+  {
+    //Until a tare or calibration says otherwise, compensate relative to the first temperature
+    if (!zeroTemperatureSet)
+      zeroTemperature = temperature;
+    if (!spanTemperatureSet)
+      spanTemperature = temperature;
+    afeTemperature = temperature;
+    temperatureValid = true;
+  }
+  updateCorrections();
+}
+
+void TemperatureCompensator::setCoefficients(float zero_coefficient, float span_coefficient)
+{
+  zeroCoefficient = zero_coefficient;
+  spanCoefficient = span_coefficient;
+  updateCorrections();
+}
+
+void TemperatureCompensator::updateCorrections()
+{
+  offsetCorrection = zeroCoefficient * (temperature - zeroTemperature);
+  float span = 1 + spanCoefficient * (temperature - spanTemperature);
+  gainCorrection = (span > 0) ? 1 / span : 1;
+}
+
+void TemperatureCompensator::resetLearning()
+{
+  memset(&zeroFit, 0, sizeof(zeroFit));
+  memset(&spanFit, 0, sizeof(spanFit));
+}
+
+void TemperatureCompensator::addObservation(temperature_fit_t &fit, float t, float value)
+{
+  if (fit.count == 0)
+  {
+    fit.t0 = t;
+    fit.v0 = value;
+    fit.minT = t;
+    fit.maxT = t;
+  }
+
+  float dt = t - fit.t0;
+  float dv = value - fit.v0;
+  fit.count++;
+  fit.sumT += dt;
+  fit.sumV += dv;
+  fit.sumTT += dt * dt;
+  fit.sumTV += dt * dv;
+  fit.minT = min(fit.minT, t);
+  fit.maxT = max(fit.maxT, t);
+}
+
+bool TemperatureCompensator::getSlope(const temperature_fit_t &fit, float *slope, float *mean)
+{
+  if ((fit.count < 2) || (fit.maxT - fit.minT < TEMPERATURE_LEARN_SPREAD))
+    return false;
+
+  float denominator = fit.count * fit.sumTT - fit.sumT * fit.sumT;
+  if (denominator <= 0)
+    return false;
+
+  *slope = (fit.count * fit.sumTV - fit.sumT * fit.sumV) / denominator;
+  *mean = fit.v0 + fit.sumV / fit.count;
+  return true;
+}
+
+void TemperatureCompensator::learnZero(int32_t zero_offset)
+{
+  if (!temperatureValid)
+    return;
+
+  float slope, mean;
+  addObservation(zeroFit, temperature, zero_offset);
+  if (getSlope(zeroFit, &slope, &mean))
+    zeroCoefficient = slope;
+
+  setZeroReference();
+}
+
+void TemperatureCompensator::setZeroReference()
+{
+  if (!temperatureValid)
+    return;
+
+  zeroTemperature = temperature;
+  zeroTemperatureSet = true;
+  updateCorrections();
+}
+
+void TemperatureCompensator::learnSpan(float calibration_factor)
+{
+  if (!temperatureValid)
+    return;
+
+  float slope, mean;
+  addObservation(spanFit, temperature, calibration_factor);
+  if (getSlope(spanFit, &slope, &mean) && (mean != 0))
+    spanCoefficient = slope / mean;
+
+  spanTemperature = temperature;
+  spanTemperatureSet = true;
+  updateCorrections();
+}
+
+int32_t TemperatureCompensator::compensate(int32_t reading, int32_t zero_offset)
+{
+  if (!temperatureValid)
+    return reading;
+  return zero_offset + lround((reading - zero_offset - offsetCorrection) * gainCorrection);
+}
+
+int32_t TemperatureCompensator::compensateZero(int32_t reading)
+{
+  if (!temperatureValid)
+    return reading;
+  return reading - lround(offsetCorrection);
+}
+
+bool TemperatureCompensator::isRecalibrationDue()
+{
+  return temperatureValid && (recalibrationThreshold > 0) &&
+         (fabs(temperature - afeTemperature) > recalibrationThreshold);
+}
@@ -0,0 +1,103 @@
+#ifndef TEMPERATURE_COMPENSATOR_H
+#define TEMPERATURE_COMPENSATOR_H
+#include <Arduino.h>
+
+/* Temperature compensation of zero and span from the NAU7802's internal temperature sensor.
+
+  The zero is modelled as zeroOffset + zeroCoefficient * (T - T_zero), where T_zero is the
+  temperature at the last tare, and the span as calibrationFactor * (1 + spanCoefficient *
+  (T - T_span)), where T_span is the temperature at the last calibration. Every channel 1 reading
+  is corrected back to what it would have read at those temperatures. The corrections are worked
+  out when a temperature arrives, so each reading costs a subtract and a multiply.
+
+  The coefficients can be set, or learned: each zero calibration of the empty platform adds the
+  measured zero at the current temperature, each calibration the measured calibration factor,
+  and a least-squares line through them gives the coefficient once the observations span at
+  least TEMPERATURE_LEARN_SPREAD degrees.
+
+  The compensator also reports when the temperature has moved more than a threshold since the
+  analog front end was last calibrated, so QwiicScale can start a recalibration.*/
+
+#define TEMPERATURE_LEARN_SPREAD  2.0f   //Degrees C between observations before a coefficient is learned
+
+//Least-squares line through (temperature, value) observations, relative to the first one
+typedef struct
+{
+  uint16_t count;
+  float t0, v0;
+  float sumT, sumV, sumTT, sumTV;
+  float minT, maxT;
+} temperature_fit_t;
+
+class TemperatureCompensator
+{
+  public:
+    TemperatureCompensator();
+
+    //Sensor counts at gain x1 to degrees: 25 + (counts - counts_at_25c) / counts_per_degree.
+    //The defaults (109mV at 25C, 360uV/C, 3.3V reference) are nominal; calibrate against a thermometer.
+    void setSensorScale(int32_t counts_at_25c, float counts_per_degree);
+
+    //New temperature sensor conversion
+    void addTemperature(int32_t counts);
+    bool hasTemperature() {return temperatureValid;}
+    float getTemperature() {return temperature;}
+    int32_t getTemperatureCounts() {return temperatureCounts;}
+
+    //Zero drift in counts per degree and span drift as a fraction per degree
+    void setCoefficients(float zero_coefficient, float span_coefficient);
+    float getZeroCoefficient() {return zeroCoefficient;}
+    float getSpanCoefficient() {return spanCoefficient;}
+    float getZeroTemperature() {return zeroTemperature;}
+    float getSpanTemperature() {return spanTemperature;}
+
+    //Record a zero calibration of the empty platform or a calibration made at the current
+    //temperature and learn from it. learnZero() takes the zero reading without temperature correction.
+    void learnZero(int32_t zero_offset);
+    //Record a tare made at the current temperature without learning from it, e.g. of a container
+    void setZeroReference();
+    void learnSpan(float calibration_factor);
+    void resetLearning();
+
+    //Correct a channel 1 reading to the tare and calibration temperatures
+    int32_t compensate(int32_t reading, int32_t zero_offset);
+    //Only the zero drift since the tare, for measuring a calibration factor
+    int32_t compensateZero(int32_t reading);
+
+    //Degrees of change since the last AFE calibration that call for another. 0 disables.
+    void setRecalibrationThreshold(float degrees) {recalibrationThreshold = degrees;}
+    float getRecalibrationThreshold() {return recalibrationThreshold;}
+    bool isRecalibrationDue();
+    //Record that the AFE was calibrated at the current temperature
+    void recalibrated() {afeTemperature = temperature;}
+
+  private:
+    void updateCorrections();
+    static void addObservation(temperature_fit_t &fit, float t, float value);
+    static bool getSlope(const temperature_fit_t &fit, float *slope, float *mean);
+
+    int32_t countsAt25 = 277000;
+    float countsPerDegree = 915;
+
+    bool temperatureValid = false;
+    int32_t temperatureCounts = 0;
+    float temperature = 25;
+
+    float zeroCoefficient = 0;
+    float spanCoefficient = 0;
+    float zeroTemperature = 25;
+    float spanTemperature = 25;
+    bool zeroTemperatureSet = false;
+    bool spanTemperatureSet = false;
+
+    temperature_fit_t zeroFit;
+    temperature_fit_t spanFit;
+
+    float recalibrationThreshold = 0;
+    float afeTemperature = 25;
+
+    //Worked out from the temperature and coefficients, applied to every reading
+    float offsetCorrection = 0;
+    float gainCorrection = 1;
+};
+#endif //TEMPERATURE_COMPENSATOR_H
@@ -0,0 +1,83 @@
+#include <Arduino.h>
+#include "VibrationCanceller.h"
+
+//Keeps the normalisation finite while the reference is quiet, in counts^2
+#define CANCELLER_EPSILON  1.0f
+
+//Fractional bits of the means
+#define CANCELLER_MEAN_FRACTION  16
+#define CANCELLER_MEAN_ONE       (1L << CANCELLER_MEAN_FRACTION)
+
+VibrationCancellerBase::VibrationCancellerBase(float *weights, float *history, uint8_t taps)
+  : weights(weights), history(history), taps(taps)
+{
+  reset();
+}
+
+void VibrationCancellerBase::reset()
+{
+  for (uint8_t i = 0; i < taps; i++)
+  {
+    weights[i] = 0;
+    history[i] = 0;
+  }
+  haveReference = false;
+  haveReading = false;
+  cancelled = 0;
+}
+
+void VibrationCancellerBase::addReference(int32_t reading)
+{
+  if (!haveReference)
+  {
+    referenceMean = (int64_t)reading * CANCELLER_MEAN_ONE;
+    haveReference = true;
+  }
+  reference = reading;
+  trackMean(referenceMean, reading);
+}
+
+float VibrationCancellerBase::trackMean(int64_t &mean, int32_t reading)
+{
+  int64_t deviation = (int64_t)reading * CANCELLER_MEAN_ONE - mean;
+  mean += deviation >> meanShift;
+  return deviation / (float)CANCELLER_MEAN_ONE;
+}
+
+int32_t VibrationCancellerBase::cancel(int32_t reading)
+{
+  if (!haveReference)
+    return reading;
+
+  if (!haveReading)
+  {
+    readingMean = (int64_t)reading * CANCELLER_MEAN_ONE;
+    haveReading = true;
+  }
+
+  //Shift the held reference deviation into the tap line
+  float power = 0;
+  for (uint8_t i = taps - 1; i > 0; i--)
+  {
+    history[i] = history[i - 1];
+    power += history[i] * history[i];
+  }
+  history[0] = ((int64_t)reference * CANCELLER_MEAN_ONE - referenceMean) / (float)CANCELLER_MEAN_ONE;
+  power += history[0] * history[0];
+
+  float prediction = 0;
+  for (uint8_t i = 0; i < taps; i++)
+    prediction += weights[i] * history[i];
+
+  float error = trackMean(readingMean, reading) - prediction;
+
+  if (adapting && ((freezeThreshold == 0) || (fabs(error) < freezeThreshold)))
+  {
+    float gain = stepSize * error / (CANCELLER_EPSILON + power);
+    for (uint8_t i = 0; i < taps; i++)
+      weights[i] += gain * history[i];
+  }
+
+  cancelled = prediction;
+  return reading - (int32_t)lround(prediction);
+}
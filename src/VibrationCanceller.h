@@ -0,0 +1,81 @@
+#ifndef VIBRATION_CANCELLER_H
+#define VIBRATION_CANCELLER_H
+#include <Arduino.h>
+
+/* Adaptive cancellation of machine vibration using a reference sensor on channel 2, e.g. an
+  unloaded load cell or an accelerometer bridge on the same frame.
+
+  A normalised LMS filter learns the transfer from the reference to the vibration seen on
+  channel 1 and subtracts its prediction from every channel 1 reading. Both signals have their slow
+  component removed by an exponential mean before the fit, so the filter only models vibration and
+  the weight itself passes through untouched. The means are kept in fixed point with 16 fractional
+  bits, so they track 24-bit readings to well under a count at any time constant. With a freeze
+  threshold set, adaptation pauses while the channel 1 error is larger than it, so load changes do
+  not disturb the learned filter. There is no threshold by default, as it depends on the vibration
+  amplitude; set one a few times above it.
+
+  The reference is sampled less often than channel 1 (see QwiicScale::beginInterleave()); the most
+  recent reference sample is held for the channel 1 readings in between, and the taps of the filter
+  absorb the resulting delay.*/
+
+class VibrationCancellerBase
+{
+  public:
+    //Normalised step size, 0 to 1. Larger adapts faster but leaves more misadjustment noise.
+    void setStepSize(float mu) {stepSize = constrain(mu, 0.0f, 1.0f);}
+    //Channel 1 deviations beyond this many counts freeze adaptation. 0 never freezes.
+    void setFreezeThreshold(int32_t counts) {freezeThreshold = counts;}
+    //The means follow the slow component with a time constant of 2^shift samples
+    void setMeanShift(uint8_t shift) {meanShift = min(shift, (uint8_t)15);}
+    void setAdaptation(bool enabled) {adapting = enabled;}
+
+    //Forget the learned filter and the signal history
+    void reset();
+
+    //New reference (channel 2) sample, held until the next one
+    void addReference(int32_t reading);
+    //Channel 1 reading in, reading with the predicted vibration removed out. Readings pass through
+    //unchanged until the first reference sample arrives.
+    int32_t cancel(int32_t reading);
+
+    //Vibration removed from the last reading, counts
+    float getCancelled() {return cancelled;}
+    uint8_t getTaps() {return taps;}
+    const float *getWeights() {return weights;}
+
+  protected:
+    VibrationCancellerBase(float *weights, float *history, uint8_t taps);
+
+    //Move mean towards reading by 1 / 2^meanShift, returning reading - mean before the move
+    float trackMean(int64_t &mean, int32_t reading);
+
+  private:
+    float *weights;
+    float *history;       //Reference deviations, newest first
+    uint8_t taps;
+
+    float stepSize = 0.05f;
+    int32_t freezeThreshold = 0;
+    uint8_t meanShift = 5;
+    bool adapting = true;
+
+    bool haveReference = false;
+    bool haveReading = false;
+    int32_t reference = 0;
+    int64_t referenceMean = 0;   //Counts * 2^CANCELLER_MEAN_FRACTION
+    int64_t readingMean = 0;
+    float cancelled = 0;
+};
+
+//Canceller with TAPS filter taps, 8 bytes each
+template <uint8_t TAPS>
+class VibrationCanceller : public VibrationCancellerBase
+{
+  public:
+    VibrationCanceller() : VibrationCancellerBase(weights, history, TAPS) {};
+
+  private:
+    float weights[TAPS];
+    float history[TAPS];
+};
+#endif //VIBRATION_CANCELLER_H